@@ -0,0 +1,172 @@
+/**
+ * @file client_sweep.c
+ * @brief Compares sweeps over the hot client state in client_hot_table with the same sweeps
+ *        over clients that embed the state, as they did before the hot/cold split.
+ *
+ * Two sweeps run over every client: a liveness sweep (who needs a PING, who is a zombie) and
+ * a matchmaking sweep (who waits for a game of a given size). The embedded clients live in a
+ * slab pool like the real ones, so every client visited costs at least one cache line; the
+ * hot table packs two clients into one.
+ *
+ * Usage: client_sweep [-n clients] [-p passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../def_n_struct.h"
+#include "../slab_pool.h"
+
+/**
+ * A client with its hot state inside, as before the split.
+ */
+typedef struct {
+    client      cold;
+    client_hot  state;
+} embedded_client;
+
+/**
+ * Result of one pass of both sweeps.
+ */
+typedef struct {
+    long    need_ping;      /**< Quiet for PING_SLEEP seconds. */
+    long    zombies;        /**< Silent for PING_ZOMBIE seconds after a PING. */
+    long    waiting;        /**< Waiting for a game on the default board. */
+} sweep_counts;
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Adds one client to the sweep results.
+ */
+static void sweep_one(const client_hot *state, long long now, sweep_counts *counts) {
+    long long quiet = now - state->last_seen;
+    counts->need_ping += state->is_connected && quiet >= PING_SLEEP * 1000;
+    counts->zombies += !state->is_connected && quiet >= PING_ZOMBIE * 1000;
+    counts->waiting += state->is_requesting_game && state->current_game == NULL_HANDLE &&
+                       state->requested_board_size == DEFAULT_BOARD_SIZE;
+}
+
+/**
+ * @brief Sweeps the state embedded in the pooled clients.
+ */
+static sweep_counts sweep_embedded(const slab_pool *pool, int count, long long now) {
+    sweep_counts counts = {0, 0, 0};
+    for (int slot = 0; slot < count; slot++) {
+        const embedded_client *cl = slab_object(pool, slot);
+        sweep_one(&cl->state, now, &counts);
+    }
+    return counts;
+}
+
+/**
+ * @brief Sweeps the hot table.
+ */
+static sweep_counts sweep_table(const client_hot *table, int count, long long now) {
+    sweep_counts counts = {0, 0, 0};
+    for (int slot = 0; slot < count; slot++) {
+        sweep_one(&table[slot], now, &counts);
+    }
+    return counts;
+}
+
+/**
+ * @brief Fills a client's state with a random mix of quiet, silent and waiting clients.
+ */
+static void random_state(client_hot *state, long long now, unsigned int *seed) {
+    memset(state, 0, sizeof(client_hot));
+    state->last_seen = now - rand_r(seed) % (30 * 1000);
+    state->is_connected = rand_r(seed) % 8 != 0;
+    state->is_requesting_game = rand_r(seed) % 16 == 0;
+    state->requested_board_size = rand_r(seed) % 2 == 0 ? DEFAULT_BOARD_SIZE : 8;
+    if (!state->is_requesting_game) {
+        state->current_game = ((game_handle) 1 << 32) | (unsigned int) rand_r(seed);
+    }
+}
+
+/**
+ * @brief Runs one layout for the given number of passes and prints its speed.
+ * @return the counts of the last pass
+ */
+static sweep_counts run(const char *name, const void *layout, int embedded, int count, int passes,
+                        long long now) {
+    sweep_counts counts = {0, 0, 0};
+    double best = 0;
+    double total = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        double start = now_seconds();
+        counts = embedded ? sweep_embedded(layout, count, now) : sweep_table(layout, count, now);
+        double elapsed = now_seconds() - start;
+        total += elapsed;
+        if (pass == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("%-18s %10.3f ms/sweep (best %8.3f) %8.2f ns/client\n", name, total * 1e3 / passes, best * 1e3,
+           total * 1e9 / passes / count);
+    return counts;
+}
+
+int main(int argc, char *argv[]) {
+    int count = 100000;
+    int passes = 50;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'p':
+                passes = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n clients] [-p passes]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (count < 1 || passes < 1) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    slab_pool pool;
+    client_hot *table = aligned_alloc(64, count * sizeof(client_hot));
+    if (table == NULL || !init_slab_pool(&pool, sizeof(embedded_client), count)) {
+        fprintf(stderr, "Failed to allocate %d clients\n", count);
+        return EXIT_FAILURE;
+    }
+
+    // The same states in both layouts
+    long long now = 1000000;
+    unsigned int seed = 12345u;
+    for (int slot = 0; slot < count; slot++) {
+        pool_handle handle;
+        embedded_client *cl = slab_alloc(&pool, &handle);
+        random_state(&table[slot], now, &seed);
+        cl->state = table[slot];
+    }
+
+    printf("%d clients, %d passes; %zu bytes per embedded client, %zu per hot entry\n", count, passes,
+           pool.stride, sizeof(client_hot));
+    sweep_counts embedded = run("embedded in client", &pool, TRUE, count, passes, now);
+    sweep_counts hot = run("client_hot_table", table, FALSE, count, passes, now);
+    printf("need PING %ld, zombies %ld, waiting %ld\n", hot.need_ping, hot.zombies, hot.waiting);
+
+    if (memcmp(&embedded, &hot, sizeof(sweep_counts)) != 0) {
+        fprintf(stderr, "Layouts disagree\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+/**
+ * @file game_contention.c
+ * @brief Measures move throughput of independent games played on 1..N threads.
+ *
+ * Every thread owns its own games and plays random legal moves through validate_move, exactly
+ * as the server does for a MOVE message. The same run is
+ * repeated with one process-wide mutex around every move, which is how moves were
+ * serialized before games had their own locks.
+ *
+ * Usage: game_contention [-t max_threads] [-g games_per_thread] [-b board_size] [-s seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../def_n_struct.h"
+#include "../match_manager.h"
+#include "../rules_engine.h"
+
+/**
+ * Configuration of one measurement.
+ */
+typedef struct {
+    int     games_per_thread;   /**< Number of games owned by every worker. */
+    int     board_size;         /**< Board size of all games. */
+    double  seconds;            /**< Duration of one measurement. */
+    int     global_lock;        /**< Serialize all moves on g_benchMutex when TRUE. */
+} bench_config;
+
+/**
+ * State of one worker thread.
+ */
+typedef struct {
+    pthread_t           thread;
+    const bench_config  *config;
+    client              *players;   /**< Two clients per game. */
+    client_hot          *player_states; /**< Hot state of the players. */
+    unsigned int        seed;
+    long                moves;      /**< Moves played during the measurement. */
+} worker;
+
+/**
+ * Emulates the former global game lock.
+ */
+static pthread_mutex_t g_benchMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Set by the main thread when the measurement is over.
+ */
+static volatile int g_stop = 0;
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Creates a game between two bench clients and seats them like start_match does.
+ * @return TRUE on success, FALSE if the game could not be created
+ */
+static int seat_players(client *first, client *second, int board_size) {
+    game *g = initiate_game_session(first, second, board_size);
+    if (g == NULL) {
+        return FALSE;
+    }
+
+    first->client_char = FIRST_PL_CHAR;
+    first->hot->opponent = second->handle;
+    first->hot->current_game = g->handle;
+
+    second->client_char = SECOND_PL_CHAR;
+    second->hot->opponent = first->handle;
+    second->hot->current_game = g->handle;
+    return TRUE;
+}
+
+/**
+ * @brief Returns the index of the lowest set cell (b must not be 0).
+ */
+static int lowest_cell(bitboard b) {
+    uint64_t low = (uint64_t) b;
+    return low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (b >> 64));
+}
+
+/**
+ * @brief Puts a finished game back to the starting position.
+ */
+static void restart_game(client *first) {
+    game *g = resolve_game(first->hot->current_game);
+    pthread_mutex_lock(&g->lock);
+    setup_initial_board(g->board, g->board_size);
+    init_board_bits(g);
+    g->current_player = first->handle;
+    g->game_status = GAME_PLAYING;
+    g->winner = NULL_HANDLE;
+    pthread_mutex_unlock(&g->lock);
+}
+
+/**
+ * @brief Plays one random legal move in the game of the given players.
+ */
+static void play_move(worker *w, client *first) {
+    game *g = resolve_game(first->hot->current_game);
+    client *mover = g->current_player == first->handle ? first : first + 1;
+    int own = mover->client_char == FIRST_PL_CHAR ? 0 : 1;
+
+    // Pick a random legal target
+    bitboard legal = g->kernel->generate_moves(g->discs[own], g->discs[1 - own]);
+    int legalCount = __builtin_popcountll((uint64_t) legal) + __builtin_popcountll((uint64_t) (legal >> 64));
+    int pick = rand_r(&w->seed) % legalCount;
+    for (int i = 0; i < pick; i++) {
+        legal &= legal - 1;
+    }
+    int cell = lowest_cell(legal);
+
+    if (w->config->global_lock) {
+        pthread_mutex_lock(&g_benchMutex);
+    }
+    int finalStatus;
+    int status = validate_move(mover, cell % g->board_size, cell / g->board_size, &finalStatus, NULL);
+    if (w->config->global_lock) {
+        pthread_mutex_unlock(&g_benchMutex);
+    }
+
+    if (status != TRUE) {
+        fprintf(stderr, "Unexpected move status %d\n", status);
+        exit(EXIT_FAILURE);
+    }
+    if (finalStatus == GAME_WIN || finalStatus == GAME_DRAW) {
+        restart_game(first);
+    }
+}
+
+/**
+ * @brief Worker thread: plays its games round-robin until g_stop is set.
+ */
+static void *worker_main(void *arg) {
+    worker *w = arg;
+    long moves = 0;
+
+    while (!g_stop) {
+        for (int i = 0; i < w->config->games_per_thread; i++) {
+            play_move(w, &w->players[2 * i]);
+        }
+        moves += w->config->games_per_thread;
+    }
+
+    w->moves = moves;
+    return NULL;
+}
+
+/**
+ * @brief Runs one measurement on thread_count workers.
+ * @return moves per second over all workers
+ */
+static double measure(worker *workers, int thread_count, const bench_config *config) {
+    g_stop = 0;
+    for (int t = 0; t < thread_count; t++) {
+        workers[t].config = config;
+        workers[t].moves = 0;
+        pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+    }
+
+    double start = now_seconds();
+    usleep((useconds_t) (config->seconds * 1e6));
+    g_stop = 1;
+
+    long moves = 0;
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(workers[t].thread, NULL);
+        moves += workers[t].moves;
+    }
+    return moves / (now_seconds() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int maxThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    bench_config config = {64, 8, 1.0, FALSE};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:g:b:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                maxThreads = atoi(optarg);
+                break;
+            case 'g':
+                config.games_per_thread = atoi(optarg);
+                break;
+            case 'b':
+                config.board_size = atoi(optarg);
+                break;
+            case 's':
+                config.seconds = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t max_threads] [-g games_per_thread] [-b board_size] [-s seconds]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (maxThreads < 1 || config.games_per_thread < 1 || config.seconds <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    init_rules_engine();
+    if (get_rules_kernel(config.board_size) == NULL) {
+        fprintf(stderr, "Unsupported board size %d\n", config.board_size);
+        return EXIT_FAILURE;
+    }
+    if (!init_game_registry(maxThreads * config.games_per_thread)) {
+        return EXIT_FAILURE;
+    }
+
+    // Create all games up front; the measured loop never touches the global game tables
+    worker *workers = calloc(maxThreads, sizeof(worker));
+    for (int t = 0; t < maxThreads; t++) {
+        workers[t].players = calloc(2 * config.games_per_thread, sizeof(client));
+        workers[t].player_states = calloc(2 * config.games_per_thread, sizeof(client_hot));
+        workers[t].seed = 12345u + t;
+        for (int i = 0; i < config.games_per_thread; i++) {
+            client *first = &workers[t].players[2 * i];
+            client *second = &workers[t].players[2 * i + 1];
+            first->id = 2 * (t * config.games_per_thread + i);
+            second->id = first->id + 1;
+            first->hot = &workers[t].player_states[2 * i];
+            second->hot = &workers[t].player_states[2 * i + 1];
+            // Not pool handles; the rules engine only compares them
+            first->handle = ((client_handle) 1 << 32) | (unsigned int) first->id;
+            second->handle = ((client_handle) 1 << 32) | (unsigned int) second->id;
+            if (!seat_players(first, second, config.board_size)) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf("board %dx%d, %d games per thread, %.1f s per run\n",
+           config.board_size, config.board_size, config.games_per_thread, config.seconds);
+    printf("%8s %18s %8s %18s %8s\n", "threads", "per-game moves/s", "scale", "global moves/s", "scale");
+
+    double perGameBase = 0;
+    double globalBase = 0;
+    // 1, 2, 4, ... threads, always ending with maxThreads
+    for (int threads = 1;; threads *= 2) {
+        if (threads > maxThreads) {
+            threads = maxThreads;
+        }
+        config.global_lock = FALSE;
+        double perGame = measure(workers, threads, &config);
+        config.global_lock = TRUE;
+        double global = measure(workers, threads, &config);
+
+        if (threads == 1) {
+            perGameBase = perGame;
+            globalBase = global;
+        }
+        printf("%8d %18.0f %7.2fx %18.0f %7.2fx\n", threads, perGame, perGame / perGameBase,
+               global, global / globalBase);
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,511 @@
+/**
+ * @file load_generator.c
+ * @brief Drives a running server with many synthetic players and reports end-to-end latency.
+ *
+ * Every connection logs in, asks for a game and plays it with legal moves computed on its own
+ * copy of the board (a scalar rules implementation independent of the server's), then asks
+ * for the next game until the run ends; PINGs are answered. A PASS listing squares means the
+ * opponent passed and the connection moves again. The connections are spread over
+ * worker threads, each serving its share through one epoll instance.
+ *
+ * Latencies are taken from a request to its answer (LOGIN, JOIN_GAME, MOVE), from JOIN_GAME to
+ * START_GAME (matchmaking, which includes waiting for a partner) and from a MOVE to the
+ * opponent receiving its OPP_MOVE (relay). Percentiles come from log-linear histograms with
+ * 16 sub-buckets per power of two (within about 6%).
+ *
+ * Usage: load_generator [-a address] [-p port] [-c connections] [-t threads] [-d seconds] [-b board_size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "../def_n_struct.h"
+
+/**
+ * Measured latencies.
+ */
+enum {
+    LAT_LOGIN,
+    LAT_JOIN,
+    LAT_START,
+    LAT_MOVE,
+    LAT_OPP_MOVE,
+    LAT_TYPES
+};
+
+static const char *g_latencyNames[LAT_TYPES] = {"LOGIN", "JOIN_GAME", "START_GAME", "MOVE", "OPP_MOVE"};
+
+/**
+ * Histogram layout: values below 16 us are exact, larger ones fall into one of 16 sub-buckets
+ * of their power of two.
+ */
+#define HIST_SUB_BITS           4
+#define HIST_BUCKETS            (40 << HIST_SUB_BITS)
+
+typedef struct {
+    long    counts[HIST_BUCKETS];
+    long    total;
+    long    max;
+} histogram;
+
+/**
+ * One synthetic player.
+ */
+typedef struct {
+    int         fd;
+    int         index;                  /**< Also its username: "lg<index>". */
+    int         alive;
+    char        in[MESSAGE_SIZE * 4];   /**< Received bytes not yet split into lines. */
+    size_t      in_len;
+    char        board[MAX_BOARD_SIZE][MAX_BOARD_SIZE];
+    char        color;                  /**< Own color in the current game, 0 outside a game. */
+    int         opponent;               /**< Index of the opponent, -1 if unknown. */
+    long long   login_sent;             /**< When the pending request was sent (us). */
+    long long   join_sent;
+    long long   move_sent;              /**< Read by the opponent's thread for the relay latency. */
+} load_conn;
+
+/**
+ * State of one worker thread.
+ */
+typedef struct {
+    pthread_t       thread;
+    int             first;              /**< First connection served by the worker. */
+    int             count;              /**< Number of connections served by the worker. */
+    unsigned int    seed;
+    histogram       latencies[LAT_TYPES];
+    long            moves;              /**< Accepted moves. */
+    long            games;              /**< Games finished (counted by both players). */
+    long            rejected;           /**< MOVE answers other than success. */
+    long            closed;             /**< Connections closed by the server. */
+} load_worker;
+
+static const int g_directions[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+static load_conn *g_conns;
+static struct sockaddr_in g_server;
+static int g_boardSize = 8;
+static volatile int g_stop = 0;
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+static long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Maps a latency to its histogram bucket.
+ */
+static int bucket_of(long value) {
+    if (value < (1 << HIST_SUB_BITS)) {
+        return value < 0 ? 0 : (int) value;
+    }
+    int exponent = 63 - __builtin_clzll((unsigned long long) value);
+    int bucket = ((exponent - HIST_SUB_BITS + 1) << HIST_SUB_BITS) |
+                 (int) ((value >> (exponent - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Returns the lowest latency of a histogram bucket.
+ */
+static long bucket_floor(int bucket) {
+    if (bucket < (1 << HIST_SUB_BITS)) {
+        return bucket;
+    }
+    int exponent = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    long mantissa = (1 << HIST_SUB_BITS) | (bucket & ((1 << HIST_SUB_BITS) - 1));
+    return mantissa << (exponent - HIST_SUB_BITS);
+}
+
+static void record_latency(histogram *h, long value) {
+    h->counts[bucket_of(value)]++;
+    h->total++;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/**
+ * @brief Returns the latency below which the given fraction of the samples lies.
+ */
+static long percentile(const histogram *h, double fraction) {
+    long rank = (long) (fraction * (double) h->total);
+    long seen = 0;
+    for (int bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += h->counts[bucket];
+        if (seen > rank) {
+            return bucket_floor(bucket);
+        }
+    }
+    return h->max;
+}
+
+/**
+ * @brief Sends a whole line; the connection is dropped if the socket cannot take it.
+ */
+static void send_line(load_worker *w, load_conn *c, const char *line, size_t len) {
+    if (!c->alive) {
+        return;
+    }
+    if (send(c->fd, line, len, MSG_NOSIGNAL) != (ssize_t) len) {
+        c->alive = FALSE;
+        w->closed++;
+        close(c->fd);
+    }
+}
+
+static void send_join(load_worker *w, load_conn *c) {
+    char line[32];
+    int len = snprintf(line, sizeof(line), "JOIN_GAME;%d\n", g_boardSize);
+    c->join_sent = now_us();
+    send_line(w, c, line, (size_t) len);
+}
+
+/**
+ * @brief Counts (and optionally flips) the discs a move at (x, y) encloses.
+ */
+static int play_cell(char board[MAX_BOARD_SIZE][MAX_BOARD_SIZE], char color, int x, int y, int apply) {
+    char other = color == FIRST_PL_CHAR ? SECOND_PL_CHAR : FIRST_PL_CHAR;
+    int flipped = 0;
+    for (int d = 0; d < 8; d++) {
+        int nx = x + g_directions[d][0];
+        int ny = y + g_directions[d][1];
+        int run = 0;
+        while (nx >= 0 && nx < g_boardSize && ny >= 0 && ny < g_boardSize && board[ny][nx] == other) {
+            nx += g_directions[d][0];
+            ny += g_directions[d][1];
+            run++;
+        }
+        if (run == 0 || nx < 0 || nx >= g_boardSize || ny < 0 || ny >= g_boardSize || board[ny][nx] != color) {
+            continue;
+        }
+        flipped += run;
+        for (int i = 1; apply && i <= run; i++) {
+            board[y + i * g_directions[d][1]][x + i * g_directions[d][0]] = color;
+        }
+    }
+    if (apply && flipped > 0) {
+        board[y][x] = color;
+    }
+    return flipped;
+}
+
+/**
+ * @brief Plays a random legal move, if there is one.
+ */
+static void make_move(load_worker *w, load_conn *c) {
+    int legal[MAX_BOARD_SIZE * MAX_BOARD_SIZE];
+    int count = 0;
+    for (int y = 0; y < g_boardSize; y++) {
+        for (int x = 0; x < g_boardSize; x++) {
+            if (c->board[y][x] == EMPTY_CHAR && play_cell(c->board, c->color, x, y, FALSE) > 0) {
+                legal[count++] = y * g_boardSize + x;
+            }
+        }
+    }
+    if (count == 0) {
+        // The server passes the turn back or ends the game
+        return;
+    }
+
+    int cell = legal[rand_r(&w->seed) % count];
+    play_cell(c->board, c->color, cell % g_boardSize, cell / g_boardSize, TRUE);
+    char line[32];
+    int len = snprintf(line, sizeof(line), "MOVE;%d;%d\n", cell % g_boardSize, cell / g_boardSize);
+    __atomic_store_n(&c->move_sent, now_us(), __ATOMIC_RELAXED);
+    send_line(w, c, line, (size_t) len);
+}
+
+/**
+ * @brief Sets up the board of a new game.
+ */
+static void start_board(load_conn *c) {
+    for (int y = 0; y < g_boardSize; y++) {
+        memset(c->board[y], EMPTY_CHAR, (size_t) g_boardSize);
+    }
+    int mid = g_boardSize / 2;
+    c->board[mid - 1][mid - 1] = FIRST_PL_CHAR;
+    c->board[mid - 1][mid] = SECOND_PL_CHAR;
+    c->board[mid][mid - 1] = SECOND_PL_CHAR;
+    c->board[mid][mid] = FIRST_PL_CHAR;
+}
+
+/**
+ * @brief Returns the n-th ';'-separated field of a line (0 is the command), or NULL.
+ */
+static const char *field_of(const char *line, int n) {
+    while (n-- > 0) {
+        line = strchr(line, ';');
+        if (line == NULL) {
+            return NULL;
+        }
+        line++;
+    }
+    return line;
+}
+
+/**
+ * @brief Reacts to one message from the server.
+ */
+static void handle_line(load_worker *w, load_conn *c, const char *line) {
+    long long now = now_us();
+
+    if (strncmp(line, "PING", 4) == 0) {
+        send_line(w, c, "PONG;\n", 6);
+    } else if (strncmp(line, "LOGIN;", 6) == 0) {
+        record_latency(&w->latencies[LAT_LOGIN], (long) (now - c->login_sent));
+        send_join(w, c);
+    } else if (strncmp(line, "JOIN_GAME;", 10) == 0) {
+        record_latency(&w->latencies[LAT_JOIN], (long) (now - c->join_sent));
+    } else if (strncmp(line, "START_GAME;", 11) == 0) {
+        record_latency(&w->latencies[LAT_START], (long) (now - c->join_sent));
+        const char *name = field_of(line, 1);
+        const char *oppColor = field_of(line, 2);
+        const char *starts = field_of(line, 3);
+        if (name == NULL || oppColor == NULL || starts == NULL) {
+            return;
+        }
+        c->opponent = strncmp(name, "lg", 2) == 0 ? atoi(name + 2) : -1;
+        c->color = *oppColor == FIRST_PL_CHAR ? SECOND_PL_CHAR : FIRST_PL_CHAR;
+        start_board(c);
+        if (*starts == '1') {
+            make_move(w, c);
+        }
+    } else if (strncmp(line, "MOVE;", 5) == 0) {
+        record_latency(&w->latencies[LAT_MOVE], (long) (now - __atomic_load_n(&c->move_sent, __ATOMIC_RELAXED)));
+        if (line[5] == '1') {
+            w->moves++;
+        } else {
+            w->rejected++;
+        }
+    } else if (strncmp(line, "OPP_MOVE;", 9) == 0) {
+        const char *y = field_of(line, 2);
+        if (c->color == 0 || y == NULL) {
+            return;
+        }
+        if (c->opponent >= 0) {
+            long long sent = __atomic_load_n(&g_conns[c->opponent].move_sent, __ATOMIC_RELAXED);
+            record_latency(&w->latencies[LAT_OPP_MOVE], (long) (now - sent));
+        }
+        char oppColor = c->color == FIRST_PL_CHAR ? SECOND_PL_CHAR : FIRST_PL_CHAR;
+        play_cell(c->board, oppColor, atoi(line + 9), atoi(y), TRUE);
+        make_move(w, c);
+    } else if (strncmp(line, "PASS;", 5) == 0) {
+        if (c->color != 0 && atoi(line + 5) > 0) {
+            make_move(w, c);
+        }
+    } else if (strncmp(line, "GAME_STATUS;", 12) == 0) {
+        w->games++;
+        c->color = 0;
+        c->opponent = -1;
+        if (!g_stop) {
+            send_join(w, c);
+        }
+    }
+}
+
+/**
+ * @brief Reads what arrived on a connection and handles every complete line.
+ */
+static void read_connection(load_worker *w, load_conn *c) {
+    while (c->alive) {
+        ssize_t got = recv(c->fd, c->in + c->in_len, sizeof(c->in) - 1 - c->in_len, 0);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (got <= 0) {
+            c->alive = FALSE;
+            w->closed++;
+            close(c->fd);
+            return;
+        }
+        c->in_len += (size_t) got;
+        c->in[c->in_len] = '\0';
+
+        char *start = c->in;
+        char *end;
+        while ((end = memchr(start, '\n', c->in_len - (size_t) (start - c->in))) != NULL) {
+            *end = '\0';
+            handle_line(w, c, start);
+            start = end + 1;
+        }
+        c->in_len -= (size_t) (start - c->in);
+        memmove(c->in, start, c->in_len);
+    }
+}
+
+/**
+ * @brief Opens a worker's connections and plays on them until the run ends.
+ */
+static void *run_worker(void *arg) {
+    load_worker *w = arg;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    for (int i = w->first; i < w->first + w->count; i++) {
+        load_conn *c = &g_conns[i];
+        c->index = i;
+        c->opponent = -1;
+        c->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (c->fd == -1 || connect(c->fd, (struct sockaddr *) &g_server, sizeof(g_server)) == -1) {
+            perror("Failed to connect");
+            if (c->fd != -1) {
+                close(c->fd);
+            }
+            w->closed++;
+            continue;
+        }
+        setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+        fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+        c->alive = TRUE;
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &ev);
+
+        char line[32];
+        int len = snprintf(line, sizeof(line), "LOGIN;lg%d\n", i);
+        c->login_sent = now_us();
+        send_line(w, c, line, (size_t) len);
+    }
+
+    struct epoll_event events[256];
+    while (!g_stop) {
+        int count = epoll_wait(epoll_fd, events, 256, 100);
+        for (int i = 0; i < count; i++) {
+            read_connection(w, events[i].data.ptr);
+        }
+    }
+
+    for (int i = w->first; i < w->first + w->count; i++) {
+        if (g_conns[i].alive) {
+            close(g_conns[i].fd);
+        }
+    }
+    close(epoll_fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *address = "127.0.0.1";
+    int port = PORT;
+    int connections = 1000;
+    int threads = 4;
+    int seconds = 10;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:c:t:d:b:")) != -1) {
+        switch (opt) {
+            case 'a':
+                address = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'c':
+                connections = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'b':
+                g_boardSize = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-a address] [-p port] [-c connections] [-t threads] [-d seconds] "
+                                "[-b board_size]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (connections < 2 || threads <= 0 || threads > connections || seconds <= 0 || g_boardSize < 4 ||
+        g_boardSize > MAX_BOARD_SIZE || g_boardSize % 2 != 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+    memset(&g_server, 0, sizeof(g_server));
+    g_server.sin_family = AF_INET;
+    g_server.sin_port = htons((uint16_t) port);
+    if (inet_pton(AF_INET, address, &g_server.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address: %s\n", address);
+        return EXIT_FAILURE;
+    }
+
+    // Thousands of sockets need more than the default descriptor limit
+    struct rlimit fdLimit;
+    if (getrlimit(RLIMIT_NOFILE, &fdLimit) == 0) {
+        fdLimit.rlim_cur = fdLimit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fdLimit);
+    }
+
+    g_conns = calloc((size_t) connections, sizeof(load_conn));
+    load_worker *workers = calloc((size_t) threads, sizeof(load_worker));
+    if (g_conns == NULL || workers == NULL) {
+        perror("Failed to allocate the connections");
+        return EXIT_FAILURE;
+    }
+
+    long long start = now_us();
+    for (int i = 0; i < threads; i++) {
+        workers[i].first = (int) ((long) connections * i / threads);
+        workers[i].count = (int) ((long) connections * (i + 1) / threads) - workers[i].first;
+        workers[i].seed = (unsigned int) (i * 7919 + 1);
+        if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+            perror("Failed to launch a worker");
+            return EXIT_FAILURE;
+        }
+    }
+    sleep((unsigned int) seconds);
+    g_stop = 1;
+
+    histogram merged[LAT_TYPES];
+    memset(merged, 0, sizeof(merged));
+    long moves = 0, games = 0, rejected = 0, closed = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (int type = 0; type < LAT_TYPES; type++) {
+            for (int bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+                merged[type].counts[bucket] += workers[i].latencies[type].counts[bucket];
+            }
+            merged[type].total += workers[i].latencies[type].total;
+            if (workers[i].latencies[type].max > merged[type].max) {
+                merged[type].max = workers[i].latencies[type].max;
+            }
+        }
+        moves += workers[i].moves;
+        games += workers[i].games;
+        rejected += workers[i].rejected;
+        closed += workers[i].closed;
+    }
+    double elapsed = (double) (now_us() - start) / 1e6;
+
+    printf("%d connections on %d threads, board %dx%d, %.1f s\n", connections, threads, g_boardSize, g_boardSize,
+           elapsed);
+    printf("%-11s %10s %10s %10s %10s %10s\n", "latency us", "count", "p50", "p99", "p999", "max");
+    for (int type = 0; type < LAT_TYPES; type++) {
+        const histogram *h = &merged[type];
+        printf("%-11s %10ld %10ld %10ld %10ld %10ld\n", g_latencyNames[type], h->total, percentile(h, 0.5),
+               percentile(h, 0.99), percentile(h, 0.999), h->max);
+    }
+    printf("moves/sec %.0f, games %ld, rejected moves %ld, closed connections %ld\n", moves / elapsed, games / 2,
+           rejected, closed);
+    return rejected == 0 && closed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file message_bench.c
+ * @brief Compares the message builders with the former sprintf/strlen formatting.
+ *
+ * Every round formats what one move and one reconnection cost: the MOVE answer, the OPP_MOVE
+ * for the opponent, a GAME_STATUS and a RECONNECT for both players on a full-size board.
+ * Each finished message is handed to a sink that copies it like the output queue does;
+ * the legacy variant measures it with strlen first, as transmit_message did. The binary
+ * variant shows the cost and the size of the same round in the binary encoding.
+ *
+ * Usage: message_bench [-n rounds] [-b board_size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../message_builder.h"
+
+/**
+ * Output of the last round (one round fits), compared between the variants.
+ */
+typedef struct {
+    char    data[4 * RECONNECT_MESSAGE_SIZE + OPP_MOVE_MESSAGE_SIZE];
+    size_t  len;
+} sink;
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Takes one message, as append_output does.
+ */
+static void emit(sink *out, const char *data, size_t len) {
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
+
+/**
+ * Legal targets sent with OPP_MOVE (every other empty cell of the board).
+ */
+static legal_squares g_nextMoves;
+
+/**
+ * @brief One round formatted as before the builders existed.
+ */
+static void legacy_round(sink *out, const game *g, const client *cl, const client *opponent, int x, int y) {
+    char response[MOVE_MESS_RESP_SIZE] = {0};
+    sprintf(response, "MOVE;%c;%c;%c\n", TRUE + '0', x + '0', y + '0');
+    emit(out, response, strlen(response));
+
+    char oppMsg[OPP_MOVE_MESSAGE_SIZE] = {0};
+    int squares = 0;
+    for (int cell = 0; cell < g->board_size * g->board_size; cell++) {
+        squares += (int) (g_nextMoves.cells >> cell) & 1;
+    }
+    sprintf(oppMsg, "OPP_MOVE;%c;%c;%d", x + '0', y + '0', squares);
+    for (int cell = 0; cell < g->board_size * g->board_size; cell++) {
+        if ((g_nextMoves.cells >> cell) & 1) {
+            sprintf(oppMsg + strlen(oppMsg), ";%d;%d", cell % g->board_size, cell / g->board_size);
+        }
+    }
+    sprintf(oppMsg + strlen(oppMsg), "\n");
+    emit(out, oppMsg, strlen(oppMsg));
+
+    char status[GAME_STATUS_RESP_SIZE] = {0};
+    sprintf(status, "GAME_STATUS;%s\n", cl->username);
+    emit(out, status, strlen(status));
+
+    char reconnect[RECONNECT_MESSAGE_SIZE] = {0};
+    sprintf(reconnect, "RECONNECT;");
+    for (int row = 0; row < g->board_size; row++) {
+        for (int col = 0; col < g->board_size; col++) {
+            sprintf(reconnect + strlen(reconnect), "%c", g->board[row][col]);
+        }
+    }
+    sprintf(reconnect + strlen(reconnect), ";%s;%s;", cl->username, opponent->username);
+    char oppReconnect[RECONNECT_MESSAGE_SIZE] = {0};
+    strcpy(oppReconnect, reconnect);
+    sprintf(reconnect + strlen(reconnect), "%c\n", opponent->client_char);
+    sprintf(oppReconnect + strlen(oppReconnect), "%c\n", cl->client_char);
+    emit(out, reconnect, strlen(reconnect));
+    emit(out, oppReconnect, strlen(oppReconnect));
+}
+
+/**
+ * @brief The same round through the builders, in the given encoding.
+ */
+static void encoded_round(sink *out, const game *g, const client *cl, const client *opponent, int x, int y,
+                          int protocol) {
+    message_buffer msg;
+    init_message(&msg, protocol);
+    build_move_result(&msg, TRUE, x, y);
+    emit(out, msg.data, msg.len);
+
+    build_opp_move(&msg, x, y, &g_nextMoves);
+    emit(out, msg.data, msg.len);
+
+    build_game_status(&msg, cl);
+    emit(out, msg.data, msg.len);
+
+    size_t sharedLen = build_reconnect_state(&msg, g, cl, opponent);
+    finish_reconnect(&msg, sharedLen, opponent->client_char);
+    emit(out, msg.data, msg.len);
+    finish_reconnect(&msg, sharedLen, cl->client_char);
+    emit(out, msg.data, msg.len);
+}
+
+/**
+ * @brief The round through the builders in text.
+ */
+static void builder_round(sink *out, const game *g, const client *cl, const client *opponent, int x, int y) {
+    encoded_round(out, g, cl, opponent, x, y, PROTOCOL_TEXT);
+}
+
+/**
+ * @brief The round through the builders in binary.
+ */
+static void binary_round(sink *out, const game *g, const client *cl, const client *opponent, int x, int y) {
+    encoded_round(out, g, cl, opponent, x, y, PROTOCOL_BINARY);
+}
+
+/**
+ * @brief Runs a variant and prints its speed.
+ */
+static void run(const char *name,
+                void (*round)(sink *, const game *, const client *, const client *, int, int),
+                sink *out, const game *g, const client *cl, const client *opponent, long rounds) {
+    double start = now_seconds();
+    for (long i = 0; i < rounds; i++) {
+        int cell = (int) (i % (g->board_size * g->board_size));
+        out->len = 0;
+        round(out, g, cl, opponent, cell % g->board_size, cell / g->board_size);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-10s %8.1f ns/round %8.1f ns/message %6zu bytes/round\n", name, elapsed * 1e9 / rounds,
+           elapsed * 1e9 / rounds / 5, out->len);
+}
+
+int main(int argc, char *argv[]) {
+    long rounds = 2000000;
+    int boardSize = MAX_BOARD_SIZE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:")) != -1) {
+        switch (opt) {
+            case 'n':
+                rounds = atol(optarg);
+                break;
+            case 'b':
+                boardSize = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n rounds] [-b board_size]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (rounds <= 0 || boardSize < 4 || boardSize > MAX_BOARD_SIZE) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    static game g;
+    static client players[2];
+    g.board_size = boardSize;
+    for (int row = 0; row < boardSize; row++) {
+        for (int col = 0; col < boardSize; col++) {
+            g.board[row][col] = (row * 7 + col * 3) % 3 == 0 ? EMPTY_CHAR : (col % 2 ? FIRST_PL_CHAR : SECOND_PL_CHAR);
+            if (g.board[row][col] == EMPTY_CHAR && (row + col) % 2 == 0) {
+                g_nextMoves.cells |= (bitboard) 1 << (row * boardSize + col);
+            }
+        }
+    }
+    g_nextMoves.board_size = boardSize;
+    strcpy(players[0].username, "first_player_name");
+    strcpy(players[1].username, "second");
+    for (int i = 0; i < 2; i++) {
+        players[i].username_len = (int) strlen(players[i].username);
+        players[i].client_char = i == 0 ? FIRST_PL_CHAR : SECOND_PL_CHAR;
+    }
+
+    static sink legacy;
+    static sink built;
+    static sink binary;
+    printf("board %dx%d, %ld rounds of MOVE, OPP_MOVE, GAME_STATUS and RECONNECT x2\n", boardSize, boardSize, rounds);
+    run("sprintf", legacy_round, &legacy, &g, &players[0], &players[1], rounds);
+    run("builder", builder_round, &built, &g, &players[0], &players[1], rounds);
+    run("binary", binary_round, &binary, &g, &players[0], &players[1], rounds);
+
+    if (legacy.len != built.len || memcmp(legacy.data, built.data, legacy.len) != 0) {
+        fprintf(stderr, "Outputs differ\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file parser_bench.c
+ * @brief Compares the single-pass message parser with the former strtok/strcmp/atoi parsing.
+ *
+ * Both parsers run over the same mix of client messages (mostly MOVE and PONG, as in a
+ * running game). The legacy variant copies each message first, because strtok rewrites it.
+ *
+ * Usage: parser_bench [-n iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../message_parser.h"
+
+/**
+ * The message mix; MOVE and PONG dominate real traffic.
+ */
+static const char *g_messages[] = {
+        "MOVE;3;1", "PONG;", "MOVE;0;7", "PONG;", "MOVE;12;9", "MOVE;5;5",
+        "JOIN_GAME;8", "WAIT_REPLY;WAIT", "LOGIN;player_name", "LOGOUT;",
+};
+#define MESSAGE_COUNT (sizeof(g_messages) / sizeof(g_messages[0]))
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief The parsing done by process_client_message before the parser existed.
+ * @return a value depending on the parsed fields (keeps the work observable)
+ */
+static int legacy_parse(const char *message, size_t length) {
+    char copy[MESSAGE_SIZE];
+    memcpy(copy, message, length);
+    copy[length] = '\0';
+
+    char *token = strtok(copy, MESS_DELIMITER);
+    if (token == NULL) {
+        return 0;
+    }
+    if (strcmp(token, "MOVE") == 0) {
+        int x = atoi(strtok(NULL, MESS_DELIMITER));
+        int y = atoi(strtok(NULL, MESS_DELIMITER));
+        return 1 + x + y;
+    } else if (strcmp(token, "JOIN_GAME") == 0) {
+        token = strtok(NULL, MESS_DELIMITER);
+        return 2 + ((token != NULL && atoi(token) > 0) ? atoi(token) : DEFAULT_BOARD_SIZE);
+    } else if (strcmp(token, "LOGOUT") == 0) {
+        return 3;
+    } else if (strcmp(token, "PONG") == 0) {
+        return 4;
+    } else if (strcmp(token, "WAIT_REPLY") == 0) {
+        token = strtok(NULL, MESS_DELIMITER);
+        return 5 + (strncmp(token, "WAIT", 4) == 0);
+    } else if (strcmp(token, "LOGIN") == 0) {
+        token = strtok(NULL, MESS_END_CHAR);
+        return 6 + (int) strlen(token);
+    }
+    return 0;
+}
+
+/**
+ * @brief The same work done through parse_message.
+ */
+static int view_parse(const char *message, size_t length) {
+    parsed_message parsed;
+    parse_message(message, length, &parsed);
+    switch (parsed.command) {
+        case CMD_MOVE:
+            return 1 + parsed.x + parsed.y;
+        case CMD_JOIN_GAME:
+            return 2 + parsed.board_size;
+        case CMD_LOGOUT:
+            return 3;
+        case CMD_PONG:
+            return 4;
+        case CMD_WAIT_REPLY:
+            return 5 + parsed.wait;
+        case CMD_LOGIN:
+            return 6 + (int) parsed.username.len;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Runs a parser over the message mix and prints its speed.
+ * @return the checksum of the results
+ */
+static long run(const char *name, int (*parse)(const char *, size_t), long iterations) {
+    size_t lengths[MESSAGE_COUNT];
+    for (size_t i = 0; i < MESSAGE_COUNT; i++) {
+        lengths[i] = strlen(g_messages[i]);
+    }
+
+    long checksum = 0;
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        size_t idx = (size_t) i % MESSAGE_COUNT;
+        checksum += parse(g_messages[idx], lengths[idx]);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-14s %8.1f ns/message %12.0f messages/s\n", name, elapsed * 1e9 / iterations, iterations / elapsed);
+    return checksum;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = 20000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            iterations = atol(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-n iterations]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    long legacy = run("strtok/atoi", legacy_parse, iterations);
+    long views = run("parse_message", view_parse, iterations);
+    if (legacy != views) {
+        fprintf(stderr, "Parsers disagree: %ld != %ld\n", legacy, views);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
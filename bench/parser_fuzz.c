@@ -0,0 +1,574 @@
+/**
+ * @file parser_fuzz.c
+ * @brief Feeds random and mutated client input to the message parsers and to the framing of
+ *        the receive buffer, and checks every result against what the parsers promise.
+ *
+ * Three rounds draw from one seeded generator, so a failure replays with the same -s:
+ *  - text lines: every command with valid, truncated and oversized fields, then randomly
+ *    mutated, through parse_message;
+ *  - binary frame bodies: every opcode with short, exact and long bodies, through
+ *    parse_binary_message, compared with a plain decoding of the opcode table;
+ *  - streams of lines (or frames) cut into random reads, through next_message (or next_frame),
+ *    compared with the messages that were sent; each message taken out is parsed as well.
+ * Every parsed input is copied to a heap block of exactly its length first, so the build with
+ * -fsanitize=address,undefined (see the Makefile) reports any read past a message.
+ *
+ * Usage: parser_fuzz [-n iterations] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "../def_n_struct.h"
+#include "../message_parser.h"
+#include "../network_interface.h"
+
+/**
+ * Messages per stream of the framing round.
+ */
+#define STREAM_MESSAGES         32
+
+/**
+ * Bytes a stream may need: every message at its longest, with its terminator or header.
+ */
+#define STREAM_CAPACITY         (STREAM_MESSAGES * (MESSAGE_SIZE + 128))
+
+/**
+ * Failing inputs printed before the rest are only counted.
+ */
+#define MAX_REPORTED            10
+
+/**
+ * A text message and the command parse_message has to find in it.
+ */
+typedef struct {
+    const char      *text;
+    command_type    expected;
+} text_seed;
+
+/**
+ * The whole command set, with fields missing, empty, out of range and longer than the server keeps.
+ */
+static const text_seed g_textSeeds[] = {
+        {"LOGIN;player",                                CMD_LOGIN},
+        {"LOGIN;player;BIN",                            CMD_LOGIN},
+        {"LOGIN;player;BINARY",                         CMD_LOGIN},
+        {"LOGIN;a_name_far_longer_than_PLAYER_NAME_SIZE", CMD_LOGIN},
+        {"LOGIN;",                                      CMD_INVALID},
+        {"LOGIN",                                       CMD_INVALID},
+        {"MOVE;3;1",                                    CMD_MOVE},
+        {"MOVE;0;0;",                                   CMD_MOVE},
+        {"MOVE;999;999",                                CMD_MOVE},
+        {"MOVE;0000000000000000000000003;1",            CMD_MOVE},
+        {"MOVE;1000;1",                                 CMD_INVALID},
+        {"MOVE;4294967299;1",                           CMD_INVALID},
+        {"MOVE;-1;2",                                   CMD_INVALID},
+        {"MOVE;3",                                      CMD_INVALID},
+        {"MOVE;3;",                                     CMD_INVALID},
+        {"MOVE;;",                                      CMD_INVALID},
+        {"MOVE",                                        CMD_INVALID},
+        {"JOIN_GAME",                                   CMD_JOIN_GAME},
+        {"JOIN_GAME;",                                  CMD_JOIN_GAME},
+        {"JOIN_GAME;8",                                 CMD_JOIN_GAME},
+        {"JOIN_GAME;10",                                CMD_JOIN_GAME},
+        {"JOIN_GAME;11",                                CMD_INVALID},
+        {"JOIN_GAME;8x",                                CMD_INVALID},
+        {"LOGOUT",                                      CMD_LOGOUT},
+        {"LOGOUT;",                                     CMD_LOGOUT},
+        {"PONG",                                        CMD_PONG},
+        {"PONG;",                                       CMD_PONG},
+        {"WAIT_REPLY;WAIT",                             CMD_WAIT_REPLY},
+        {"WAIT_REPLY;NOT_WAIT",                         CMD_WAIT_REPLY},
+        {"WAIT_REPLY;",                                 CMD_INVALID},
+        {"WAIT_REPLY",                                  CMD_INVALID},
+        {"",                                            CMD_INVALID},
+        {";",                                           CMD_INVALID},
+        {"MOVEX;1;2",                                   CMD_INVALID},
+        {"move;1;2",                                    CMD_INVALID},
+};
+#define TEXT_SEED_COUNT ((int) (sizeof(g_textSeeds) / sizeof(g_textSeeds[0])))
+
+/**
+ * The client opcodes, and two bytes that are none.
+ */
+static const unsigned char g_opcodes[] = {BIN_MOVE, BIN_JOIN_GAME, BIN_LOGOUT, BIN_PONG, BIN_WAIT_REPLY,
+                                          0x00, BIN_PING};
+#define OPCODE_COUNT ((int) (sizeof(g_opcodes) / sizeof(g_opcodes[0])))
+
+/**
+ * Failing inputs found so far.
+ */
+static long g_failures = 0;
+
+/**
+ * @brief Returns a random number in 0..bound-1.
+ */
+static int pick(unsigned int *seed, int bound) {
+    return rand_r(seed) % bound;
+}
+
+/**
+ * @brief Prints a failing input (non-printable bytes escaped) unless enough have been shown.
+ */
+static void report(const char *round, const char *reason, const char *data, size_t len) {
+    if (++g_failures > MAX_REPORTED) {
+        return;
+    }
+    fprintf(stderr, "%s: %s: \"", round, reason);
+    for (size_t i = 0; i < len && i < 120; i++) {
+        unsigned char c = (unsigned char) data[i];
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+            fputc(c, stderr);
+        } else {
+            fprintf(stderr, "\\x%02x", c);
+        }
+    }
+    fprintf(stderr, "%s\" (%zu bytes)\n", len > 120 ? "..." : "", len);
+}
+
+/**
+ * @brief Checks the fields the parsers fill in against their documented ranges.
+ * @param message The parsed bytes
+ * @param length Number of parsed bytes
+ * @param accepted The parser's return value
+ * @param parsed The parser's result
+ * @return NULL if the result is consistent, otherwise what is wrong with it
+ */
+static const char *check_result(const char *message, size_t length, int accepted, const parsed_message *parsed) {
+    if (accepted != TRUE && accepted != FALSE) {
+        return "return value is neither TRUE nor FALSE";
+    }
+    if (accepted != (parsed->command != CMD_INVALID)) {
+        return "return value and command disagree";
+    }
+    switch (parsed->command) {
+        case CMD_LOGIN:
+            if (parsed->username.len == 0 || parsed->username.ptr < message ||
+                parsed->username.ptr + parsed->username.len > message + length) {
+                return "username view outside the message";
+            }
+            if (parsed->protocol != PROTOCOL_TEXT && parsed->protocol != PROTOCOL_BINARY) {
+                return "unknown protocol";
+            }
+            break;
+        case CMD_MOVE:
+            if (parsed->x < 0 || parsed->x > MOVE_COORD_MAX || parsed->y < 0 || parsed->y > MOVE_COORD_MAX) {
+                return "coordinate out of range";
+            }
+            break;
+        case CMD_JOIN_GAME:
+            if (parsed->board_size < 0 || parsed->board_size > MAX_BOARD_SIZE) {
+                return "board size out of range";
+            }
+            break;
+        case CMD_WAIT_REPLY:
+            if (parsed->wait != TRUE && parsed->wait != FALSE) {
+                return "wait is neither TRUE nor FALSE";
+            }
+            break;
+        default:
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses a text line from a heap block of exactly its length and checks the result.
+ * @param round Name of the calling round, for the report
+ * @param expected The command the line must yield, or -1 if unknown
+ * @return TRUE if the line was accepted
+ */
+static int fuzz_text_line(const char *round, const char *line, size_t len, int expected) {
+    char *copy = malloc(len > 0 ? len : 1);
+    memcpy(copy, line, len);
+
+    parsed_message parsed;
+    int accepted = parse_message(copy, len, &parsed);
+    const char *problem = check_result(copy, len, accepted, &parsed);
+    if (problem == NULL && expected >= 0 && parsed.command != (command_type) expected) {
+        problem = "unexpected command";
+    }
+    if (problem != NULL) {
+        report(round, problem, line, len);
+    }
+    free(copy);
+    return accepted;
+}
+
+/**
+ * @brief Decodes a binary body the plain way, straight from the opcode table in def_n_struct.h.
+ * @param expected Receives the fields the body must yield
+ * @return The command the body must yield
+ */
+static command_type decode_binary(const unsigned char *body, size_t len, parsed_message *expected) {
+    if (len == 0) {
+        return CMD_INVALID;
+    }
+    switch (body[0]) {
+        case BIN_MOVE:
+            expected->x = len >= 3 ? body[1] : 0;
+            expected->y = len >= 3 ? body[2] : 0;
+            return len >= 3 ? CMD_MOVE : CMD_INVALID;
+        case BIN_JOIN_GAME:
+            expected->board_size = len >= 2 ? body[1] : DEFAULT_BOARD_SIZE;
+            return expected->board_size <= MAX_BOARD_SIZE ? CMD_JOIN_GAME : CMD_INVALID;
+        case BIN_WAIT_REPLY:
+            expected->wait = len >= 2 && body[1] != 0;
+            return len >= 2 ? CMD_WAIT_REPLY : CMD_INVALID;
+        case BIN_LOGOUT:
+            return CMD_LOGOUT;
+        case BIN_PONG:
+            return CMD_PONG;
+        default:
+            return CMD_INVALID;
+    }
+}
+
+/**
+ * @brief Parses a binary body from a heap block of exactly its length and compares the result
+ *        with decode_binary.
+ * @param round Name of the calling round, for the report
+ * @return TRUE if the body was accepted
+ */
+static int fuzz_binary_body(const char *round, const char *body, size_t len) {
+    char *copy = malloc(len > 0 ? len : 1);
+    memcpy(copy, body, len);
+
+    parsed_message parsed, expected;
+    int accepted = parse_binary_message(copy, len, &parsed);
+    command_type command = decode_binary((const unsigned char *) body, len, &expected);
+    const char *problem = check_result(copy, len, accepted, &parsed);
+    if (problem == NULL && parsed.command != command) {
+        problem = "unexpected command";
+    } else if (problem == NULL && command == CMD_MOVE && (parsed.x != expected.x || parsed.y != expected.y)) {
+        problem = "wrong coordinates";
+    } else if (problem == NULL && command == CMD_JOIN_GAME && parsed.board_size != expected.board_size) {
+        problem = "wrong board size";
+    } else if (problem == NULL && command == CMD_WAIT_REPLY && parsed.wait != expected.wait) {
+        problem = "wrong wait flag";
+    }
+    if (problem != NULL) {
+        report(round, problem, body, len);
+    }
+    free(copy);
+    return accepted;
+}
+
+/**
+ * @brief Builds a text line: a seed, often mutated (bytes replaced, inserted or removed,
+ *        delimiters added, the line cut short or a field grown up to the message limit).
+ * @param line Buffer of MESSAGE_SIZE bytes
+ * @param expected Receives the command the line must yield, or -1 once it is mutated
+ * @return Length of the line, below MESSAGE_SIZE
+ */
+static size_t make_text_line(unsigned int *seed, char *line, int *expected) {
+    const text_seed *base = &g_textSeeds[pick(seed, TEXT_SEED_COUNT)];
+    size_t len = strlen(base->text);
+    memcpy(line, base->text, len);
+    *expected = (int) base->expected;
+
+    int mutations = pick(seed, 4);
+    for (int m = 0; m < mutations; m++) {
+        size_t pos = len > 0 ? (size_t) pick(seed, (int) len + 1) : 0;
+        *expected = -1;
+        switch (pick(seed, 6)) {
+            case 0:
+                if (pos < len) {
+                    line[pos] = (char) pick(seed, 256);
+                }
+                break;
+            case 1:
+            case 2:
+                if (len < MESSAGE_SIZE - 1) {
+                    memmove(line + pos + 1, line + pos, len - pos);
+                    line[pos] = pick(seed, 2) ? MESS_DELIMITER[0] : (char) pick(seed, 256);
+                    len++;
+                }
+                break;
+            case 3:
+                if (pos < len) {
+                    memmove(line + pos, line + pos + 1, len - pos - 1);
+                    len--;
+                }
+                break;
+            case 4:
+                len = pos;
+                break;
+            default: {
+                // An oversized field: a long run of one byte (digits overflow numbers, letters names)
+                size_t grow = (size_t) pick(seed, MESSAGE_SIZE - (int) len);
+                char fill = "9aZ;"[pick(seed, 4)];
+                memmove(line + pos + grow, line + pos, len - pos);
+                memset(line + pos, fill, grow);
+                len += grow;
+                break;
+            }
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Builds a binary frame body: a client opcode (or a wrong one) and random field bytes,
+ *        shorter than, exactly as long as or longer than the opcode needs.
+ * @param body Buffer of MESSAGE_SIZE bytes
+ * @return Length of the body, below MESSAGE_SIZE
+ */
+static size_t make_binary_body(unsigned int *seed, char *body) {
+    size_t len = (size_t) pick(seed, 6);
+    if (pick(seed, 16) == 0) {
+        len = (size_t) pick(seed, MESSAGE_SIZE);
+    }
+    for (size_t i = 0; i < len; i++) {
+        body[i] = (char) pick(seed, 256);
+    }
+    if (len > 0 && pick(seed, 8) != 0) {
+        body[0] = (char) g_opcodes[pick(seed, OPCODE_COUNT)];
+    }
+    // Board sizes around the limit are the interesting ones
+    if (len >= 2 && (unsigned char) body[0] == BIN_JOIN_GAME && pick(seed, 2)) {
+        body[1] = (char) pick(seed, MAX_BOARD_SIZE + 3);
+    }
+    return len;
+}
+
+/**
+ * @brief A stream sent to the framing round and the messages it must yield.
+ */
+typedef struct {
+    char    bytes[STREAM_CAPACITY];             /**< The stream. */
+    size_t  len;                                /**< Bytes in the stream. */
+    size_t  offsets[STREAM_MESSAGES];           /**< Where each expected message starts in bytes. */
+    size_t  lengths[STREAM_MESSAGES];           /**< Length of each expected message. */
+    int     count;                              /**< Number of expected messages. */
+    int     too_long;                           /**< Set if the reader must stop with MESSAGE_TOO_LONG after them. */
+} fuzz_stream;
+
+/**
+ * @brief Builds a stream of text lines or binary frames: mostly valid messages, empty ones
+ *        (skipped by the readers), sometimes one over the limit (which ends the stream) and
+ *        sometimes an unfinished one at the end.
+ */
+static void make_stream(unsigned int *seed, int binary, fuzz_stream *stream) {
+    char message[MESSAGE_SIZE];
+    int expected;
+    stream->len = 0;
+    stream->count = 0;
+    stream->too_long = FALSE;
+
+    int messages = 1 + pick(seed, STREAM_MESSAGES);
+    for (int i = 0; i < messages; i++) {
+        size_t len;
+        if (pick(seed, 24) == 0) {
+            // Over the limit: MESSAGE_SIZE bytes or more without a terminator (or announced so)
+            len = MESSAGE_SIZE + (size_t) pick(seed, 100);
+            memset(message, 'A', sizeof(message));
+            stream->too_long = TRUE;
+        } else if (pick(seed, 10) == 0) {
+            len = 0;
+        } else {
+            len = binary ? make_binary_body(seed, message) : make_text_line(seed, message, &expected);
+        }
+
+        char *out = stream->bytes + stream->len;
+        if (binary) {
+            out[0] = (char) (len >> 8);
+            out[1] = (char) (len & 0xff);
+            out += BIN_HEADER_SIZE;
+            stream->len += BIN_HEADER_SIZE;
+        }
+        if (stream->too_long) {
+            // The reader gives up before the body (or terminator) could matter
+            size_t sent = binary ? (size_t) pick(seed, 8) : len;
+            memset(out, 'A', sent);
+            stream->len += sent;
+            return;
+        }
+
+        if (!binary) {
+            // A line cannot hold its terminator
+            for (size_t b = 0; b < len; b++) {
+                if (message[b] == MESS_END_CHAR[0]) {
+                    message[b] = MESS_DELIMITER[0];
+                }
+            }
+        }
+        memcpy(out, message, len);
+        if (len > 0) {
+            stream->offsets[stream->count] = (size_t) (out - stream->bytes);
+            stream->lengths[stream->count] = len;
+            stream->count++;
+        }
+        stream->len += len;
+        if (!binary) {
+            stream->bytes[stream->len++] = MESS_END_CHAR[0];
+        }
+    }
+
+    // An unfinished message stays in the buffer
+    if (pick(seed, 4) == 0) {
+        size_t len = binary ? make_binary_body(seed, message) : make_text_line(seed, message, &expected);
+        if (binary) {
+            // The header announces one byte more than follows, and stays within the limit
+            len = len < MESSAGE_SIZE - 2 ? len : MESSAGE_SIZE - 2;
+            stream->bytes[stream->len++] = (char) ((len + 1) >> 8);
+            stream->bytes[stream->len++] = (char) ((len + 1) & 0xff);
+        }
+        for (size_t b = 0; b < len; b++) {
+            stream->bytes[stream->len++] = message[b] == MESS_END_CHAR[0] ? MESS_DELIMITER[0] : message[b];
+        }
+    }
+}
+
+/**
+ * @brief Sends a stream through a receive buffer in random reads and checks that next_message
+ *        (or next_frame) returns exactly the messages of the stream.
+ * @param binary TRUE for frames, FALSE for lines
+ * @param in The receive buffer (its counters start anywhere, so they also wrap around)
+ * @return Number of messages taken out
+ */
+static int fuzz_stream_framing(unsigned int *seed, int binary, fuzz_stream *stream, recv_buffer *in) {
+    const char *round = binary ? "next_frame" : "next_message";
+    int (*next)(recv_buffer *, char *, char **, size_t *) = binary ? next_frame : next_message;
+    char scratch[MESSAGE_SIZE];
+
+    make_stream(seed, binary, stream);
+    init_receive_buffer(in);
+    in->head = in->tail = UINT_MAX - (unsigned int) pick(seed, 2 * RECV_BUFFER_SIZE);
+
+    size_t sent = 0;
+    int taken = 0;
+    while (1) {
+        // One read: whatever fits, cut at a random length
+        unsigned int room = RECV_BUFFER_SIZE - (in->tail - in->head);
+        size_t chunk = stream->len - sent;
+        if (chunk > room) {
+            chunk = room;
+        }
+        if (chunk > 1) {
+            chunk = 1 + (size_t) pick(seed, (int) chunk);
+        }
+        for (size_t b = 0; b < chunk; b++) {
+            in->data[(in->tail + b) & (RECV_BUFFER_SIZE - 1)] = stream->bytes[sent + b];
+        }
+        in->tail += (unsigned int) chunk;
+        sent += chunk;
+
+        char *message;
+        size_t length;
+        int status;
+        while ((status = next(in, scratch, &message, &length)) == TRUE) {
+            if (taken >= stream->count) {
+                report(round, "message that was never sent", message, length);
+                return taken;
+            }
+            const char *expected = stream->bytes + stream->offsets[taken];
+            if (length != stream->lengths[taken] || memcmp(message, expected, length) != 0) {
+                report(round, "message differs from the one sent", expected, stream->lengths[taken]);
+                return taken;
+            }
+            if (!binary && message[length] != '\0') {
+                report(round, "line not NUL-terminated", expected, length);
+            }
+            if (binary) {
+                fuzz_binary_body(round, message, length);
+            } else {
+                fuzz_text_line(round, message, length, -1);
+            }
+            taken++;
+        }
+
+        if (status == MESSAGE_TOO_LONG) {
+            if (!stream->too_long || taken != stream->count) {
+                report(round, "MESSAGE_TOO_LONG for messages within the limit", stream->bytes, stream->len);
+            }
+            return taken;
+        }
+        if (status != FALSE) {
+            report(round, "unknown status", stream->bytes, stream->len);
+            return taken;
+        }
+        if (sent == stream->len) {
+            break;
+        }
+        if (in->tail - in->head == RECV_BUFFER_SIZE) {
+            report(round, "full buffer without a complete message", stream->bytes, stream->len);
+            return taken;
+        }
+    }
+
+    if (taken != stream->count || stream->too_long) {
+        report(round, "messages missing at the end of the stream", stream->bytes, stream->len);
+    }
+    return taken;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = 500000;
+    unsigned int seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atol(optarg);
+                break;
+            case 's':
+                seed = (unsigned int) strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-s seed]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    char message[MESSAGE_SIZE];
+    long accepted = 0;
+    for (int i = 0; i < TEXT_SEED_COUNT; i++) {
+        accepted += fuzz_text_line("seed", g_textSeeds[i].text, strlen(g_textSeeds[i].text),
+                                   (int) g_textSeeds[i].expected);
+    }
+    for (long i = 0; i < iterations; i++) {
+        int expected;
+        size_t len = make_text_line(&seed, message, &expected);
+        accepted += fuzz_text_line("parse_message", message, len, expected);
+    }
+    printf("%-22s %10ld inputs %10ld accepted\n", "parse_message", iterations + TEXT_SEED_COUNT, accepted);
+
+    accepted = 0;
+    for (long i = 0; i < iterations; i++) {
+        size_t len = make_binary_body(&seed, message);
+        accepted += fuzz_binary_body("parse_binary_message", message, len);
+    }
+    printf("%-22s %10ld inputs %10ld accepted\n", "parse_binary_message", iterations, accepted);
+
+    fuzz_stream *stream = malloc(sizeof(fuzz_stream));
+    recv_buffer *in = malloc(sizeof(recv_buffer));
+    if (stream == NULL || in == NULL) {
+        perror("Failed to allocate the stream buffers");
+        return EXIT_FAILURE;
+    }
+    for (int binary = FALSE; binary <= TRUE; binary++) {
+        long streams = iterations / 50 + 1;
+        long taken = 0;
+        for (long i = 0; i < streams; i++) {
+            taken += fuzz_stream_framing(&seed, binary, stream, in);
+        }
+        printf("%-22s %10ld streams %9ld messages\n", binary ? "next_frame" : "next_message", streams, taken);
+    }
+    free(stream);
+    free(in);
+
+    if (g_failures > 0) {
+        printf("%ld inputs failed\n", g_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
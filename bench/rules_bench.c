@@ -0,0 +1,526 @@
+/**
+ * @file rules_bench.c
+ * @brief Measures the rules engine in isolation: perft move enumeration on the rules kernels
+ *        and randomized playouts through validate_move, apply_move and settle_game.
+ *
+ * Perft counts the leaves of the game tree to a fixed depth from the starting position of
+ * setup_initial_board. A player without a move passes (one ply); a position where neither
+ * player can move is a leaf at whatever depth it is reached. With -c the counts are checked:
+ * against the published Othello values for 8x8, and against a plain 8-direction scan of a
+ * character board (independent of the kernels) for the other sizes.
+ *
+ * The playouts replay pre-generated random games (with passes, as the server plays them)
+ * and report the time per call of validate_move and apply_move (fastest of PLAYOUT_REPEATS
+ * replays). settle_game is timed on its own, as perft times generate_moves: the game after
+ * every move is copied aside, and a loop that only calls settle_game runs over the copies
+ * (fastest of PLAYOUT_REPEATS passes over every batch of SETTLE_BATCH copies).
+ * The perft "ns/gen" column is the perft time per generate_moves call, which includes the
+ * compute_flips calls of the moves it generated.
+ *
+ * Built with -DRULES_CROSSCHECK ("make crosscheck"), every playout move is also checked against
+ * the scalar engine in rules_engine.c: the boards, the flips, the generated and the cached
+ * legal moves of both players. The timings of such a build are meaningless.
+ *
+ * Usage: rules_bench [-c] [-d max_depth] [-g playout_games]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../def_n_struct.h"
+#include "../match_manager.h"
+#include "../rules_engine.h"
+
+/**
+ * Published perft counts of 8x8 Othello, indexed by depth.
+ */
+static const long long g_knownPerft8[] = {1, 4, 12, 56, 244, 1396, 8200, 55092, 390216, 3005288, 24571284,
+                                          212258800, 1939886636};
+
+#define KNOWN_PERFT8_DEPTH      ((int) (sizeof(g_knownPerft8) / sizeof(g_knownPerft8[0])) - 1)
+
+/**
+ * Deepest perft checked against the scalar reference (which is far slower than the kernels).
+ */
+#define REFERENCE_MAX_DEPTH     8
+
+/**
+ * Every playout replay is repeated this often and the fastest run is reported.
+ */
+#define PLAYOUT_REPEATS         5
+
+/**
+ * Positions settle_game is timed on at a time (small enough for the copies to stay in cache).
+ */
+#define SETTLE_BATCH            1024
+
+static const int g_boardSizes[] = {4, 6, 8, 10};
+
+static const int g_directions[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+/**
+ * Calls of generate_moves during the current perft.
+ */
+static long long g_generateCalls;
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Returns the index of the lowest set cell (b must not be 0).
+ */
+static int lowest_cell(bitboard b) {
+    uint64_t low = (uint64_t) b;
+    return low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (b >> 64));
+}
+
+static int count_cells(bitboard b) {
+    return __builtin_popcountll((uint64_t) b) + __builtin_popcountll((uint64_t) (b >> 64));
+}
+
+/**
+ * @brief Sets up a game's board and bitboards in the starting position.
+ */
+static void start_position(game *g, int board_size) {
+    g->board_size = board_size;
+    g->kernel = get_rules_kernel(board_size);
+    setup_initial_board(g->board, board_size);
+    init_board_bits(g);
+}
+
+/**
+ * @brief Perft on a rules kernel.
+ * @param passed TRUE if the previous ply was a pass
+ */
+static long long perft(const rules_kernel *kernel, bitboard own, bitboard opp, int depth, int passed) {
+    if (depth == 0) {
+        return 1;
+    }
+    g_generateCalls++;
+    bitboard moves = kernel->generate_moves(own, opp);
+    if (moves == 0) {
+        return passed ? 1 : perft(kernel, opp, own, depth - 1, TRUE);
+    }
+    if (depth == 1) {
+        return count_cells(moves);
+    }
+
+    long long nodes = 0;
+    while (moves != 0) {
+        int cell = lowest_cell(moves);
+        bitboard flips = kernel->compute_flips(own, opp, cell);
+        nodes += perft(kernel, opp & ~flips, own | flips | ((bitboard) 1 << cell), depth - 1, FALSE);
+        moves &= moves - 1;
+    }
+    return nodes;
+}
+
+/**
+ * @brief Plays (or only tests) a move on a character board by scanning the 8 directions.
+ * @return Number of flipped discs, 0 if the move is illegal
+ */
+static int scalar_play(char board[MAX_BOARD_SIZE][MAX_BOARD_SIZE], int size, char color, int x, int y, int apply) {
+    char other = color == FIRST_PL_CHAR ? SECOND_PL_CHAR : FIRST_PL_CHAR;
+    int flipped = 0;
+    for (int d = 0; d < 8; d++) {
+        int nx = x + g_directions[d][0];
+        int ny = y + g_directions[d][1];
+        int run = 0;
+        while (nx >= 0 && nx < size && ny >= 0 && ny < size && board[ny][nx] == other) {
+            nx += g_directions[d][0];
+            ny += g_directions[d][1];
+            run++;
+        }
+        if (run == 0 || nx < 0 || nx >= size || ny < 0 || ny >= size || board[ny][nx] != color) {
+            continue;
+        }
+        flipped += run;
+        for (int i = 1; apply && i <= run; i++) {
+            board[y + i * g_directions[d][1]][x + i * g_directions[d][0]] = color;
+        }
+    }
+    if (apply && flipped > 0) {
+        board[y][x] = color;
+    }
+    return flipped;
+}
+
+/**
+ * @brief Perft on a character board, the reference for the kernels.
+ */
+static long long scalar_perft(char board[MAX_BOARD_SIZE][MAX_BOARD_SIZE], int size, char color, int depth,
+                              int passed) {
+    if (depth == 0) {
+        return 1;
+    }
+    char other = color == FIRST_PL_CHAR ? SECOND_PL_CHAR : FIRST_PL_CHAR;
+    long long nodes = 0;
+    int moves = 0;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (board[y][x] != EMPTY_CHAR || scalar_play(board, size, color, x, y, FALSE) == 0) {
+                continue;
+            }
+            moves++;
+            char child[MAX_BOARD_SIZE][MAX_BOARD_SIZE];
+            memcpy(child, board, sizeof(child));
+            scalar_play(child, size, color, x, y, TRUE);
+            nodes += scalar_perft(child, size, other, depth - 1, FALSE);
+        }
+    }
+    if (moves == 0) {
+        return passed ? 1 : scalar_perft(board, size, other, depth - 1, TRUE);
+    }
+    return nodes;
+}
+
+/**
+ * @brief Runs perft to every depth up to max_depth for one board size.
+ * @return Number of depths whose count did not match the expected one
+ */
+static int run_perft(int board_size, int max_depth, int check) {
+    game start;
+    start_position(&start, board_size);
+    int mismatches = 0;
+
+    for (int depth = 1; depth <= max_depth; depth++) {
+        g_generateCalls = 0;
+        double begin = now_seconds();
+        long long nodes = perft(start.kernel, start.discs[0], start.discs[1], depth, FALSE);
+        double elapsed = now_seconds() - begin;
+
+        printf("%4d %5d %14lld %10.1f %10.2f %10.1f", board_size, depth, nodes, elapsed * 1e3,
+               nodes / elapsed / 1e6, elapsed * 1e9 / (double) g_generateCalls);
+        if (check) {
+            long long expected = -1;
+            if (board_size == 8 && depth <= KNOWN_PERFT8_DEPTH) {
+                expected = g_knownPerft8[depth];
+            } else if (depth <= REFERENCE_MAX_DEPTH) {
+                expected = scalar_perft(start.board, board_size, FIRST_PL_CHAR, depth, FALSE);
+            }
+            if (expected < 0) {
+                printf("  unchecked");
+            } else if (expected == nodes) {
+                printf("  ok");
+            } else {
+                printf("  MISMATCH (expected %lld)", expected);
+                mismatches++;
+            }
+        }
+        printf("\n");
+    }
+    return mismatches;
+}
+
+/**
+ * Random games for the playouts: the cells of every game's moves, in order.
+ */
+typedef struct {
+    unsigned char   *cells;
+    int             *lengths;
+    int             games;
+    int             moves;      /**< Total over all games. */
+} playout_set;
+
+/**
+ * @brief Generates random games: a player without a move passes, and a game ends when neither
+ *        player can move.
+ */
+static void generate_playouts(playout_set *set, int board_size, int games, unsigned int seed) {
+    int maxMoves = board_size * board_size;
+    set->cells = malloc((size_t) games * maxMoves);
+    set->lengths = calloc((size_t) games, sizeof(int));
+    set->games = games;
+    set->moves = 0;
+
+    game g;
+    for (int i = 0; i < games; i++) {
+        start_position(&g, board_size);
+        int own = 0;
+        bitboard moves;
+        while ((moves = g.kernel->generate_moves(g.discs[own], g.discs[1 - own])) != 0) {
+            int pick = rand_r(&seed) % count_cells(moves);
+            for (int k = 0; k < pick; k++) {
+                moves &= moves - 1;
+            }
+            int cell = lowest_cell(moves);
+            bitboard flips = g.kernel->compute_flips(g.discs[own], g.discs[1 - own], cell);
+            g.discs[own] |= flips | ((bitboard) 1 << cell);
+            g.discs[1 - own] &= ~flips;
+            set->cells[i * maxMoves + set->lengths[i]++] = (unsigned char) cell;
+            if (g.kernel->generate_moves(g.discs[1 - own], g.discs[own]) != 0) {
+                own = 1 - own;
+            }
+        }
+        set->moves += set->lengths[i];
+    }
+}
+
+/**
+ * Entry points replayed by a playout run.
+ */
+enum {
+    REPLAY_VALIDATE,            /**< validate_move (which applies the move and settles the game). */
+    REPLAY_APPLY                /**< apply_move alone. */
+};
+
+/**
+ * Positions recorded for timing settle_game.
+ */
+typedef struct {
+    game            *positions; /**< Copies of the game after a move. */
+    client          **movers;   /**< The player who made that move. */
+    unsigned char   *ends;      /**< TRUE if it was the last move of its game. */
+    int             count;
+} settle_batch;
+
+/**
+ * @brief Puts the game back into the starting position, the first player on turn.
+ */
+static void restart_game(game *g, client players[2]) {
+    setup_initial_board(g->board, g->board_size);
+    init_board_bits(g);
+    g->current_player = players[0].handle;
+    g->game_status = GAME_PLAYING;
+    g->winner = NULL_HANDLE;
+}
+
+/**
+ * @brief Replays all games of a set in one game through the given entry points.
+ * @return Seconds spent, or a negative value if the engine disagreed with the recorded games
+ */
+static double replay_playouts(const playout_set *set, client players[2], int mode) {
+    game *g = resolve_game(players[0].hot->current_game);
+    int maxMoves = g->board_size * g->board_size;
+    double spent = 0;
+
+    for (int i = 0; i < set->games; i++) {
+        restart_game(g, players);
+
+        const unsigned char *cells = &set->cells[i * maxMoves];
+        int length = set->lengths[i];
+        int final = 0;
+        double begin = now_seconds();
+        for (int m = 0; m < length; m++) {
+            // apply_move hands the turn over, or keeps it when the opponent passes
+            client *mover = g->current_player == players[0].handle ? &players[0] : &players[1];
+            int x = cells[m] % g->board_size;
+            int y = cells[m] / g->board_size;
+            if (mode == REPLAY_VALIDATE) {
+                if (validate_move(mover, x, y, &final, NULL) != TRUE) {
+                    return -1;
+                }
+            } else {
+                apply_move(g, mover, x, y);
+            }
+        }
+        spent += now_seconds() - begin;
+        if (mode == REPLAY_VALIDATE && final != GAME_WIN && final != GAME_DRAW) {
+            return -1;
+        }
+    }
+    return spent;
+}
+
+/**
+ * @brief Returns the fastest of PLAYOUT_REPEATS replays (negative if the engine disagreed).
+ */
+static double best_replay(const playout_set *set, client players[2], int mode) {
+    double best = -1;
+    for (int i = 0; i < PLAYOUT_REPEATS; i++) {
+        double spent = replay_playouts(set, players, mode);
+        if (spent < 0) {
+            return spent;
+        }
+        if (best < 0 || spent < best) {
+            best = spent;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Times settle_game over a batch of recorded positions. The positions are settled once
+ *        untimed first, which checks that the last position of a game ends it and no other
+ *        position does; every timed pass then starts from positions still being played.
+ * @return Seconds of the fastest of PLAYOUT_REPEATS passes, or a negative value if settle_game
+ *         disagreed with the recorded games
+ */
+static double time_settle_batch(settle_batch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        int settled = settle_game(&batch->positions[i], batch->movers[i], NULL);
+        if ((settled == GAME_WIN || settled == GAME_DRAW) != batch->ends[i]) {
+            return -1;
+        }
+    }
+
+    double best = -1;
+    for (int r = 0; r < PLAYOUT_REPEATS; r++) {
+        for (int i = 0; i < batch->count; i++) {
+            batch->positions[i].game_status = GAME_PLAYING;
+            batch->positions[i].winner = NULL_HANDLE;
+        }
+        double begin = now_seconds();
+        for (int i = 0; i < batch->count; i++) {
+            settle_game(&batch->positions[i], batch->movers[i], NULL);
+        }
+        double spent = now_seconds() - begin;
+        if (best < 0 || spent < best) {
+            best = spent;
+        }
+    }
+    batch->count = 0;
+    return best;
+}
+
+/**
+ * @brief Replays all games of a set with apply_move, untimed, and times settle_game on the
+ *        position after every move (see time_settle_batch).
+ * @return Seconds spent in settle_game, or a negative value if it disagreed with the recorded games
+ */
+static double time_settle_game(const playout_set *set, client players[2]) {
+    game *g = resolve_game(players[0].hot->current_game);
+    int maxMoves = g->board_size * g->board_size;
+    settle_batch batch;
+    batch.positions = malloc(SETTLE_BATCH * sizeof(game));
+    batch.movers = malloc(SETTLE_BATCH * sizeof(client *));
+    batch.ends = malloc(SETTLE_BATCH);
+    batch.count = 0;
+    double spent = 0;
+
+    for (int i = 0; i < set->games && spent >= 0; i++) {
+        restart_game(g, players);
+        const unsigned char *cells = &set->cells[i * maxMoves];
+        int length = set->lengths[i];
+        for (int m = 0; m < length && spent >= 0; m++) {
+            client *mover = g->current_player == players[0].handle ? &players[0] : &players[1];
+            apply_move(g, mover, cells[m] % g->board_size, cells[m] / g->board_size);
+            batch.positions[batch.count] = *g;
+            batch.movers[batch.count] = mover;
+            batch.ends[batch.count] = m == length - 1;
+            if (++batch.count == SETTLE_BATCH) {
+                double batchSpent = time_settle_batch(&batch);
+                spent = batchSpent < 0 ? batchSpent : spent + batchSpent;
+            }
+        }
+    }
+    if (spent >= 0 && batch.count > 0) {
+        double batchSpent = time_settle_batch(&batch);
+        spent = batchSpent < 0 ? batchSpent : spent + batchSpent;
+    }
+
+    free(batch.positions);
+    free(batch.movers);
+    free(batch.ends);
+    return spent;
+}
+
+/**
+ * @brief Times the engine's entry points on random games of one board size.
+ * @return TRUE if the engine replayed every game as generated
+ */
+static int run_playouts(int board_size, int games, client players[2]) {
+    game *g = initiate_game_session(&players[0], &players[1], board_size);
+    if (g == NULL) {
+        return FALSE;
+    }
+    // initiate_game_session does not seat the players; do it like start_match
+    players[0].hot->current_game = g->handle;
+    players[1].hot->current_game = g->handle;
+
+    playout_set set;
+    generate_playouts(&set, board_size, games, 4242u + board_size);
+
+    double validate = best_replay(&set, players, REPLAY_VALIDATE);
+    double apply = best_replay(&set, players, REPLAY_APPLY);
+    double settle = time_settle_game(&set, players);
+    free(set.cells);
+    free(set.lengths);
+    if (validate < 0 || apply < 0 || settle < 0) {
+        printf("%4d playouts diverged from the rules kernel\n", board_size);
+        return FALSE;
+    }
+
+    printf("%4d %8d %10d %14.1f %14.1f %14.1f\n", board_size, games, set.moves, validate * 1e9 / set.moves,
+           apply * 1e9 / set.moves, settle * 1e9 / set.moves);
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    int check = FALSE;
+    int maxDepth = 9;
+    int playoutGames = 20000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "cd:g:")) != -1) {
+        switch (opt) {
+            case 'c':
+                check = TRUE;
+                break;
+            case 'd':
+                maxDepth = atoi(optarg);
+                break;
+            case 'g':
+                playoutGames = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c] [-d max_depth] [-g playout_games]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (maxDepth < 1 || playoutGames < 1) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    init_rules_engine();
+    int sizeCount = (int) (sizeof(g_boardSizes) / sizeof(g_boardSizes[0]));
+    if (!init_game_registry(sizeCount)) {
+        return EXIT_FAILURE;
+    }
+
+    printf("perft from the starting position%s\n", check ? ", checked" : "");
+    printf("%4s %5s %14s %10s %10s %10s\n", "size", "depth", "nodes", "ms", "Mnodes/s", "ns/gen");
+    int mismatches = 0;
+    for (int i = 0; i < sizeCount; i++) {
+        mismatches += run_perft(g_boardSizes[i], maxDepth, check);
+    }
+
+    printf("\nplayouts, ns per call\n");
+    printf("%4s %8s %10s %14s %14s %14s\n", "size", "games", "moves", "validate_move", "apply_move",
+           "settle_game");
+    client players[2 * sizeCount];
+    client_hot states[2 * sizeCount];
+    memset(players, 0, sizeof(players));
+    memset(states, 0, sizeof(states));
+    int diverged = 0;
+    for (int i = 0; i < sizeCount; i++) {
+        client *pair = &players[2 * i];
+        for (int p = 0; p < 2; p++) {
+            pair[p].id = 2 * i + p;
+            pair[p].hot = &states[2 * i + p];
+            // Not pool handles; the rules engine only compares them
+            pair[p].handle = ((client_handle) 1 << 32) | (unsigned int) pair[p].id;
+            pair[p].client_char = p == 0 ? FIRST_PL_CHAR : SECOND_PL_CHAR;
+        }
+        pair[0].hot->opponent = pair[1].handle;
+        pair[1].hot->opponent = pair[0].handle;
+        if (!run_playouts(g_boardSizes[i], playoutGames, pair)) {
+            diverged++;
+        }
+    }
+
+    if (check && mismatches > 0) {
+        printf("%d perft counts differ\n", mismatches);
+    }
+    return mismatches == 0 && diverged == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file snapshot_bench.c
+ * @brief Measures what the game snapshot costs per move and how long a restart takes to
+ *        restore the snapshot.
+ *
+ * A child process plays the opening moves of many games with a snapshot file open, timing
+ * apply_move with its snapshot write, and exits without any cleanup like a killed server.
+ * The parent then starts like the server does and times open_game_snapshot on that file,
+ * checking that every game came back with its position.
+ *
+ * Usage: snapshot_bench [-g games] [-m moves_per_game] [-b board_size] [-f file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "../def_n_struct.h"
+#include "../match_manager.h"
+#include "../rules_engine.h"
+#include "../game_snapshot.h"
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Names a bench player after its game and seat.
+ */
+static void name_player(client *cl, int game_index, int seat) {
+    cl->username_len = snprintf(cl->username, sizeof(cl->username), "player%d_%d", game_index, seat);
+}
+
+/**
+ * @brief Plays up to moves_per_game legal moves in every game (lowest legal cell first) and
+ *        prints the cost per move; runs in the child process.
+ * @return Number of games written
+ */
+static int write_games(const char *path, int games, int moves_per_game, int board_size) {
+    if (!init_game_registry(games) || open_game_snapshot(path) < 0) {
+        return 0;
+    }
+
+    static client players[2];
+    static client_hot states[2];
+    for (int seat = 0; seat < 2; seat++) {
+        players[seat].hot = &states[seat];
+        players[seat].handle = (client_handle) (seat + 1);
+        players[seat].client_char = seat == 0 ? FIRST_PL_CHAR : SECOND_PL_CHAR;
+    }
+
+    long moves = 0;
+    double moveTime = 0;
+    for (int i = 0; i < games; i++) {
+        name_player(&players[0], i, 0);
+        name_player(&players[1], i, 1);
+        game *g = initiate_game_session(&players[0], &players[1], board_size);
+        if (g == NULL) {
+            return i;
+        }
+
+        double start = now_seconds();
+        for (int move = 0; move < moves_per_game; move++) {
+            int seat = g->current_player == players[0].handle ? 0 : 1;
+            bitboard legal = g->kernel->generate_moves(g->discs[seat], g->discs[1 - seat]);
+            if (legal == 0) {
+                break;
+            }
+            int cell = 0;
+            while (!((legal >> cell) & 1)) {
+                cell++;
+            }
+            apply_move(g, &players[seat], cell % board_size, cell / board_size);
+            moves++;
+        }
+        moveTime += now_seconds() - start;
+    }
+
+    printf("%d games, %ld moves: %.1f ns/move including the snapshot write\n", games, moves,
+           moves > 0 ? moveTime * 1e9 / moves : 0);
+    return games;
+}
+
+int main(int argc, char *argv[]) {
+    int games = 100000;
+    int movesPerGame = 10;
+    int boardSize = 8;
+    const char *path = "bench/snapshot_bench.snap";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:m:b:f:")) != -1) {
+        switch (opt) {
+            case 'g':
+                games = atoi(optarg);
+                break;
+            case 'm':
+                movesPerGame = atoi(optarg);
+                break;
+            case 'b':
+                boardSize = atoi(optarg);
+                break;
+            case 'f':
+                path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-g games] [-m moves_per_game] [-b board_size] [-f file]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    init_rules_engine();
+    if (games <= 0 || movesPerGame < 0 || get_rules_kernel(boardSize) == NULL) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+    unlink(path);
+
+    // The writer exits without unmapping anything, as a killed server would
+    pid_t writer = fork();
+    if (writer == 0) {
+        int written = write_games(path, games, movesPerGame, boardSize);
+        fflush(stdout);
+        _exit(written == games ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    int status;
+    if (writer == -1 || waitpid(writer, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Writing the snapshot failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // The restart: the same steps as the server's main
+    double start = now_seconds();
+    if (!init_game_registry(games)) {
+        return EXIT_FAILURE;
+    }
+    double registered = now_seconds();
+    int restored = open_game_snapshot(path);
+    double end = now_seconds();
+    printf("restart with %d games: %.1f ms game tables + %.1f ms snapshot restore\n", restored,
+           (registered - start) * 1e3, (end - registered) * 1e3);
+
+    int moved = 0;
+    for (int i = 0; i < count_games(); i++) {
+        moved += g_gamesArr[i]->discs[0] != 0 && g_gamesArr[i]->discs[1] != 0;
+    }
+    unlink(path);
+    if (restored != games || moved != games) {
+        fprintf(stderr, "Restored %d of %d games\n", restored, games);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -2,6 +2,7 @@
 #define __DEF_N_STRUCT__
 
 #include <pthread.h>
+#include <stdint.h>
 
 /* -------------------------------------------------------------------------
  *                              MESSAGE CONSTANTS
@@ -27,14 +28,15 @@
 #define MESS_END_CHAR           "\n"
 
 /**
- * The length of the login message, which includes an 8-char prefix and the player's name.
+ * The length of the login message, which includes an 8-char prefix, the player's name and
+ * the optional 4-char ";BIN" field.
  */
-#define LOGIN_MESSAGE_SIZE      (8 + PLAYER_NAME_SIZE)
+#define LOGIN_MESSAGE_SIZE      (12 + PLAYER_NAME_SIZE)
 
 /**
- * The size for a response to a login message (9 + max name length).
+ * The size for a response to a login message (13 + max name length, ";BIN" included).
  */
-#define LOGIN_MESSAGE_RESP_SIZE (9 + PLAYER_NAME_SIZE)
+#define LOGIN_MESSAGE_RESP_SIZE (13 + PLAYER_NAME_SIZE)
 
 /**
  * The size allocated for responding to a "want game" query.
@@ -52,9 +54,10 @@
 #define MOVE_MESS_RESP_SIZE     12
 
 /**
- * The size of a message indicating an opponent's move.
+ * The size of a message indicating an opponent's move, followed by every legal target of the
+ * recipient (at most one per empty cell).
  */
-#define OPP_MOVE_MESSAGE_SIZE   14
+#define OPP_MOVE_MESSAGE_SIZE   (16 + 4 * MAX_BOARD_SIZE * MAX_BOARD_SIZE)
 
 /**
  * The size for messages containing the game status, including the winner's name.
@@ -64,7 +67,64 @@
 /**
  * The size for a message used when a client reconnects (depends on board size and names).
  */
-#define RECONNECT_MESSAGE_SIZE  (BOARD_SIZE * BOARD_SIZE + 20 + PLAYER_NAME_SIZE + PLAYER_NAME_SIZE)
+#define RECONNECT_MESSAGE_SIZE  (MAX_BOARD_SIZE * MAX_BOARD_SIZE + 20 + PLAYER_NAME_SIZE + PLAYER_NAME_SIZE)
+
+/* -------------------------------------------------------------------------
+ *                              BINARY PROTOCOL
+ * ------------------------------------------------------------------------- */
+/**
+ * Encodings a client can use after the (always textual) LOGIN. A client selects the binary
+ * one with "LOGIN;<name>;BIN"; the server confirms with "LOGIN;<name>;BIN".
+ */
+#define PROTOCOL_TEXT           0
+#define PROTOCOL_BINARY         1
+
+/**
+ * Field of the LOGIN message that selects the binary encoding.
+ */
+#define BINARY_LOGIN_FIELD      "BIN"
+
+/**
+ * A binary frame starts with the length of its body (opcode and fields) as a big-endian
+ * 16-bit number. Numbers are single bytes, names a length byte followed by the name.
+ */
+#define BIN_HEADER_SIZE         2
+
+/**
+ * Opcodes of the frames sent by clients.
+ */
+#define BIN_MOVE                0x01    /**< [x][y] */
+#define BIN_JOIN_GAME           0x02    /**< [board size] (optional) */
+#define BIN_LOGOUT              0x03
+#define BIN_PONG                0x04
+#define BIN_WAIT_REPLY          0x05    /**< [1 to wait, 0 otherwise] */
+
+/**
+ * Opcodes of the frames sent by the server.
+ */
+#define BIN_JOIN_GAME_RESP      0x81    /**< [color] */
+#define BIN_START_GAME          0x82    /**< [name][opponent color][1 if the recipient starts] */
+#define BIN_MOVE_RESP           0x83    /**< [status][x][y] */
+#define BIN_OPP_MOVE            0x84    /**< [x][y][count][x][y] per legal target of the recipient */
+#define BIN_GAME_STATUS         0x85    /**< [BIN_STATUS_*][winner name, empty unless BIN_STATUS_WIN] */
+#define BIN_RECONNECT           0x86    /**< [board size][board, 2 bits per cell][name on turn][opponent name][color] */
+#define BIN_PING                0x87
+#define BIN_OPP_DISCONNECTED    0x88
+#define BIN_PASS                0x89    /**< [count][x][y] per legal target of the recipient */
+
+/**
+ * Outcomes carried by BIN_GAME_STATUS.
+ */
+#define BIN_STATUS_WIN          0
+#define BIN_STATUS_DRAW         1
+#define BIN_STATUS_OPP_GONE     2
+
+/**
+ * Cell values of a packed board; cell i occupies bits 2 * (i % 4) of byte i / 4 (rows first).
+ */
+#define BIN_CELL_EMPTY          0
+#define BIN_CELL_FIRST          1
+#define BIN_CELL_SECOND         2
 
 
 /* -------------------------------------------------------------------------
@@ -72,19 +132,45 @@
  * ------------------------------------------------------------------------- */
 
 /**
- * The width and height of the Reversi board.
+ * The width and height of the Reversi board used when a client does not ask for a size.
+ * Every game picks its own size; the supported sizes are 4, 6, 8 and 10.
+ */
+#define DEFAULT_BOARD_SIZE      4
+
+/**
+ * The largest supported board width and height.
+ */
+#define MAX_BOARD_SIZE         10
+
+/**
+ * One bit per board cell; cell (x, y) of a game is bit y * board_size + x. The rules kernels
+ * of boards up to 8x8 work on the low 64 bits only.
+ */
+typedef unsigned __int128 bitboard;
+
+/**
+ * Legal targets of one player, as sent to the clients with OPP_MOVE.
+ */
+typedef struct {
+    bitboard    cells;          /**< One bit per legal target. */
+    int         board_size;     /**< Width of the board the bits refer to. */
+} legal_squares;
+
+/**
+ * The default maximum number of simultaneous games (override with -g).
  */
-#define BOARD_SIZE              4
+#define DEFAULT_MAX_GAMES      100000
 
 /**
- * The maximum number of simultaneous games allowed by the server.
+ * The default maximum number of clients that can be connected concurrently (override with -c).
  */
-#define MAX_GAMES              10
+#define DEFAULT_MAX_CLIENTS    200000
 
 /**
- * The maximum number of clients that can be connected concurrently.
+ * Size of the client pool relative to the maximum number of clients (detached clients stay
+ * allocated while referenced).
  */
-#define MAX_CLIENTS            20
+#define CLIENT_POOL_FACTOR     2
 
 /**
  * Indicates that a game is active/ongoing.
@@ -112,9 +198,9 @@
 #define GAME_DRAW              2
 
 /**
- * Represents a "null" or invalid game ID.
+ * Indicates that the opponent has no legal move: it passes and the player moves again.
  */
-#define GAME_NULL_ID           0
+#define GAME_PASS              3
 
 /**
  * Represents the character used by the first player on the board (e.g., 'R' = Red).
@@ -146,6 +232,30 @@
  */
 #define PING_ZOMBIE            20
 
+/**
+ * Number of seconds a new connection has to complete the LOGIN handshake before it is closed.
+ */
+#define HANDSHAKE_TIMEOUT      10
+
+/**
+ * Number of seconds after a restart during which the players of the restored games can
+ * claim their seats; a game whose players did not all come back is then given up.
+ */
+#define RESTORE_GRACE          60
+
+/**
+ * Resolution of the liveness timer wheel in milliseconds.
+ */
+#define TIMER_TICK_MS          100
+
+/**
+ * Levels of the timer wheel and slots per level (as a power of two); four levels of 64
+ * slots cover 64^4 ticks, anything later is clamped to that horizon.
+ */
+#define TIMER_LEVELS           4
+#define TIMER_SLOT_BITS        6
+#define TIMER_SLOTS            (1 << TIMER_SLOT_BITS)
+
 
 /* -------------------------------------------------------------------------
  *                              BOOLEAN SHORTCUTS
@@ -163,31 +273,240 @@
  */
 #define PORT                   10000
 
+/**
+ * I/O model: one blocking thread per accepted client (the original behaviour).
+ */
+#define IO_MODE_THREAD         0
+
+/**
+ * I/O model: non-blocking sockets multiplexed by an epoll reactor thread.
+ */
+#define IO_MODE_EPOLL          1
+
+/**
+ * Upper bound for the number of reactor threads (shards) in epoll mode.
+ */
+#define MAX_REACTORS           64
+
+/**
+ * Shard value of clients served by the thread-per-client model.
+ */
+#define NO_SHARD               (-1)
+
+/**
+ * Shard value of a connection that is being handed over between two reactors.
+ */
+#define SHARD_IN_TRANSIT       (-2)
+
+/**
+ * Maximum number of readiness events the reactor collects per epoll_wait call.
+ */
+#define REACTOR_MAX_EVENTS     256
+
+/**
+ * Maximum number of connections accepted per readiness event of a listening socket; the rest
+ * waits for the next round, so that handshakes in progress are not starved during a storm.
+ */
+#define ACCEPT_BATCH           64
+
+/**
+ * Backpressure limit: a client whose unsent output grows past this many bytes is disconnected.
+ */
+#define OUT_QUEUE_LIMIT        (64 * 1024)
+
+/**
+ * Maximum number of queued messages written by one sendmsg call.
+ */
+#define OUT_QUEUE_MAX_IOV      64
+
+/**
+ * Move journal: number of append buffers (threads are spread over them), records per buffer,
+ * and how often (in milliseconds) the buffers are written out and the file is synced.
+ */
+#define JOURNAL_STRIPES        16
+#define JOURNAL_BATCH          1024
+#define JOURNAL_FLUSH_MS       10
+#define JOURNAL_SYNC_MS        1000
+
+/**
+ * Server log: messages buffered per thread, bytes per message (longer ones are truncated),
+ * how often (in milliseconds) the writer empties the buffers, and its output chunk size.
+ */
+#define LOG_RING_RECORDS       256
+#define LOG_RECORD_SIZE        256
+#define LOG_FLUSH_MS           5
+#define LOG_WRITE_BATCH        (64 * 1024)
+
+/**
+ * Capacity (in bytes) of the per-connection receive ring; must be a power of two.
+ * Holds several pipelined messages; a single message is limited to MESSAGE_SIZE - 1 bytes.
+ */
+#define RECV_BUFFER_SIZE       4096
+
+/**
+ * Connection is accepted but has not completed the LOGIN handshake yet.
+ */
+#define CONN_HANDSHAKE         0
+
+/**
+ * Connection is logged in and bound to a client structure.
+ */
+#define CONN_ACTIVE            1
+
+/**
+ * Connection was closed; the structure is released after the current event batch.
+ */
+#define CONN_CLOSED            2
+
 
 /* -------------------------------------------------------------------------
  *                           FORWARD DECLARATIONS
  * ------------------------------------------------------------------------- */
 typedef struct client client;  /* Forward declaration to allow self-referencing. */
+typedef struct rules_kernel rules_kernel;  /* Board-size specialized rules (see rules_engine.h). */
+typedef struct game game;      /* Forward declaration of the game structure. */
+typedef struct connection connection;  /* Reactor-side connection state (see below). */
+
+/**
+ * Generation-tagged reference to a pooled object (see slab_pool.h): the generation in the
+ * upper 32 bits, the slot in the lower 32 bits. A handle outliving its object is detected.
+ */
+typedef uint64_t pool_handle;
+typedef pool_handle client_handle;  /* Handle of a client (its slot is the client id). */
+typedef pool_handle game_handle;    /* Handle of a game. */
+
+/**
+ * A handle that refers to nothing.
+ */
+#define NULL_HANDLE            ((pool_handle) 0)
+
+/* -------------------------------------------------------------------------
+ *                           OUTBOUND QUEUE STRUCTURE
+ * ------------------------------------------------------------------------- */
+typedef struct out_chunk out_chunk;
+
+/**
+ * One queued outgoing message.
+ */
+struct out_chunk {
+    out_chunk   *next;      /**< Next message in the queue. */
+    size_t      len;        /**< Number of bytes in data. */
+    char        data[];     /**< The message bytes. */
+};
+
+/**
+ * Messages waiting to be written to a socket, oldest first (see outbound.h).
+ */
+typedef struct {
+    out_chunk   *head;      /**< Oldest message, partially written if head_sent > 0. */
+    out_chunk   *tail;      /**< Newest message. */
+    size_t      head_sent;  /**< Bytes of head already accepted by the kernel. */
+    size_t      queued;     /**< Unsent bytes in the whole queue. */
+} out_queue;
+
+/* -------------------------------------------------------------------------
+ *                            TIMER WHEEL STRUCTURE
+ * ------------------------------------------------------------------------- */
+typedef struct timer_entry timer_entry;
+
+/**
+ * A deadline registered in a timer wheel (see timer_wheel.h). Embedded in its owner.
+ */
+struct timer_entry {
+    timer_entry *next;      /**< Next entry in the same slot. */
+    timer_entry **pprev;    /**< Link pointing at this entry, NULL while not scheduled. */
+    long long   expires;    /**< Deadline in ticks of TIMER_TICK_MS. */
+    void        *data;      /**< The owner of the entry. */
+};
+
+/**
+ * Hierarchical timer wheel: level 0 holds the deadlines of the next TIMER_SLOTS ticks, every
+ * further level covers TIMER_SLOTS times more and is cascaded down when level 0 wraps.
+ */
+typedef struct {
+    long long   current;                            /**< Next tick to process. */
+    timer_entry *slots[TIMER_LEVELS][TIMER_SLOTS];  /**< Pending deadlines. */
+    timer_entry *expired;                           /**< Deadlines that passed, not yet handled. */
+} timer_wheel;
 
 /* -------------------------------------------------------------------------
  *                             CLIENT STRUCTURE
  * ------------------------------------------------------------------------- */
+/**
+ * The state of a client that the liveness and matchmaking paths check, kept apart from the
+ * rest of the client in one cache-line aligned table indexed by client id (client_hot_table),
+ * two clients per cache line. Sweeping it does not pull in names, sockets or output queues.
+ */
+typedef struct {
+    long long     last_seen;             /**< Monotonic time (ms) of the last data received from the client. */
+    client_handle opponent;              /**< The client's current opponent, or NULL_HANDLE if none. */
+    game_handle   current_game;          /**< The game the client plays, or NULL_HANDLE if none. */
+    char          is_connected;          /**< Cleared when a PING is sent, set again by any received data. */
+    char          need_reconnect_mess;   /**< Indicator that a reconnect message is needed. */
+    char          is_requesting_game;    /**< Flag indicating if the client wants to join a new game. */
+    unsigned char requested_board_size;  /**< Board size asked for in the last JOIN_GAME. */
+} client_hot;
+
 /**
  * Represents an individual player's connection and status.
  */
 struct client {
     int         socket;                 /**< File descriptor representing the client's connection. */
-    int         id;                     /**< A unique identifier for the client. */
+    int         id;                     /**< A unique identifier for the client (its pool slot). */
+    client_handle handle;               /**< Handle of this client. */
+    client_hot  *hot;                   /**< Liveness and matchmaking state (the client's entry of client_hot_table). */
     char        username[PLAYER_NAME_SIZE];  /**< The player's chosen name, up to 20 chars. */
-    int         active_game_id;         /**< The ID of the game in which the client participates. */
+    int         username_len;          /**< Length of username. */
+    int         protocol;              /**< PROTOCOL_TEXT or PROTOCOL_BINARY, chosen at LOGIN. */
     int         is_in_game;            /**< Flag indicating if the user is actively playing. */
-    int         is_connected;          /**< Flag showing if the user is currently connected. */
-    int         need_reconnect_mess;   /**< Indicator that a reconnect message is needed. */
-    time_t      last_ping;             /**< Timestamp of the last ping response. */
+    timer_entry ping_timer;            /**< When to check the client's activity and ping it if quiet. */
+    timer_entry zombie_timer;          /**< When a silent client is removed as a zombie. */
     char        client_char;           /**< The character used by this client in Reversi (e.g., 'R' or 'B'). */
-    int         is_requesting_game;    /**< Flag indicating if the client wants to join a new game. */
-    client      *opponent;            /**< A pointer to the client's current opponent, or NULL if none. */
     pthread_t   *client_thread;       /**< Reference to the thread that handles this client. */
+    connection  *conn;                /**< Reactor connection in epoll mode, NULL in thread mode. */
+    int         refs;                 /**< References (registry, queued match requests, output); freed at 0. */
+    int         is_detached;          /**< Set once the client has been removed from the registry. */
+    client      *previous_session;    /**< Session registered under the same name before this LOGIN (referenced until resumed). */
+    pthread_mutex_t out_lock;         /**< Thread mode: guards out and out_armed. */
+    out_queue   out;                  /**< Thread mode: output not yet written to the socket. */
+    int         out_armed;            /**< Thread mode: the output writer waits for the socket to drain. */
+    client      *out_next_retired;    /**< Thread mode: link in the output writer's retire list. */
+    long long   join_requested_at;    /**< When the last JOIN_GAME arrived (ns, see metrics_clock_ns). */
+};
+
+/* -------------------------------------------------------------------------
+ *                          RECEIVE BUFFER STRUCTURE
+ * ------------------------------------------------------------------------- */
+/**
+ * Ring buffer of received bytes that are split into messages on MESS_END_CHAR.
+ * head and tail run freely; the byte positions are taken modulo RECV_BUFFER_SIZE.
+ */
+typedef struct {
+    unsigned int    head;                       /**< Position of the first unconsumed byte. */
+    unsigned int    tail;                       /**< Position one past the last received byte. */
+    unsigned int    scanned;                    /**< Bytes from head already searched for MESS_END_CHAR. */
+    char            data[RECV_BUFFER_SIZE];     /**< The received bytes. */
+} recv_buffer;
+
+/* -------------------------------------------------------------------------
+ *                           CONNECTION STRUCTURE
+ * ------------------------------------------------------------------------- */
+/**
+ * Non-blocking socket state owned by one epoll reactor. Only the owning reactor thread
+ * touches a connection and its client; ownership moves only through a shard handoff.
+ */
+struct connection {
+    int         fd;                             /**< Non-blocking socket descriptor. */
+    int         state;                          /**< CONN_HANDSHAKE, CONN_ACTIVE or CONN_CLOSED. */
+    int         shard;                          /**< Index of the owning reactor, or SHARD_IN_TRANSIT. */
+    client      *owner;                         /**< Logged-in client, NULL during the handshake. */
+    timer_entry handshake_timer;                /**< When the connection is closed if the LOGIN has not arrived. */
+    int         want_write;                     /**< Set while EPOLLOUT is armed for pending output. */
+    out_queue   out;                            /**< Output not yet accepted by the kernel. */
+    int         out_dirty;                      /**< Set while the connection is on the reactor's flush list. */
+    connection  *next_dirty;                    /**< Link in the reactor's flush list. */
+    recv_buffer in;                             /**< Received bytes not yet dispatched as messages. */
+    connection  *next_closed;                   /**< Link in the reactor's deferred-release list. */
 };
 
 /* -------------------------------------------------------------------------
@@ -197,15 +516,21 @@ struct client {
  * Holds information about an individual Reversi match, including the participants,
  * board state, and current game status.
  */
-typedef struct {
-    int         id;                        /**< The unique identifier for this game. */
-    char        board[BOARD_SIZE][BOARD_SIZE];  /**< A 2D array holding the Reversi board. */
-    client      *player1;                  /**< Pointer to the first player. */
-    client      *player2;                  /**< Pointer to the second player. */
-    client      *current_player;           /**< Pointer to whichever client is currently moving. */
+struct game {
+    pthread_mutex_t lock;                  /**< Guards the board and turn state; never destroyed (games are recycled). */
+    game_handle handle;                    /**< Handle of this game, NULL_HANDLE once it has been removed. */
+    int         slot;                      /**< Position in the dense g_gamesArr array. */
+    int         board_size;                /**< Width and height of this game's board. */
+    const rules_kernel *kernel;            /**< Rules specialized for board_size. */
+    char        board[MAX_BOARD_SIZE][MAX_BOARD_SIZE];  /**< Character snapshot of the board (wire format). */
+    bitboard    discs[2];                  /**< Discs of the first and second player; used by the rules. */
+    bitboard    moves[2];                  /**< Legal targets of the first and second player, kept up to date by apply_move. */
+    client_handle player1;                 /**< The first player. */
+    client_handle player2;                 /**< The second player. */
+    client_handle current_player;          /**< Whichever client is currently moving. */
     int         game_status;               /**< Tracks whether it's playing, waiting, or over. */
-    client      *winner;                   /**< Pointer to the winning client, or NULL if no winner yet. */
-} game;
+    client_handle winner;                  /**< The winning client, or NULL_HANDLE if no winner yet. */
+};
 
 /* -------------------------------------------------------------------------
  *                            SERVER STRUCTURE
@@ -216,6 +541,13 @@ typedef struct {
 typedef struct {
     char    ip_address[17];  /**< Holds the IPv4 address as a dotted-decimal string. */
     int     port;            /**< The port on which the server is set to listen. */
+    int     io_mode;         /**< IO_MODE_THREAD or IO_MODE_EPOLL. */
+    int     reactor_count;   /**< Number of reactor threads (shards) in epoll mode. */
+    int     max_clients;     /**< Capacity of the client tables. */
+    int     max_games;       /**< Capacity of the game tables. */
+    const char *snapshot_path;  /**< File holding the snapshot of the running games, or NULL for none. */
+    const char *journal_path;   /**< File the move journal is appended to, or NULL for none. */
+    int     admin_port;      /**< Local port serving the metrics page, 0 for none. */
 } server_address;
 
 #endif /* __CONFIG_H__ */
@@ -0,0 +1,731 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "event_loop.h"
+#include "player_manager.h"
+#include "network_interface.h"
+#include "outbound.h"
+#include "timer_wheel.h"
+#include "game_snapshot.h"
+#include "server_metrics.h"
+#include "server_log.h"
+
+typedef struct shard_handoff shard_handoff;
+
+/**
+ * A connection migrating to another shard, either to be paired with a waiting client there or
+ * to resume the session its LOGIN superseded.
+ */
+struct shard_handoff {
+    connection      *conn;          /**< The migrating connection (its client is already logged in). */
+    client_handle   partner;        /**< The waiting client on the destination shard (NULL_HANDLE when resuming). */
+    int             resume;         /**< Set when the client resumes its previous session on the destination shard. */
+    shard_handoff   *next;          /**< Next entry in the mailbox. */
+};
+
+/**
+ * State of one reactor thread (shard).
+ */
+typedef struct {
+    int             id;             /**< Shard index. */
+    int             epoll_fd;       /**< The reactor's epoll instance. */
+    int             listen_fd;      /**< The reactor's own SO_REUSEPORT listening socket. */
+    int             wake_fd;        /**< eventfd signalled when the mailbox receives a handoff. */
+    pthread_t       thread;         /**< The thread running the reactor. */
+    pthread_mutex_t mailbox_mutex;  /**< Protects mailbox. */
+    shard_handoff   *mailbox;       /**< Incoming handoffs (LIFO, reversed on processing). */
+    connection      *closed_list;   /**< Connections closed in the current batch, released at its end. */
+    connection      *dirty_list;    /**< Connections with output queued in the current batch, flushed at its end. */
+    timer_wheel     timers;         /**< Ping and zombie deadlines of the shard's clients. */
+    timer_wheel     handshakes;     /**< LOGIN deadlines of the shard's connections in CONN_HANDSHAKE. */
+    long long       batch_started;  /**< When epoll_wait returned the current batch (ns). */
+    int             batch_reads;    /**< Reads in the current batch that delivered client messages. */
+} reactor;
+
+/**
+ * All reactors, indexed by shard.
+ */
+static reactor g_reactors[MAX_REACTORS];
+
+/**
+ * Number of running reactors.
+ */
+static int g_reactorCount = 0;
+
+/**
+ * The reactor run by the current thread (NULL outside reactor threads).
+ */
+static __thread reactor *t_reactor = NULL;
+
+/**
+ * A client waiting for an opponent, together with its shard.
+ */
+typedef struct {
+    client_handle   waiting;    /**< The waiting client, or NULL_HANDLE if nobody waits. */
+    int             shard;      /**< Shard of the waiting client. */
+} lobby_entry;
+
+/**
+ * Protects the lobby (one waiting client per board size across all shards).
+ */
+static pthread_mutex_t g_lobbyMutex = PTHREAD_MUTEX_INITIALIZER;
+static lobby_entry g_lobby[MAX_BOARD_SIZE + 1];
+
+/**
+ * @brief Re-arms the epoll interest set of a connection (EPOLLOUT only while output is pending).
+ * @param conn The connection
+ */
+static void update_connection_events(connection *conn) {
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | (conn->want_write ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    epoll_ctl(t_reactor->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/**
+ * @brief Writes as much pending output as the socket accepts, in one sendmsg per
+ *        OUT_QUEUE_MAX_IOV messages.
+ *
+ * A hard write error only discards the output and shuts the socket down; the resulting
+ * hang-up event then removes the client from the reactor loop, never from inside a handler.
+ *
+ * @param conn The connection
+ */
+static void flush_connection(connection *conn) {
+    int result = write_output(&conn->out, conn->fd);
+    if (result == OUTPUT_FAILED) {
+        discard_output(&conn->out);
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+
+    int wantWrite = result == OUTPUT_PENDING;
+    if (wantWrite != conn->want_write) {
+        conn->want_write = wantWrite;
+        update_connection_events(conn);
+    }
+}
+
+/**
+ * @brief Writes the output queued during the current batch, one system call per connection.
+ * @param self The reactor
+ */
+static void flush_dirty_connections(reactor *self) {
+    while (self->dirty_list != NULL) {
+        connection *conn = self->dirty_list;
+        self->dirty_list = conn->next_dirty;
+        conn->out_dirty = FALSE;
+        if (conn->state != CONN_CLOSED && !conn->want_write) {
+            flush_connection(conn);
+        }
+    }
+}
+
+/**
+ * @brief Takes a connection off the reactor's flush list (before it leaves the shard).
+ * @param self The reactor
+ * @param conn The connection
+ */
+static void unlink_dirty_connection(reactor *self, connection *conn) {
+    if (!conn->out_dirty) {
+        return;
+    }
+    connection **link = &self->dirty_list;
+    while (*link != conn) {
+        link = &(*link)->next_dirty;
+    }
+    *link = conn->next_dirty;
+    conn->out_dirty = FALSE;
+}
+
+void queue_connection_output(connection *conn, const char *data, size_t len) {
+    if (conn->state == CONN_CLOSED) {
+        return;
+    }
+
+    if (!append_output(&conn->out, data, len)) {
+        log_warn("Output queue of socket %d overflowed -> disconnect", conn->fd);
+        discard_output(&conn->out);
+        shutdown(conn->fd, SHUT_RDWR);
+        return;
+    }
+
+    // Written at the end of the batch, together with the other replies to this connection
+    if (!conn->out_dirty) {
+        conn->out_dirty = TRUE;
+        conn->next_dirty = t_reactor->dirty_list;
+        t_reactor->dirty_list = conn;
+    }
+}
+
+void close_connection(connection *conn) {
+    if (conn->state == CONN_CLOSED) {
+        return;
+    }
+    assert(conn->shard == t_reactor->id);
+
+    conn->state = CONN_CLOSED;
+    conn->owner = NULL;
+    cancel_timer(&conn->handshake_timer);
+    discard_output(&conn->out);
+    epoll_ctl(t_reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+
+    conn->next_closed = t_reactor->closed_list;
+    t_reactor->closed_list = conn;
+}
+
+/**
+ * @brief Ends an event batch: flushes the queued output, then frees every connection
+ *        closed during the batch.
+ * @param self The reactor
+ */
+static void finish_batch(reactor *self) {
+    flush_dirty_connections(self);
+
+    // The replies to every read of the batch are written now
+    if (self->batch_reads > 0) {
+        record_latency(LATENCY_REQUEST, metrics_clock_ns() - self->batch_started, (uint64_t) self->batch_reads);
+        self->batch_reads = 0;
+    }
+
+    while (self->closed_list != NULL) {
+        connection *next = self->closed_list->next_closed;
+        free(self->closed_list);
+        self->closed_list = next;
+    }
+}
+
+/**
+ * @brief Puts the client into the lobby as the one waiting for an opponent.
+ * @param cl The client, owned by the calling reactor
+ */
+static void enter_lobby(client *cl) {
+    lobby_entry *entry = &g_lobby[cl->hot->requested_board_size];
+    pthread_mutex_lock(&g_lobbyMutex);
+    entry->waiting = cl->handle;
+    entry->shard = t_reactor->id;
+    pthread_mutex_unlock(&g_lobbyMutex);
+}
+
+/**
+ * @brief Puts a partner taken from the lobby back, unless another client has entered meanwhile.
+ * @param board_size The partner's board size
+ * @param partner Handle of the partner
+ * @param shard Shard of the partner
+ */
+static void restore_lobby_entry(int board_size, client_handle partner, int shard) {
+    lobby_entry *entry = &g_lobby[board_size];
+    pthread_mutex_lock(&g_lobbyMutex);
+    if (entry->waiting == NULL_HANDLE) {
+        entry->waiting = partner;
+        entry->shard = shard;
+    }
+    pthread_mutex_unlock(&g_lobbyMutex);
+}
+
+void withdraw_match_request(client *cl) {
+    lobby_entry *entry = &g_lobby[cl->hot->requested_board_size];
+    pthread_mutex_lock(&g_lobbyMutex);
+    if (entry->waiting == cl->handle) {
+        entry->waiting = NULL_HANDLE;
+    }
+    pthread_mutex_unlock(&g_lobbyMutex);
+}
+
+/**
+ * @brief Pairs a client with the partner taken from the lobby; both live on this shard.
+ *
+ * The partner left the lobby before the pairing, so it may have disconnected or joined
+ * another game meanwhile. In that case the client goes through the lobby again.
+ *
+ * @param partner_handle Handle of the client taken from the lobby
+ * @param cl The requesting client
+ * @return TRUE if cl was handed over to another shard meanwhile (see hand_over_client), else FALSE
+ */
+static int pair_in_shard(client_handle partner_handle, client *cl) {
+    client *partner = resolve_client(partner_handle);
+    if (partner == NULL ||
+        __atomic_load_n(&partner->is_detached, __ATOMIC_ACQUIRE) ||
+        client_shard(partner) != t_reactor->id ||
+        partner->hot->is_requesting_game != TRUE ||
+        partner->hot->current_game != NULL_HANDLE ||
+        partner->hot->requested_board_size != cl->hot->requested_board_size) {
+        return request_shard_match(cl);
+    }
+
+    if (start_match(partner, cl)) {
+        announce_match_result(cl, TRUE);
+    } else {
+        // No free game slot; the partner keeps waiting in the lobby
+        enter_lobby(partner);
+        announce_match_result(cl, FALSE);
+    }
+    return FALSE;
+}
+
+/**
+ * @brief Gives up resuming the session a client's LOGIN superseded; that session is left to
+ *        its liveness deadlines.
+ * @param cl The client
+ */
+static void abandon_previous_session(client *cl) {
+    if (cl->previous_session != NULL) {
+        release_client(cl->previous_session);
+        cl->previous_session = NULL;
+    }
+}
+
+/**
+ * @brief Moves a client's connection to another shard, where it is paired with the partner
+ *        or resumes its previous session.
+ *
+ * Once the connection is in the destination's mailbox that reactor owns the client: the
+ * calling reactor must not touch cl, its connection or its receive buffer any more, not even
+ * to dispatch the messages pipelined behind the current one.
+ *
+ * @param target Index of the destination shard
+ * @param cl The migrating client, owned by the calling reactor
+ * @param partner Handle of the waiting client on the destination shard (NULL_HANDLE when resuming)
+ * @param resume TRUE to resume cl->previous_session on the destination shard
+ * @return TRUE if the connection was handed over, FALSE if it stays on this shard (no memory)
+ */
+static int hand_over_client(int target, client *cl, client_handle partner, int resume) {
+    shard_handoff *handoff = malloc(sizeof(shard_handoff));
+    if (handoff == NULL) {
+        perror("Failed to allocate memory for shard handoff");
+        return FALSE;
+    }
+
+    // Send what is queued while this reactor still owns the connection
+    connection *conn = cl->conn;
+    disarm_liveness_timers(cl);
+    unlink_dirty_connection(t_reactor, conn);
+    if (!conn->want_write) {
+        flush_connection(conn);
+    }
+    epoll_ctl(t_reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    conn->shard = SHARD_IN_TRANSIT;
+
+    handoff->conn = conn;
+    handoff->partner = partner;
+    handoff->resume = resume;
+
+    reactor *dest = &g_reactors[target];
+    pthread_mutex_lock(&dest->mailbox_mutex);
+    handoff->next = dest->mailbox;
+    dest->mailbox = handoff;
+    pthread_mutex_unlock(&dest->mailbox_mutex);
+
+    count_metric(METRIC_HANDOFFS_SENT, 1);
+
+    uint64_t one = 1;
+    if (write(dest->wake_fd, &one, sizeof(one)) == -1) {
+        perror("Failed to wake reactor");
+    }
+    return TRUE;
+}
+
+int request_shard_match(client *cl) {
+    set_game_request(cl, TRUE);
+
+    lobby_entry *entry = &g_lobby[cl->hot->requested_board_size];
+    pthread_mutex_lock(&g_lobbyMutex);
+    client_handle partner = entry->waiting;
+    int partnerShard = entry->shard;
+
+    if (partner == NULL_HANDLE || partner == cl->handle) {
+        entry->waiting = cl->handle;
+        entry->shard = t_reactor->id;
+        pthread_mutex_unlock(&g_lobbyMutex);
+        announce_match_result(cl, FALSE);
+        return FALSE;
+    }
+    entry->waiting = NULL_HANDLE;
+    pthread_mutex_unlock(&g_lobbyMutex);
+
+    if (partnerShard == t_reactor->id) {
+        return pair_in_shard(partner, cl);
+    }
+    log_debug("Client %d handed over from shard %d to shard %d", cl->id, t_reactor->id, partnerShard);
+    if (hand_over_client(partnerShard, cl, partner, FALSE)) {
+        return TRUE;
+    }
+    // The partner goes back to the lobby and the client asks again
+    restore_lobby_entry(cl->hot->requested_board_size, partner, partnerShard);
+    return request_shard_match(cl);
+}
+
+/**
+ * @brief Resumes the session superseded by a client's LOGIN when this shard serves it (or it
+ *        is gone already). A session served by another shard is resumed there: the client's
+ *        connection is handed over, with the messages pipelined behind the LOGIN. A seat in a
+ *        restored game is likewise claimed on the shard its game's slot selects, where the
+ *        other player of the game ends up too.
+ * @param cl The client, owned by the calling reactor
+ * @param may_hand_over FALSE once the client has been handed over for this purpose
+ * @return TRUE if the client stays on this shard, FALSE if it was handed over (the calling
+ *         reactor must not touch it any more)
+ */
+static int resume_on_shard(client *cl, int may_hand_over) {
+    client *previous = cl->previous_session;
+    int shard;
+    if (previous == NULL) {
+        int slot = may_hand_over ? restored_seat_slot(cl->username, cl->username_len) : -1;
+        if (slot >= 0 && slot % g_reactorCount != t_reactor->id) {
+            log_debug("Client %d handed over from shard %d to shard %d to claim its restored game", cl->id,
+                   t_reactor->id, slot % g_reactorCount);
+            // The seat can only be claimed on its game's shard; without a handoff it stays unclaimed
+            return !hand_over_client(slot % g_reactorCount, cl, NULL_HANDLE, TRUE);
+        }
+    } else if (locate_registered_shard(previous, &shard) && shard != t_reactor->id) {
+        if (shard >= 0 && may_hand_over) {
+            log_debug("Client %d handed over from shard %d to shard %d to resume its session", cl->id,
+                   t_reactor->id, shard);
+            if (hand_over_client(shard, cl, NULL_HANDLE, TRUE)) {
+                return FALSE;
+            }
+        }
+        // The session moved on meanwhile; only its own reactor may remove it
+        abandon_previous_session(cl);
+    }
+    resume_previous_session(cl);
+    return TRUE;
+}
+
+/**
+ * @brief Adopts the connections handed over to this shard and pairs their clients (or lets
+ *        them resume their previous session), then dispatches the messages they had pipelined.
+ * @param self The reactor
+ */
+static void process_handoffs(reactor *self) {
+    uint64_t counter;
+    if (read(self->wake_fd, &counter, sizeof(counter)) == -1 && errno != EAGAIN) {
+        perror("Failed to read reactor wake counter");
+    }
+
+    pthread_mutex_lock(&self->mailbox_mutex);
+    shard_handoff *pending = self->mailbox;
+    self->mailbox = NULL;
+    pthread_mutex_unlock(&self->mailbox_mutex);
+
+    // Restore arrival order
+    shard_handoff *ordered = NULL;
+    while (pending != NULL) {
+        shard_handoff *next = pending->next;
+        pending->next = ordered;
+        ordered = pending;
+        pending = next;
+    }
+
+    while (ordered != NULL) {
+        shard_handoff *handoff = ordered;
+        ordered = ordered->next;
+
+        connection *conn = handoff->conn;
+        conn->shard = self->id;
+        count_metric(METRIC_HANDOFFS_TAKEN, 1);
+
+        // Both buffers travel with the connection; EPOLLOUT resumes output the socket had not taken
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN | (conn->want_write ? EPOLLOUT : 0);
+        ev.data.ptr = conn;
+        if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) == -1) {
+            perror("Failed to adopt handed over connection");
+            if (!handoff->resume) {
+                restore_lobby_entry(conn->owner->hot->requested_board_size, handoff->partner, self->id);
+            }
+            detach_client(conn->owner);
+        } else if (handoff->resume) {
+            client *cl = conn->owner;
+            arm_liveness_timers(cl);
+            resume_on_shard(cl, FALSE);
+            dispatch_received_messages(cl, &conn->in);
+        } else {
+            client *cl = conn->owner;
+            arm_liveness_timers(cl);
+            // Dispatch the messages pipelined behind the JOIN_GAME, unless the client was handed on again
+            if (!pair_in_shard(handoff->partner, cl)) {
+                dispatch_received_messages(cl, &conn->in);
+            }
+        }
+        free(handoff);
+    }
+}
+
+/**
+ * @brief Accepts up to ACCEPT_BATCH pending connections on the reactor's (non-blocking)
+ *        listening socket and starts their handshake deadlines.
+ * @param self The reactor
+ */
+static void accept_connections(reactor *self) {
+    long long deadline = monotonic_ms() + HANDSHAKE_TIMEOUT * 1000;
+
+    for (int accepted = 0; accepted < ACCEPT_BATCH; accepted++) {
+        int sockCl = accept4(self->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sockCl == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Unable to accept client connection");
+            }
+            return;
+        }
+
+        connection *conn = calloc(1, sizeof(connection));
+        if (conn == NULL) {
+            perror("Failed to allocate memory for connection");
+            close(sockCl);
+            continue;
+        }
+        conn->fd = sockCl;
+        conn->state = CONN_HANDSHAKE;
+        conn->shard = self->id;
+        init_receive_buffer(&conn->in);
+        init_out_queue(&conn->out);
+        init_timer(&conn->handshake_timer, conn);
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, sockCl, &ev) == -1) {
+            perror("Failed to register client socket");
+            close(sockCl);
+            free(conn);
+            continue;
+        }
+        schedule_timer(&self->handshakes, &conn->handshake_timer, deadline);
+
+        log_debug("A client connected to shard %d.", self->id);
+    }
+}
+
+/**
+ * @brief Reads the LOGIN message of a fresh connection and registers the client.
+ * @param conn The connection in CONN_HANDSHAKE state
+ */
+static void handle_handshake(connection *conn) {
+    ssize_t n = receive_into_buffer(conn->fd, &conn->in);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        close_connection(conn);
+        return;
+    }
+
+    // Wait until the whole LOGIN line has arrived
+    char scratch[MESSAGE_SIZE];
+    char *loginMsg;
+    size_t loginLength;
+    int status = next_message(&conn->in, scratch, &loginMsg, &loginLength);
+    if (status == FALSE) {
+        return;
+    }
+
+    char username[PLAYER_NAME_SIZE];
+    int protocol;
+    if (status == MESSAGE_TOO_LONG || !parse_login_message(loginMsg, loginLength, username, &protocol)) {
+        log_warn("Invalid login message - closing client socket");
+        close_connection(conn);
+        return;
+    }
+    log_debug("LOGIN request received.");
+
+    if (!register_client(conn->fd, username, protocol, NULL)) {
+        log_warn("Could not register the client - closing socket");
+        close_connection(conn);
+        return;
+    }
+
+    client *connectedClient = locate_client_by_socket(conn->fd);
+    connectedClient->conn = conn;
+    conn->owner = connectedClient;
+    conn->state = CONN_ACTIVE;
+    cancel_timer(&conn->handshake_timer);
+    arm_liveness_timers(connectedClient);
+
+    confirm_login(connectedClient);
+    if (!resume_on_shard(connectedClient, TRUE)) {
+        return;
+    }
+
+    // Messages pipelined behind the LOGIN line
+    dispatch_received_messages(connectedClient, &conn->in);
+}
+
+/**
+ * @brief Reads what the socket has ready and dispatches every complete message.
+ * @param conn The connection in CONN_ACTIVE state
+ */
+static void handle_client_input(connection *conn) {
+    ssize_t n = receive_into_buffer(conn->fd, &conn->in);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        log_debug("Client must be disconnected...");
+        detach_client(conn->owner);
+        return;
+    }
+
+    t_reactor->batch_reads++;
+    dispatch_received_messages(conn->owner, &conn->in);
+}
+
+/**
+ * @brief Closes the connections whose LOGIN did not arrive within HANDSHAKE_TIMEOUT.
+ * @param self The reactor
+ */
+static void expire_handshakes(reactor *self) {
+    advance_timer_wheel(&self->handshakes, monotonic_ms());
+
+    timer_entry *entry;
+    while ((entry = pop_expired_timer(&self->handshakes)) != NULL) {
+        log_warn("No LOGIN within %d seconds - closing client socket", HANDSHAKE_TIMEOUT);
+        close_connection(entry->data);
+    }
+}
+
+/**
+ * @brief Returns when the reactor has to handle a deadline next.
+ * @param self The reactor
+ * @return Monotonic time in milliseconds
+ */
+static long long next_reactor_deadline(const reactor *self) {
+    long long liveness = next_timer_deadline(&self->timers);
+    long long handshake = next_timer_deadline(&self->handshakes);
+    return liveness < handshake ? liveness : handshake;
+}
+
+/**
+ * @brief Registers a descriptor for EPOLLIN with the given event tag.
+ * @return 0 on success, -1 on failure
+ */
+static int watch_descriptor(int epoll_fd, int fd, void *tag) {
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * @brief Main loop of one reactor thread.
+ * @param arg Pointer to the reactor
+ * @return A void pointer (unused)
+ */
+static void *reactor_main(void *arg) {
+    reactor *self = (reactor *) arg;
+    t_reactor = self;
+
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (1) {
+        // Ping, zombie and handshake deadlines that passed
+        long long now = monotonic_ms();
+        if (now >= next_reactor_deadline(self)) {
+            if (now >= next_timer_deadline(&self->handshakes)) {
+                expire_handshakes(self);
+            }
+            if (now >= next_timer_deadline(&self->timers)) {
+                expire_liveness_timers(self->id);
+            }
+            finish_batch(self);
+        }
+
+        int timeout = (int) (next_reactor_deadline(self) - monotonic_ms());
+        int count = epoll_wait(self->epoll_fd, events, REACTOR_MAX_EVENTS, timeout > 0 ? timeout : 0);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            return NULL;
+        }
+        self->batch_started = metrics_clock_ns();
+
+        for (int i = 0; i < count; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == NULL) {
+                accept_connections(self);
+                continue;
+            }
+            if (tag == self) {
+                process_handoffs(self);
+                continue;
+            }
+
+            connection *conn = tag;
+            if (conn->state != CONN_CLOSED && conn->shard == self->id && (events[i].events & EPOLLOUT)) {
+                flush_connection(conn);
+            }
+            if (conn->state != CONN_CLOSED && conn->shard == self->id &&
+                (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                if (conn->state == CONN_HANDSHAKE) {
+                    handle_handshake(conn);
+                } else {
+                    handle_client_input(conn);
+                }
+            }
+        }
+
+        finish_batch(self);
+    }
+}
+
+timer_wheel *shard_timer_wheel(int shard) {
+    return &g_reactors[shard].timers;
+}
+
+int current_shard() {
+    return t_reactor != NULL ? t_reactor->id : NO_SHARD;
+}
+
+void *run_event_loops(const int *listen_fds, int count) {
+    g_reactorCount = count;
+    for (int i = 0; i < count; i++) {
+        reactor *self = &g_reactors[i];
+        self->id = i;
+        self->listen_fd = listen_fds[i];
+        self->mailbox = NULL;
+        self->closed_list = NULL;
+        self->dirty_list = NULL;
+        self->batch_reads = 0;
+        init_timer_wheel(&self->timers, monotonic_ms());
+        init_timer_wheel(&self->handshakes, monotonic_ms());
+        pthread_mutex_init(&self->mailbox_mutex, NULL);
+
+        self->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        self->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (self->epoll_fd == -1 || self->wake_fd == -1) {
+            perror("Failed to create reactor");
+            return NULL;
+        }
+
+        // NULL tags the listening socket, the reactor itself tags its wake-up descriptor
+        if (watch_descriptor(self->epoll_fd, self->listen_fd, NULL) == -1 ||
+            watch_descriptor(self->epoll_fd, self->wake_fd, self) == -1) {
+            perror("Failed to register reactor descriptors");
+            return NULL;
+        }
+    }
+
+    for (int i = 1; i < count; i++) {
+        if (pthread_create(&g_reactors[i].thread, NULL, reactor_main, &g_reactors[i]) != 0) {
+            perror("Failed to launch reactor thread");
+            return NULL;
+        }
+    }
+
+    return reactor_main(&g_reactors[0]);
+}
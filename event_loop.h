@@ -0,0 +1,83 @@
+/**
+ * @file event_loop.h
+ * @brief Declares the sharded epoll reactors that serve clients over non-blocking sockets.
+ */
+
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include <stddef.h>
+#include "def_n_struct.h"
+
+/**
+ * Runs one reactor thread per listening socket (each socket bound with SO_REUSEPORT, so the
+ * kernel spreads new connections across them). Every reactor owns the clients and games of
+ * its shard: it accepts, performs the LOGIN handshake, dispatches messages, flushes output
+ * and handles the ping and zombie deadlines of its clients. The calling thread becomes reactor 0; the function
+ * does not return under normal operation.
+ *
+ * @param listen_fds The bound and listening server sockets, one per reactor
+ * @param count Number of sockets (and reactors), at most MAX_REACTORS
+ * @return A void pointer (unused)
+ */
+void *run_event_loops(const int *listen_fds, int count);
+
+/**
+ * Returns the timer wheel holding the ping and zombie deadlines of a shard's clients.
+ * Only the reactor of the shard may use it.
+ *
+ * @param shard The shard index
+ * @return The shard's wheel
+ */
+timer_wheel *shard_timer_wheel(int shard);
+
+/**
+ * Returns the shard of the calling reactor thread.
+ *
+ * @return The shard index, or NO_SHARD outside the reactor threads
+ */
+int current_shard();
+
+/**
+ * Appends data to a connection's outbound queue. The queue is written at the end of the
+ * reactor's event batch, so all replies of the batch leave in one sendmsg; whatever the
+ * kernel does not accept is flushed when the socket becomes writable. A connection whose
+ * queue exceeds OUT_QUEUE_LIMIT is shut down. Must be called from the reactor owning the connection.
+ *
+ * @param conn The destination connection
+ * @param data The bytes to send
+ * @param len Number of bytes in data
+ */
+void queue_connection_output(connection *conn, const char *data, size_t len);
+
+/**
+ * Unregisters a connection from its reactor and closes its socket. The structure itself
+ * is released once the current batch of events has been processed.
+ * Must be called from the reactor owning the connection (asserted), never for a connection
+ * handed over to another shard.
+ *
+ * @param conn The connection to close
+ */
+void close_connection(connection *conn);
+
+/**
+ * Handles JOIN_GAME for a reactor client. The client either waits in the shared lobby (one
+ * slot per board size) or is paired with the client waiting for the same size; when that
+ * client lives on another shard, the requester's connection is handed over to that shard so
+ * both players of a game share one reactor. The destination reactor owns the client from then
+ * on: the caller must not touch cl or its connection any more, and the messages pipelined
+ * behind the JOIN_GAME are dispatched by the destination.
+ *
+ * @param cl The requesting client, owned by the calling reactor
+ * @return TRUE if the client was handed over to another shard, FALSE if it stays on this one
+ */
+int request_shard_match(client *cl);
+
+/**
+ * Removes the client from the lobby if it is the one waiting there.
+ *
+ * @param cl The client leaving the server
+ */
+void withdraw_match_request(client *cl);
+
+#endif
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "game_snapshot.h"
+#include "match_manager.h"
+#include "rules_engine.h"
+#include "slab_pool.h"
+#include "move_journal.h"
+#include "server_log.h"
+
+/**
+ * Identifies the file format; a file starting with anything else is overwritten.
+ */
+#define SNAPSHOT_MAGIC          "UPSGAME1"
+
+/**
+ * Start of the snapshot file, followed by capacity records.
+ */
+typedef struct {
+    char        magic[8];       /**< SNAPSHOT_MAGIC (not NUL-terminated). */
+    uint32_t    record_size;    /**< sizeof(game_record) of the writer. */
+    uint32_t    capacity;       /**< Number of records. */
+} snapshot_header;
+
+/**
+ * Snapshot of one game. The position is kept twice: a move writes the copy not in use and
+ * then switches position with a single byte store, so a process killed in the middle of a
+ * move leaves the previous position intact.
+ */
+typedef struct {
+    bitboard    discs[2][2];                    /**< Two copies of the discs of the first and second player. */
+    char        names[2][PLAYER_NAME_SIZE];     /**< Usernames of the first and second player (not NUL-terminated). */
+    uint8_t     name_len[2];                    /**< Lengths of the usernames. */
+    uint8_t     on_turn[2];                     /**< Seat on turn, per copy. */
+    uint8_t     position;                       /**< Copy holding the current position. */
+    uint8_t     board_size;                     /**< Width and height of the board. */
+    uint8_t     in_use;                         /**< Non-zero while the game runs; set last when a game starts. */
+} game_record;
+
+/**
+ * A game restored at startup, indexed by its pool slot.
+ */
+typedef struct {
+    game_handle handle;     /**< The game, NULL_HANDLE if the slot holds no restored game. */
+    int         on_turn;    /**< Seat on turn when the game was restored. */
+    int         claimed;    /**< Bit per seat already taken by a player. */
+} restored_game;
+
+/**
+ * Entry of the index of the restored seats by username; the name is read from the record.
+ */
+typedef struct {
+    int         slot;       /**< Pool slot of the game plus one, 0 for a free bucket. */
+    int         seat;       /**< Seat of the username in the game. */
+} seat_entry;
+
+/**
+ * Records of the mapped file, indexed by game pool slot (NULL without a snapshot file).
+ */
+static game_record *g_records = NULL;
+
+/**
+ * Protects the restored games and g_claimsOpen; the seat index is read-only once built.
+ * Lock order: g_restoreMutex before g_gamesMutex and game::lock.
+ */
+static pthread_mutex_t g_restoreMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Restored games by pool slot (games_capacity entries, NULL if nothing was restored).
+ */
+static restored_game *g_restoredGames = NULL;
+
+/**
+ * Open-addressing index of the restored seats; its size is a power of two, at least
+ * twice the number of seats the game tables can hold.
+ */
+static seat_entry *g_seatIndex = NULL;
+static unsigned int g_seatIndexMask = 0;
+
+/**
+ * TRUE until RESTORE_GRACE runs out.
+ */
+static int g_claimsOpen = FALSE;
+
+/**
+ * @brief Returns the seat a game's on-turn player sits on.
+ */
+static int seat_on_turn(const game *g) {
+    return g->current_player == g->player2 ? 1 : 0;
+}
+
+void snapshot_new_game(const game *g, const client *player_1, const client *player_2) {
+    if (g_records == NULL) {
+        return;
+    }
+    game_record *record = &g_records[handle_slot(g->handle)];
+    __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+
+    const client *players[2] = {player_1, player_2};
+    for (int seat = 0; seat < 2; seat++) {
+        record->name_len[seat] = (uint8_t) players[seat]->username_len;
+        memcpy(record->names[seat], players[seat]->username, (size_t) players[seat]->username_len);
+    }
+    record->board_size = (uint8_t) g->board_size;
+    record->discs[0][0] = g->discs[0];
+    record->discs[0][1] = g->discs[1];
+    record->on_turn[0] = (uint8_t) seat_on_turn(g);
+    record->position = 0;
+
+    __atomic_store_n(&record->in_use, 1, __ATOMIC_RELEASE);
+}
+
+void snapshot_move(const game *g) {
+    if (g_records == NULL) {
+        return;
+    }
+    game_record *record = &g_records[handle_slot(g->handle)];
+    int next = 1 - record->position;
+    record->discs[next][0] = g->discs[0];
+    record->discs[next][1] = g->discs[1];
+    record->on_turn[next] = (uint8_t) seat_on_turn(g);
+    __atomic_store_n(&record->position, (uint8_t) next, __ATOMIC_RELEASE);
+}
+
+void snapshot_game_over(const game *g) {
+    if (g_records == NULL) {
+        return;
+    }
+    __atomic_store_n(&g_records[handle_slot(g->handle)].in_use, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief FNV-1a hash of a username.
+ */
+static unsigned int hash_name(const char *name, int len) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Tells whether a seat entry belongs to a username.
+ */
+static int is_seat_of(const seat_entry *entry, const char *name, int len) {
+    const game_record *record = &g_records[entry->slot - 1];
+    return record->name_len[entry->seat] == len && memcmp(record->names[entry->seat], name, (size_t) len) == 0;
+}
+
+/**
+ * @brief Finds the bucket of a username: its entry, or the free bucket where it belongs.
+ */
+static seat_entry *find_seat_bucket(const char *name, int len) {
+    unsigned int bucket = hash_name(name, len) & g_seatIndexMask;
+    while (g_seatIndex[bucket].slot != 0 && !is_seat_of(&g_seatIndex[bucket], name, len)) {
+        bucket = (bucket + 1) & g_seatIndexMask;
+    }
+    return &g_seatIndex[bucket];
+}
+
+/**
+ * @brief Allocates the restored games and the seat index for up to games_capacity games.
+ * @return TRUE on success
+ */
+static int init_restore_tables() {
+    unsigned int buckets = 1;
+    while (buckets < 4u * (unsigned int) games_capacity) {
+        buckets <<= 1;
+    }
+    g_restoredGames = calloc((size_t) games_capacity, sizeof(restored_game));
+    g_seatIndex = calloc(buckets, sizeof(seat_entry));
+    if (g_restoredGames == NULL || g_seatIndex == NULL) {
+        perror("Failed to allocate the restored game tables");
+        free(g_restoredGames);
+        free(g_seatIndex);
+        g_restoredGames = NULL;
+        g_seatIndex = NULL;
+        return FALSE;
+    }
+    g_seatIndexMask = buckets - 1;
+    return TRUE;
+}
+
+/**
+ * @brief Checks that a record in use describes a position the server can continue.
+ */
+static int is_valid_record(const game_record *record) {
+    if (record->position > 1 || record->on_turn[record->position] > 1 ||
+        get_rules_kernel(record->board_size) == NULL) {
+        return FALSE;
+    }
+    for (int seat = 0; seat < 2; seat++) {
+        if (record->name_len[seat] == 0 || record->name_len[seat] >= PLAYER_NAME_SIZE) {
+            return FALSE;
+        }
+    }
+
+    const bitboard *discs = record->discs[record->position];
+    bitboard board = ((bitboard) 1 << (record->board_size * record->board_size)) - 1;
+    return (discs[0] & discs[1]) == 0 && ((discs[0] | discs[1]) & ~board) == 0;
+}
+
+/**
+ * @brief Registers the seats of a restored game. A username already holding a restored seat
+ *        keeps only its first one.
+ * @param record The game's record
+ * @param g The restored game
+ */
+static void index_restored_game(const game_record *record, const game *g) {
+    int slot = handle_slot(g->handle);
+    g_restoredGames[slot].handle = g->handle;
+    g_restoredGames[slot].on_turn = record->on_turn[record->position];
+    g_restoredGames[slot].claimed = 0;
+
+    for (int seat = 0; seat < 2; seat++) {
+        seat_entry *entry = find_seat_bucket(record->names[seat], record->name_len[seat]);
+        if (entry->slot == 0) {
+            entry->slot = slot + 1;
+            entry->seat = seat;
+        }
+    }
+}
+
+/**
+ * @brief Restores the games of the mapped records in one pass. Games get the lowest free
+ *        pool slots in record order, so a record only ever moves down to its new slot.
+ * @param capacity Number of mapped records
+ * @return Number of restored games
+ */
+static int restore_games(int capacity) {
+    int restored = 0;
+    for (int i = 0; i < capacity; i++) {
+        game_record *record = &g_records[i];
+        if (!record->in_use) {
+            continue;
+        }
+
+        game *g = NULL;
+        if (is_valid_record(record) && (g_restoredGames != NULL || init_restore_tables())) {
+            g = restore_game_session(record->board_size, record->discs[record->position]);
+        }
+        if (g == NULL) {
+            record->in_use = 0;
+            continue;
+        }
+
+        int slot = handle_slot(g->handle);
+        if (slot != i) {
+            g_records[slot] = *record;
+            record->in_use = 0;
+        }
+        index_restored_game(&g_records[slot], g);
+        for (int seat = 0; seat < 2; seat++) {
+            journal_seat(g, seat, g_records[slot].on_turn[g_records[slot].position], g_records[slot].names[seat],
+                         g_records[slot].name_len[seat]);
+        }
+        restored++;
+    }
+    return restored;
+}
+
+/**
+ * @brief Closes the claims once RESTORE_GRACE has passed and removes the restored games of
+ *        which no seat was claimed. A game with one claimed seat is ended by its player's
+ *        next ping deadline (see awaiting_restored_opponent).
+ * @param arg Unused
+ * @return NULL
+ */
+static void *expire_restored_seats(void *arg) {
+    (void) arg;
+    sleep(RESTORE_GRACE);
+
+    int abandoned = 0;
+    pthread_mutex_lock(&g_restoreMutex);
+    g_claimsOpen = FALSE;
+    for (int slot = 0; slot < games_capacity; slot++) {
+        restored_game *rg = &g_restoredGames[slot];
+        if (rg->handle != NULL_HANDLE && rg->claimed == 0 && abandon_game(rg->handle)) {
+            abandoned++;
+        }
+    }
+    pthread_mutex_unlock(&g_restoreMutex);
+
+    log_info("%d restored games abandoned by both players", abandoned);
+    return NULL;
+}
+
+int open_game_snapshot(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror("Failed to open the game snapshot");
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // Records of an earlier run are kept only if the file is one of ours
+    snapshot_header header;
+    int capacity = 0;
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 && header.record_size == sizeof(game_record) &&
+        (size_t) st.st_size >= sizeof(header) + (size_t) header.capacity * sizeof(game_record)) {
+        capacity = (int) header.capacity;
+    } else if (st.st_size != 0) {
+        log_warn("%s is not a game snapshot - starting without games", path);
+    }
+
+    // The file never shrinks: records beyond a smaller game table are still read, and dropped
+    // by restore_games when no game slot is left for them
+    int mapped = capacity > games_capacity ? capacity : games_capacity;
+    size_t size = sizeof(header) + (size_t) mapped * sizeof(game_record);
+    if ((capacity == 0 && ftruncate(fd, 0) == -1) || ftruncate(fd, (off_t) size) == -1) {
+        perror("Failed to size the game snapshot");
+        close(fd);
+        return -1;
+    }
+    // Populated up front: the restore reads every record anyway
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("Failed to map the game snapshot");
+        return -1;
+    }
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(game_record);
+    header.capacity = (uint32_t) mapped;
+    memcpy(base, &header, sizeof(header));
+    g_records = (game_record *) (base + sizeof(header));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int restored = restore_games(mapped);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_info("%d games restored from %s in %.1f ms", restored, path,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+    if (restored > 0) {
+        g_claimsOpen = TRUE;
+        pthread_t thExpire;
+        if (pthread_create(&thExpire, NULL, expire_restored_seats, NULL) != 0) {
+            perror("Failed to launch the restore timer");
+        } else {
+            pthread_detach(thExpire);
+        }
+    }
+    return restored;
+}
+
+int lock_restored_seat(const char *username, int username_len, restored_seat *seat) {
+    if (g_seatIndex == NULL) {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&g_restoreMutex);
+    seat_entry *entry = g_claimsOpen ? find_seat_bucket(username, username_len) : NULL;
+    restored_game *rg = entry != NULL && entry->slot != 0 ? &g_restoredGames[entry->slot - 1] : NULL;
+    if (rg == NULL || rg->handle == NULL_HANDLE || (rg->claimed & (1 << entry->seat))) {
+        pthread_mutex_unlock(&g_restoreMutex);
+        return FALSE;
+    }
+
+    seat->game = rg->handle;
+    seat->seat = entry->seat;
+    seat->on_turn = rg->on_turn;
+    return TRUE;
+}
+
+void release_restored_seat(const restored_seat *seat, int claimed) {
+    if (claimed) {
+        g_restoredGames[handle_slot(seat->game)].claimed |= 1 << seat->seat;
+    }
+    pthread_mutex_unlock(&g_restoreMutex);
+}
+
+int restored_seat_slot(const char *username, int username_len) {
+    restored_seat seat;
+    if (!lock_restored_seat(username, username_len, &seat)) {
+        return -1;
+    }
+    release_restored_seat(&seat, FALSE);
+    return handle_slot(seat.game);
+}
+
+int awaiting_restored_opponent(const client *cl) {
+    if (g_restoredGames == NULL) {
+        return FALSE;
+    }
+    game_handle handle = __atomic_load_n(&cl->hot->current_game, __ATOMIC_ACQUIRE);
+    if (handle == NULL_HANDLE) {
+        return FALSE;
+    }
+
+    // Once both seats are claimed the opponent is linked right away, the caller looked too early
+    pthread_mutex_lock(&g_restoreMutex);
+    restored_game *rg = &g_restoredGames[handle_slot(handle)];
+    int awaiting = rg->handle == handle && (g_claimsOpen || rg->claimed == 3);
+    pthread_mutex_unlock(&g_restoreMutex);
+    return awaiting;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file game_snapshot.h
+ * @brief Declares the snapshot of the running games kept in a memory-mapped file, and the
+ *        restore of those games when the server starts again.
+ *
+ * Every running game owns one fixed-size record, indexed by its pool slot: the usernames of
+ * both players, written when the game starts, and the discs and the seat on turn, rewritten
+ * by each move. Records are plain stores into a shared mapping, so the page cache keeps them
+ * when the process exits or crashes; nothing is flushed to disk explicitly.
+ *
+ * On startup the records are read in one pass and each game is created again without
+ * players. A player claims a seat by logging in under the username stored for it (see
+ * claim_restored_seat); when both seats are taken, the game resumes through RECONNECT.
+ * Seats not claimed within RESTORE_GRACE seconds are given up.
+ */
+
+#ifndef __GAME_SNAPSHOT_H__
+#define __GAME_SNAPSHOT_H__
+
+#include "def_n_struct.h"
+
+/**
+ * A seat of a restored game, locked for claiming by lock_restored_seat.
+ */
+typedef struct {
+    game_handle game;       /**< The restored game. */
+    int         seat;       /**< 0 for the first player (FIRST_PL_CHAR), 1 for the second. */
+    int         on_turn;    /**< Seat that moves next. */
+} restored_seat;
+
+/**
+ * Maps the snapshot file (creating it if needed) and restores the games it holds; call once
+ * at startup, after init_game_registry and before the first client connects. Records that
+ * do not fit into the game tables, or do not describe a valid position, are dropped.
+ *
+ * @param path The snapshot file
+ * @return Number of restored games, or -1 if the file could not be mapped
+ */
+int open_game_snapshot(const char *path);
+
+/**
+ * Records a new game with the names of its players. No-op without a snapshot file.
+ *
+ * @param g The game (locked by the caller)
+ * @param player_1 The first player
+ * @param player_2 The second player
+ */
+void snapshot_new_game(const game *g, const client *player_1, const client *player_2);
+
+/**
+ * Records the position after a move: the discs and the seat on turn. No-op without a
+ * snapshot file.
+ *
+ * @param g The game (locked by the caller)
+ */
+void snapshot_move(const game *g);
+
+/**
+ * Forgets a finished game, so that it is not restored. No-op without a snapshot file.
+ *
+ * @param g The game (locked by the caller)
+ */
+void snapshot_game_over(const game *g);
+
+/**
+ * Looks up the seat a username holds in a restored game and, if it can still be claimed,
+ * keeps the restored seats locked until release_restored_seat.
+ *
+ * @param username The username
+ * @param username_len Length of the username
+ * @param seat Receives the seat
+ * @return TRUE if the seat is claimable (and locked), FALSE otherwise
+ */
+int lock_restored_seat(const char *username, int username_len, restored_seat *seat);
+
+/**
+ * Unlocks a seat locked by lock_restored_seat. A claimed seat cannot be claimed again; the
+ * game is no longer restored once both of its seats are claimed.
+ *
+ * @param seat The seat
+ * @param claimed TRUE if the caller took the seat
+ */
+void release_restored_seat(const restored_seat *seat, int claimed);
+
+/**
+ * Returns the pool slot of the restored game in which a username still has a seat to
+ * claim (epoll mode serves a restored game on the shard selected by its slot).
+ *
+ * @param username The username
+ * @param username_len Length of the username
+ * @return The game's slot, or -1 if the username has no claimable seat
+ */
+int restored_seat_slot(const char *username, int username_len);
+
+/**
+ * Tells whether a client that claimed a seat should keep waiting for its opponent: the
+ * opponent's seat is claimable until RESTORE_GRACE runs out (or has just been claimed).
+ *
+ * @param cl The client
+ * @return TRUE to keep the game, FALSE if the opponent will not come back
+ */
+int awaiting_restored_opponent(const client *cl);
+
+#endif
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "login_acceptor.h"
+#include "player_manager.h"
+#include "network_interface.h"
+#include "timer_wheel.h"
+#include "server_log.h"
+
+/**
+ * @brief A connection accepted in thread mode that has not sent its LOGIN line yet.
+ */
+typedef struct {
+    int         fd;         /**< Non-blocking socket descriptor. */
+    timer_entry deadline;   /**< When the connection is closed if the LOGIN has not arrived. */
+} pending_login;
+
+/**
+ * @brief Forgets a pending connection and closes its socket.
+ * @param epoll_fd The acceptor's epoll instance
+ * @param pending The connection
+ */
+static void drop_pending_login(int epoll_fd, pending_login *pending) {
+    cancel_timer(&pending->deadline);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pending->fd, NULL);
+    close(pending->fd);
+    free(pending);
+}
+
+/**
+ * @brief Accepts up to ACCEPT_BATCH pending connections and starts their handshake deadlines.
+ * @param epoll_fd The acceptor's epoll instance
+ * @param listen_fd The non-blocking listening socket
+ * @param timers The wheel holding the handshake deadlines
+ */
+static void accept_login_batch(int epoll_fd, int listen_fd, timer_wheel *timers) {
+    long long deadline = monotonic_ms() + HANDSHAKE_TIMEOUT * 1000;
+
+    for (int accepted = 0; accepted < ACCEPT_BATCH; accepted++) {
+        int sockCl = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sockCl == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Unable to accept client connection");
+            }
+            return;
+        }
+
+        pending_login *pending = malloc(sizeof(pending_login));
+        if (pending == NULL) {
+            perror("Failed to allocate memory for connection");
+            close(sockCl);
+            continue;
+        }
+        pending->fd = sockCl;
+        init_timer(&pending->deadline, pending);
+
+        // Edge-triggered: the LOGIN line is only peeked at, so a partial line must not wake us again
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = pending;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockCl, &ev) == -1) {
+            perror("Failed to register client socket");
+            close(sockCl);
+            free(pending);
+            continue;
+        }
+        schedule_timer(timers, &pending->deadline, deadline);
+
+        log_debug("A client connected.");
+    }
+}
+
+/**
+ * @brief Registers the client of a complete LOGIN line and starts its thread.
+ * @param sockCl The client socket, already switched to blocking mode
+ * @param username The parsed username
+ * @param protocol The encoding chosen at LOGIN
+ */
+static void start_client(int sockCl, char *username, int protocol) {
+    pthread_t thClient;
+    // Attempt client registration
+    if (!register_client(sockCl, username, protocol, &thClient)) {
+        perror("Could not register the client - closing socket");
+        close(sockCl);
+        return;
+    }
+
+    // Retrieve the newly created client reference
+    client *connectedClient = locate_client_by_socket(sockCl);
+
+    // Start the client thread; it holds a reference until it ends
+    retain_client(connectedClient);
+    if (pthread_create(&thClient, NULL, client_thread_main, connectedClient) != 0) {
+        perror("Failed to launch client thread");
+        detach_client(connectedClient);
+        release_client(connectedClient);
+        close(sockCl);
+        return;
+    }
+}
+
+/**
+ * @brief Checks whether the LOGIN line of a pending connection is complete and, if so,
+ *        hands the connection over to a client thread.
+ * @param epoll_fd The acceptor's epoll instance
+ * @param pending The connection
+ */
+static void continue_login(int epoll_fd, pending_login *pending) {
+    int sockCl = pending->fd;
+    char loginMsg[LOGIN_MESSAGE_SIZE];
+    ssize_t peeked = recv(sockCl, loginMsg, sizeof(loginMsg) - 1, MSG_PEEK);
+    if (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (peeked <= 0) {
+        log_debug("Client left before logging in - closing socket");
+        drop_pending_login(epoll_fd, pending);
+        return;
+    }
+
+    // Consume only the LOGIN line; messages pipelined behind it stay queued for the client thread
+    char *loginEnd = memchr(loginMsg, MESS_END_CHAR[0], (size_t) peeked);
+    if (loginEnd == NULL) {
+        if ((size_t) peeked < sizeof(loginMsg) - 1) {
+            return;
+        }
+        log_warn("Unrecognized message - closing client socket");
+        drop_pending_login(epoll_fd, pending);
+        return;
+    }
+    size_t loginLength = (size_t) (loginEnd - loginMsg);
+    ssize_t consumed;
+    do {
+        consumed = recv(sockCl, loginMsg, loginLength + 1, 0);
+    } while (consumed < 0 && errno == EINTR);
+    if (consumed != (ssize_t) (loginLength + 1)) {
+        // A partly consumed line would leave the client thread out of step with the stream
+        log_warn("Could not read the LOGIN line - closing client socket");
+        drop_pending_login(epoll_fd, pending);
+        return;
+    }
+
+    // The socket leaves the acceptor; its client thread reads it with blocking calls
+    cancel_timer(&pending->deadline);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sockCl, NULL);
+    free(pending);
+
+    // Check protocol message
+    char tempUser[PLAYER_NAME_SIZE];
+    int protocol;
+    if (!parse_login_message(loginMsg, loginLength, tempUser, &protocol)) {
+        log_warn("Unrecognized message - closing client socket");
+        close(sockCl);
+        return;
+    }
+    log_debug("LOGIN request received.");
+
+    fcntl(sockCl, F_SETFL, fcntl(sockCl, F_GETFL) & ~O_NONBLOCK);
+    start_client(sockCl, tempUser, protocol);
+}
+
+/**
+ * @brief Closes the connections whose handshake deadline passed.
+ * @param epoll_fd The acceptor's epoll instance
+ * @param timers The wheel holding the handshake deadlines
+ */
+static void expire_pending_logins(int epoll_fd, timer_wheel *timers) {
+    advance_timer_wheel(timers, monotonic_ms());
+
+    timer_entry *entry;
+    while ((entry = pop_expired_timer(timers)) != NULL) {
+        log_warn("No LOGIN within %d seconds - closing client socket", HANDSHAKE_TIMEOUT);
+        drop_pending_login(epoll_fd, entry->data);
+    }
+}
+
+void *run_login_acceptor(int listen_fd) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("Failed to create the acceptor");
+        return NULL;
+    }
+
+    // NULL tags the listening socket
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        perror("Failed to register the server socket");
+        return NULL;
+    }
+
+    timer_wheel timers;
+    init_timer_wheel(&timers, monotonic_ms());
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (1) {
+        if (monotonic_ms() >= next_timer_deadline(&timers)) {
+            expire_pending_logins(epoll_fd, &timers);
+        }
+
+        int timeout = (int) (next_timer_deadline(&timers) - monotonic_ms());
+        int count = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, timeout > 0 ? timeout : 0);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            return NULL;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_login_batch(epoll_fd, listen_fd, &timers);
+            } else {
+                continue_login(epoll_fd, events[i].data.ptr);
+            }
+        }
+    }
+}
@@ -0,0 +1,22 @@
+/**
+ * @file login_acceptor.h
+ * @brief Declares the acceptor of the thread-per-client mode, which completes LOGIN
+ *        handshakes without blocking on any single connection.
+ */
+
+#ifndef __LOGIN_ACCEPTOR_H__
+#define __LOGIN_ACCEPTOR_H__
+
+/**
+ * Accepts connections on a non-blocking listening socket in batches and waits for their
+ * LOGIN lines on one epoll instance, each handshake bounded by HANDSHAKE_TIMEOUT. A complete
+ * LOGIN registers the client, switches its socket back to blocking mode and starts its thread;
+ * a malformed LOGIN or an expired deadline closes the socket. The function does not return
+ * under normal operation.
+ *
+ * @param listen_fd The bound, listening and non-blocking server socket
+ * @return A void pointer (unused)
+ */
+void *run_login_acceptor(int listen_fd);
+
+#endif
@@ -5,129 +5,271 @@
 
 #include "def_n_struct.h"
 #include "match_manager.h"
+#include "rules_engine.h"
+#include "slab_pool.h"
+#include "game_snapshot.h"
+#include "move_journal.h"
+#include "server_log.h"
 
 pthread_mutex_t g_gamesMutex = PTHREAD_MUTEX_INITIALIZER;
-game *g_gamesArr[MAX_GAMES] = {0};
+
+/**
+ * Dense array of the running games: entries [0, count_games()) are used.
+ */
+game **g_gamesArr = NULL;
+
+/**
+ * Capacity of the game tables.
+ */
+int games_capacity = 0;
+
+/**
+ * Number of games in g_gamesArr (live counter, written under g_gamesMutex).
+ */
+static int g_activeGames = 0;
+
+/**
+ * Pool holding every game; a removed game returns to it and its handles become stale.
+ * Game memory is never freed, so a thread still holding a stale game pointer can safely lock it.
+ */
+static slab_pool g_gamePool;
+
+int init_game_registry(int max_games) {
+    g_gamesArr = calloc(max_games, sizeof(game *));
+    if (g_gamesArr == NULL || !init_slab_pool(&g_gamePool, sizeof(game), max_games)) {
+        perror("Failed to allocate the game tables");
+        return FALSE;
+    }
+
+    // The locks live as long as the pool (games are recycled, never freed)
+    for (int slot = 0; slot < max_games; slot++) {
+        game *g = slab_object(&g_gamePool, slot);
+        pthread_mutex_init(&g->lock, NULL);
+        g->handle = NULL_HANDLE;
+    }
+
+    games_capacity = max_games;
+    return TRUE;
+}
 
 /**
  * @brief Count the number of g_gamesArr that are played
  * @return number of playing g_gamesArr
  */
 int count_games() {
-    int count = 0;
-    pthread_mutex_lock(&g_gamesMutex);
-    for (int i = 0; i < MAX_GAMES; i++) {
-        if (g_gamesArr[i] != NULL) {
-            count++;
-        }
-    }
-    pthread_mutex_unlock(&g_gamesMutex);
-
-    return count;
+    return __atomic_load_n(&g_activeGames, __ATOMIC_RELAXED);
 }
 
-game *initiate_game_session(client *player_1, client *player_2) {
-    if (count_games() >= MAX_GAMES) {
-        printf("Maximum number of g_gamesArr reached\n");
+game *initiate_game_session(client *player_1, client *player_2, int board_size) {
+    const rules_kernel *kernel = get_rules_kernel(board_size);
+    if (kernel == NULL) {
+        log_warn("Unsupported board size %d", board_size);
         return NULL;
     }
 
-    game *new_game = malloc(sizeof(game));
-    if (new_game == NULL) {
-        perror("Failed to allocate memory for the game");
+    pthread_mutex_lock(&g_gamesMutex);
+
+    if (g_activeGames >= games_capacity) {
+        pthread_mutex_unlock(&g_gamesMutex);
+        log_warn("Maximum number of games reached");
         return NULL;
     }
 
-    pthread_mutex_lock(&g_gamesMutex);
+    // The pool has room for games_capacity games, so this cannot fail here
+    game_handle handle;
+    game *new_game = slab_alloc(&g_gamePool, &handle);
 
-    // Initialize the game
-    new_game->id = rand();
-    new_game->player1 = player_1;
-    setup_initial_board(new_game->board);
-    new_game->player2 = player_2;
-    new_game->current_player = player_1;
+    // Initialize the game (under its lock: a stale reader may still lock a recycled game)
+    pthread_mutex_lock(&new_game->lock);
+    new_game->handle = handle;
+    new_game->player1 = player_1->handle;
+    new_game->board_size = board_size;
+    new_game->kernel = kernel;
+    setup_initial_board(new_game->board, board_size);
+    init_board_bits(new_game);
+    new_game->player2 = player_2->handle;
+    new_game->current_player = player_1->handle;
     new_game->game_status = GAME_PLAYING;
-    new_game->winner = NULL;
+    new_game->winner = NULL_HANDLE;
+    snapshot_new_game(new_game, player_1, player_2);
+    journal_seat(new_game, 0, 0, player_1->username, player_1->username_len);
+    journal_seat(new_game, 1, 0, player_2->username, player_2->username_len);
+    pthread_mutex_unlock(&new_game->lock);
 
     // Add the game to the list of g_gamesArr
-    for (int i = 0; i < MAX_GAMES; i++) {
-        if (g_gamesArr[i] == NULL) {
-            g_gamesArr[i] = new_game;
-            break;
-        }
-    }
+    new_game->slot = g_activeGames;
+    g_gamesArr[new_game->slot] = new_game;
+    __atomic_store_n(&g_activeGames, g_activeGames + 1, __ATOMIC_RELAXED);
+
     pthread_mutex_unlock(&g_gamesMutex);
 
     return new_game;
 }
 
-game *locate_game_for_client(client *cl) {
+game *restore_game_session(int board_size, const bitboard discs[2]) {
     pthread_mutex_lock(&g_gamesMutex);
-    game *result = NULL;
-    for (int i = 0; i < MAX_GAMES; i++) {
-        if (g_gamesArr[i] != NULL && (g_gamesArr[i]->player1 == cl || g_gamesArr[i]->player2 == cl)) {
-            result = g_gamesArr[i];
-            break;
-        }
+    if (g_activeGames >= games_capacity) {
+        pthread_mutex_unlock(&g_gamesMutex);
+        return NULL;
     }
+
+    game_handle handle;
+    game *restored = slab_alloc(&g_gamePool, &handle);
+
+    // Nobody moves until both seats are claimed again
+    pthread_mutex_lock(&restored->lock);
+    restored->handle = handle;
+    restored->board_size = board_size;
+    restored->kernel = get_rules_kernel(board_size);
+    restored->discs[0] = discs[0];
+    restored->discs[1] = discs[1];
+    init_board_chars(restored);
+    init_legal_moves(restored);
+    restored->player1 = NULL_HANDLE;
+    restored->player2 = NULL_HANDLE;
+    restored->current_player = NULL_HANDLE;
+    restored->game_status = GAME_PLAYING;
+    restored->winner = NULL_HANDLE;
+    pthread_mutex_unlock(&restored->lock);
+
+    restored->slot = g_activeGames;
+    g_gamesArr[restored->slot] = restored;
+    __atomic_store_n(&g_activeGames, g_activeGames + 1, __ATOMIC_RELAXED);
+
     pthread_mutex_unlock(&g_gamesMutex);
+    return restored;
+}
+
+game *lock_client_game(client *cl) {
+    game_handle handle = __atomic_load_n(&cl->hot->current_game, __ATOMIC_ACQUIRE);
+    while (handle != NULL_HANDLE) {
+        game *g = slab_resolve(&g_gamePool, handle);
+        if (g == NULL) {
+            // Stale handle: the game has already been removed
+            return NULL;
+        }
+        pthread_mutex_lock(&g->lock);
+
+        // The game may have been removed (or recycled) while we were waiting for the lock
+        game_handle current = __atomic_load_n(&cl->hot->current_game, __ATOMIC_ACQUIRE);
+        if (current == handle && g->handle == handle) {
+            return g;
+        }
+        pthread_mutex_unlock(&g->lock);
+        if (current == handle) {
+            return NULL;
+        }
+        handle = current;
+    }
+    return NULL;
+}
 
-    return result;
+void unlock_game(game *g) {
+    pthread_mutex_unlock(&g->lock);
 }
 
-game *fetch_game_by_id(int id) {
-    pthread_mutex_lock(&g_gamesMutex);
-    game *result = NULL;
-    for (int i = 0; i < MAX_GAMES; i++) {
-        if (g_gamesArr[i] != NULL && g_gamesArr[i]->id == id) {
-            result = g_gamesArr[i];
-            break;
+void finish_client_game(client *cl) {
+    game *g = lock_client_game(cl);
+    if (g != NULL) {
+        if (g->game_status == GAME_PLAYING) {
+            journal_end(g, cl);
         }
+        g->game_status = GAME_OVER;
+        snapshot_game_over(g);
+        unlock_game(g);
     }
-    pthread_mutex_unlock(&g_gamesMutex);
+}
 
-    return result;
+game *resolve_game(game_handle handle) {
+    return slab_resolve(&g_gamePool, handle);
 }
 
-void setup_initial_board(char board[BOARD_SIZE][BOARD_SIZE]) {
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
+void setup_initial_board(char board[MAX_BOARD_SIZE][MAX_BOARD_SIZE], int board_size) {
+    for (int i = 0; i < board_size; i++) {
+        for (int j = 0; j < board_size; j++) {
             board[i][j] = ' ';
         }
     }
-    int mid = BOARD_SIZE / 2;
+    int mid = board_size / 2;
     board[mid - 1][mid - 1] = FIRST_PL_CHAR;
     board[mid - 1][mid] = SECOND_PL_CHAR;
     board[mid][mid - 1] = SECOND_PL_CHAR;
     board[mid][mid] = FIRST_PL_CHAR;
 }
 
-void display_active_games() {
+void display_active_games(FILE *out) {
     pthread_mutex_lock(&g_gamesMutex);
-    printf("Games: \n");
-    for (int i = 0; i < MAX_GAMES; i++) {
-        if (g_gamesArr[i] != NULL) {
-            printf("    Game: %d; Player 1: %d; Player 2: %d\n", g_gamesArr[i]->id, g_gamesArr[i]->player1->id,
-                   g_gamesArr[i]->player2->id);
-        }
+    fprintf(out, "Games: \n");
+    for (int i = 0; i < g_activeGames; i++) {
+        fprintf(out, "    Game: %d; Player 1: %d; Player 2: %d\n", handle_slot(g_gamesArr[i]->handle),
+                handle_slot(g_gamesArr[i]->player1), handle_slot(g_gamesArr[i]->player2));
     }
     pthread_mutex_unlock(&g_gamesMutex);
 }
 
+/**
+ * @brief Removes a game from g_gamesArr and returns it to the pool.
+ * @param g The game, locked by the caller under g_gamesMutex; its lock is released
+ * @param handle The game's handle
+ */
+static void remove_locked_game(game *g, game_handle handle) {
+    // Keep g_gamesArr dense: move the last game into the freed slot
+    game *last = g_gamesArr[g_activeGames - 1];
+    g_gamesArr[g->slot] = last;
+    last->slot = g->slot;
+    g_gamesArr[g_activeGames - 1] = NULL;
+    __atomic_store_n(&g_activeGames, g_activeGames - 1, __ATOMIC_RELAXED);
+
+    // Return the game to the pool; every handle to it becomes stale
+    g->handle = NULL_HANDLE;
+    slab_free(&g_gamePool, handle);
+    pthread_mutex_unlock(&g->lock);
+}
+
 int purge_finished_game(client *cl) {
     pthread_mutex_lock(&g_gamesMutex);
 
-    for (int i = 0; i < MAX_GAMES; i++) {
-        if (g_gamesArr[i] != NULL && g_gamesArr[i]->id == cl->active_game_id &&
-            g_gamesArr[i]->game_status == GAME_OVER) {
-            free(g_gamesArr[i]);
-            g_gamesArr[i] = NULL;
-            pthread_mutex_unlock(&g_gamesMutex);
-            display_active_games();
-            return TRUE;
-        }
+    game_handle handle = __atomic_load_n(&cl->hot->current_game, __ATOMIC_ACQUIRE);
+    game *g = slab_resolve(&g_gamePool, handle);
+    if (g == NULL) {
+        pthread_mutex_unlock(&g_gamesMutex);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    if (g->handle != handle || g->game_status != GAME_OVER) {
+        pthread_mutex_unlock(&g->lock);
+        pthread_mutex_unlock(&g_gamesMutex);
+        return FALSE;
+    }
+    remove_locked_game(g, handle);
+
+    pthread_mutex_unlock(&g_gamesMutex);
+    return TRUE;
+}
+
+int abandon_game(game_handle handle) {
+    pthread_mutex_lock(&g_gamesMutex);
+
+    game *g = slab_resolve(&g_gamePool, handle);
+    if (g == NULL) {
+        pthread_mutex_unlock(&g_gamesMutex);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    if (g->handle != handle) {
+        pthread_mutex_unlock(&g->lock);
+        pthread_mutex_unlock(&g_gamesMutex);
+        return FALSE;
+    }
+    if (g->game_status == GAME_PLAYING) {
+        journal_end(g, NULL);
     }
+    g->game_status = GAME_OVER;
+    snapshot_game_over(g);
+    remove_locked_game(g, handle);
 
     pthread_mutex_unlock(&g_gamesMutex);
-    return FALSE;
+    return TRUE;
 }
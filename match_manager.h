@@ -7,44 +7,100 @@
 #define __MATCH_MANAGER_H__
 
 #include "def_n_struct.h"
+#include <stdio.h>
 #include <pthread.h>
 
 /**
  * A global mutex used to protect access to the `g_gamesArr` array.
+ * Taken only when a game is created or removed; moves use the lock of their game.
+ * Lock order: g_gamesMutex before game::lock.
  */
 extern pthread_mutex_t g_gamesMutex;
 
+/**
+ * Dense array of the running games; entries [0, count_games()) are used.
+ */
+extern game **g_gamesArr;
+
+/**
+ * Capacity of the game tables.
+ */
+extern int games_capacity;
+
+/**
+ * Allocates the game tables (dense game array and game pool); call once at startup.
+ *
+ * @param max_games Maximum number of simultaneous games
+ * @return TRUE on success, FALSE if the tables could not be allocated
+ */
+int init_game_registry(int max_games);
+
+/**
+ * Returns the number of running games (constant time).
+ *
+ * @return The number of games in g_gamesArr
+ */
+int count_games();
+
 /**
  * Creates a new Reversi game between two clients.
  *
  * @param player_1 The first participant in the new game
  * @param player_2 The second participant in the new game
+ * @param board_size Width and height of the board; selects the rules kernel of the game
  * @return Pointer to the newly created game structure, or NULL if creation fails
  */
-game *initiate_game_session(client *player_1, client *player_2);
+game *initiate_game_session(client *player_1, client *player_2, int board_size);
+
+/**
+ * Creates a game again from its snapshot, without players: the seats are taken by the
+ * players as they log in (see claim_restored_seat), and nobody is on turn until both are.
+ *
+ * @param board_size Width and height of the board (a size with a rules kernel)
+ * @param discs Discs of the first and second player
+ * @return Pointer to the restored game, or NULL if the game tables are full
+ */
+game *restore_game_session(int board_size, const bitboard discs[2]);
+
+/**
+ * Locks and returns the game in which the specified client is currently participating.
+ * Only this game's lock is taken, so moves in different games run in parallel.
+ *
+ * @param cl Pointer to a client structure
+ * @return Pointer to the locked game (release it with unlock_game), or NULL if the client has no game
+ */
+game *lock_client_game(client *cl);
+
+/**
+ * Releases a game locked by lock_client_game.
+ *
+ * @param g The locked game
+ */
+void unlock_game(game *g);
 
 /**
- * Searches for the game in which the specified client is currently participating.
+ * Marks the client's game (if any) as finished so that it can be purged.
  *
  * @param cl Pointer to a client structure
- * @return Pointer to the corresponding game, or NULL if none is found
  */
-game *locate_game_for_client(client *cl);
+void finish_client_game(client *cl);
 
 /**
- * Locates a game by its unique identifier.
+ * Returns the game a handle refers to, without locking it (constant time).
+ * Use lock_client_game before touching its state.
  *
- * @param id Integer representing the game's ID
- * @return Pointer to the game if found, or NULL otherwise
+ * @param handle The game's handle
+ * @return Pointer to the game, or NULL if the handle is stale or NULL_HANDLE
  */
-game *fetch_game_by_id(int id);
+game *resolve_game(game_handle handle);
 
 /**
  * Initializes the game board by filling in default Reversi starting positions.
  *
- * @param board A 2D array (BOARD_SIZE x BOARD_SIZE) representing the game board
+ * @param board A 2D array representing the game board (only board_size x board_size is used)
+ * @param board_size Width and height of the board
  */
-void setup_initial_board(char board[BOARD_SIZE][BOARD_SIZE]);
+void setup_initial_board(char board[MAX_BOARD_SIZE][MAX_BOARD_SIZE], int board_size);
 
 /**
  * Removes a game from the global array if it is marked as finished by the specified client.
@@ -55,8 +111,18 @@ void setup_initial_board(char board[BOARD_SIZE][BOARD_SIZE]);
 int purge_finished_game(client *cl);
 
 /**
- * Prints the details of all active g_gamesArr to stdout.
+ * Ends and removes a game nobody plays, e.g. a restored game whose players did not come back.
+ *
+ * @param handle The game's handle
+ * @return TRUE if the game was removed, FALSE if the handle was stale
+ */
+int abandon_game(game_handle handle);
+
+/**
+ * Writes the details of all active games (takes g_gamesMutex while writing).
+ *
+ * @param out The stream to write to
  */
-void display_active_games();
+void display_active_games(FILE *out);
 
 #endif
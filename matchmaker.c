@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "matchmaker.h"
+#include "player_manager.h"
+#include "network_interface.h"
+#include "outbound.h"
+#include "server_metrics.h"
+
+typedef struct match_request match_request;
+
+/**
+ * A JOIN_GAME request; queued by a client thread, then kept by the matchmaker while the client waits.
+ */
+struct match_request {
+    client          *cl;        /**< The requesting client (referenced until the request is dropped). */
+    int             board_size; /**< Board size asked for. */
+    match_request   *next;      /**< Next node in the incoming queue or in a waiting list. */
+};
+
+/**
+ * Intrusive MPSC queue (Vyukov): producers swap themselves in at the head, the matchmaker
+ * consumes from the tail. g_queueStub keeps the queue non-empty so a push never touches the tail.
+ */
+static match_request g_queueStub = {NULL, 0, NULL};
+static match_request *g_queueHead = &g_queueStub;
+static match_request *g_queueTail = &g_queueStub;
+
+/**
+ * Counts the pushed requests; the matchmaker sleeps on it when the queue is empty.
+ */
+static sem_t g_queueSignal;
+
+/**
+ * Clients waiting for an opponent, one FIFO per board size. Touched only by the matchmaker.
+ */
+static match_request *g_waitingHead[MAX_BOARD_SIZE + 1];
+static match_request *g_waitingTail[MAX_BOARD_SIZE + 1];
+
+/**
+ * @brief Appends a node to the incoming queue (wait-free, any thread).
+ * @param request The node
+ */
+static void queue_push(match_request *request) {
+    __atomic_store_n(&request->next, NULL, __ATOMIC_RELAXED);
+    match_request *prev = __atomic_exchange_n(&g_queueHead, request, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, request, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Takes the oldest node from the incoming queue (matchmaker thread only).
+ * @return The node, or NULL if the queue is empty or a push is still in progress
+ */
+static match_request *queue_pop() {
+    match_request *tail = g_queueTail;
+    match_request *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &g_queueStub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        g_queueTail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        g_queueTail = next;
+        return tail;
+    }
+
+    // tail is the last node; a producer may be linking a new one behind it
+    if (tail != __atomic_load_n(&g_queueHead, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    // Put the stub back behind the last node so that it can be taken out
+    queue_push(&g_queueStub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        g_queueTail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Drops a request and the reference it holds on its client.
+ * @param request The request
+ */
+static void drop_request(match_request *request) {
+    release_client(request->cl);
+    free(request);
+}
+
+/**
+ * @brief Checks whether a waiting client can still be paired.
+ * @param cl The waiting client
+ * @param board_size The board size it waits for
+ * @return TRUE if the client is registered, still asks for this size and has no game
+ */
+static int is_still_waiting(client *cl, int board_size) {
+    return __atomic_load_n(&cl->is_detached, __ATOMIC_ACQUIRE) == FALSE &&
+           cl->hot->is_requesting_game == TRUE &&
+           cl->hot->current_game == NULL_HANDLE &&
+           cl->hot->requested_board_size == board_size;
+}
+
+/**
+ * @brief Appends a request to the waiting list of its board size.
+ * @param request The request
+ */
+static void add_waiting(match_request *request) {
+    int size = request->board_size;
+    request->next = NULL;
+    if (g_waitingTail[size] == NULL) {
+        g_waitingHead[size] = request;
+    } else {
+        g_waitingTail[size]->next = request;
+    }
+    g_waitingTail[size] = request;
+}
+
+/**
+ * @brief Removes and returns the oldest waiting request of a board size that can still be paired.
+ *        Requests of clients that left or changed their mind are dropped on the way.
+ * @param board_size The board size
+ * @return The request, or NULL if nobody waits
+ */
+static match_request *take_waiting(int board_size) {
+    while (g_waitingHead[board_size] != NULL) {
+        match_request *head = g_waitingHead[board_size];
+        g_waitingHead[board_size] = head->next;
+        if (g_waitingHead[board_size] == NULL) {
+            g_waitingTail[board_size] = NULL;
+        }
+
+        if (is_still_waiting(head->cl, board_size)) {
+            return head;
+        }
+        drop_request(head);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Puts a request back at the front of its waiting list.
+ * @param request The request
+ */
+static void return_waiting(match_request *request) {
+    int size = request->board_size;
+    request->next = g_waitingHead[size];
+    g_waitingHead[size] = request;
+    if (g_waitingTail[size] == NULL) {
+        g_waitingTail[size] = request;
+    }
+}
+
+/**
+ * @brief Pairs a new request with the oldest waiting client or makes it wait.
+ * @param request The request taken from the incoming queue
+ */
+static void handle_request(match_request *request) {
+    client *cl = request->cl;
+
+    if (!is_still_waiting(cl, request->board_size)) {
+        drop_request(request);
+        return;
+    }
+
+    match_request *partner = take_waiting(request->board_size);
+    if (partner != NULL && partner->cl == cl) {
+        // The client is already waiting (a session with the same name was removed at LOGIN)
+        return_waiting(partner);
+        partner = NULL;
+    }
+
+    if (partner == NULL) {
+        add_waiting(request);
+        announce_match_result(cl, FALSE);
+        return;
+    }
+
+    if (!start_match(partner->cl, cl)) {
+        // No free game slot; both keep waiting
+        return_waiting(partner);
+        add_waiting(request);
+        announce_match_result(cl, FALSE);
+        return;
+    }
+
+    announce_match_result(cl, TRUE);
+    drop_request(partner);
+    drop_request(request);
+}
+
+/**
+ * @brief Matchmaking thread: handles requests in arrival order.
+ * @param arg Unused
+ * @return A void pointer (unused)
+ */
+static void *matchmaker_main(void *arg) {
+    (void) arg;
+
+    for (;;) {
+        if (sem_wait(&g_queueSignal) == -1 && errno == EINTR) {
+            continue;
+        }
+
+        // JOIN_GAME and START_GAME of one pairing leave together
+        begin_output_batch();
+        match_request *request;
+        while ((request = queue_pop()) != NULL) {
+            count_metric(METRIC_MATCH_TAKEN, 1);
+            handle_request(request);
+        }
+        end_output_batch();
+    }
+    return NULL;
+}
+
+int start_matchmaker() {
+    if (sem_init(&g_queueSignal, 0, 0) == -1) {
+        perror("Failed to initialize the matchmaking queue");
+        return FALSE;
+    }
+
+    pthread_t thMatchmaker;
+    if (pthread_create(&thMatchmaker, NULL, matchmaker_main, NULL) != 0) {
+        perror("Could not start the matchmaking thread");
+        return FALSE;
+    }
+    pthread_detach(thMatchmaker);
+    return TRUE;
+}
+
+int submit_match_request(client *cl) {
+    match_request *request = malloc(sizeof(match_request));
+    if (request == NULL) {
+        perror("Failed to allocate memory for match request");
+        return FALSE;
+    }
+
+    retain_client(cl);
+    request->cl = cl;
+    request->board_size = cl->hot->requested_board_size;
+
+    count_metric(METRIC_MATCH_SUBMITTED, 1);
+    queue_push(request);
+    sem_post(&g_queueSignal);
+    return TRUE;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file matchmaker.h
+ * @brief Declares the matchmaking thread that pairs JOIN_GAME requests of thread-mode clients.
+ */
+
+#ifndef __MATCHMAKER_H__
+#define __MATCHMAKER_H__
+
+#include "def_n_struct.h"
+
+/**
+ * Starts the matchmaking thread. Client threads hand their JOIN_GAME requests to it through
+ * a lock-free multi-producer queue; the matchmaker alone keeps the waiting clients (a FIFO
+ * per board size), creates the games and sends JOIN_GAME/START_GAME without holding any
+ * client lock.
+ *
+ * @return TRUE if the thread was started, FALSE otherwise
+ */
+int start_matchmaker();
+
+/**
+ * Queues a JOIN_GAME request for the matchmaker. Never blocks; the client is answered by
+ * the matchmaking thread. The matchmaker holds a reference to the client until the request
+ * has been handled, so the client may be detached meanwhile.
+ *
+ * @param cl The requesting client (its requested_board_size must be set)
+ * @return TRUE if the request was queued, FALSE if it could not be allocated
+ */
+int submit_match_request(client *cl);
+
+#endif
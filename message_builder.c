@@ -0,0 +1,253 @@
+#include <string.h>
+
+#include "message_builder.h"
+
+void init_message(message_buffer *msg, int protocol) {
+    msg->len = 0;
+    msg->protocol = protocol;
+}
+
+void append_bytes(message_buffer *msg, const char *bytes, size_t len) {
+    memcpy(msg->data + msg->len, bytes, len);
+    msg->len += len;
+}
+
+void append_char(message_buffer *msg, char c) {
+    msg->data[msg->len++] = c;
+}
+
+/**
+ * @brief Starts a message: the command name in text, the frame header and opcode in binary.
+ * @param msg The message (its protocol is kept)
+ * @param name The command name
+ * @param name_len Length of the command name
+ * @param opcode The binary opcode
+ */
+static void begin_message(message_buffer *msg, const char *name, size_t name_len, unsigned char opcode) {
+    msg->len = 0;
+    if (msg->protocol == PROTOCOL_BINARY) {
+        msg->len = BIN_HEADER_SIZE;
+        append_char(msg, (char) opcode);
+    } else {
+        append_bytes(msg, name, name_len);
+    }
+}
+
+/**
+ * @brief begin_message with the command name given as a literal.
+ */
+#define begin_literal(msg, name, opcode) begin_message((msg), (name), sizeof(name) - 1, (opcode))
+
+/**
+ * @brief Appends a number: one byte in binary, a delimited decimal in text.
+ * @param msg The message
+ * @param value The value, 0 to 255
+ */
+static void put_number(message_buffer *msg, int value) {
+    if (msg->protocol == PROTOCOL_BINARY) {
+        append_char(msg, (char) value);
+        return;
+    }
+
+    append_char(msg, MESS_DELIMITER[0]);
+    if (value >= 100) {
+        append_char(msg, (char) ('0' + value / 100));
+    }
+    if (value >= 10) {
+        append_char(msg, (char) ('0' + value / 10 % 10));
+    }
+    append_char(msg, (char) ('0' + value % 10));
+}
+
+/**
+ * @brief Appends a character field (a color): the character itself in both encodings.
+ * @param msg The message
+ * @param c The character
+ */
+static void put_char(message_buffer *msg, char c) {
+    if (msg->protocol != PROTOCOL_BINARY) {
+        append_char(msg, MESS_DELIMITER[0]);
+    }
+    append_char(msg, c);
+}
+
+/**
+ * @brief Appends a name: length-prefixed in binary, delimited in text.
+ * @param msg The message
+ * @param name The name
+ * @param len Length of the name
+ */
+static void put_name(message_buffer *msg, const char *name, size_t len) {
+    append_char(msg, msg->protocol == PROTOCOL_BINARY ? (char) len : MESS_DELIMITER[0]);
+    append_bytes(msg, name, len);
+}
+
+/**
+ * @brief Ends a message: the terminator in text, the body length in the binary header.
+ * @param msg The message
+ */
+static void end_message(message_buffer *msg) {
+    if (msg->protocol == PROTOCOL_BINARY) {
+        size_t body = msg->len - BIN_HEADER_SIZE;
+        msg->data[0] = (char) (body >> 8);
+        msg->data[1] = (char) (body & 0xff);
+    } else {
+        append_char(msg, MESS_END_CHAR[0]);
+    }
+}
+
+/**
+ * Binary code of every board character (anything but the two player characters is empty).
+ */
+static const unsigned char g_cellCodes[256] = {
+    [(unsigned char) FIRST_PL_CHAR] = BIN_CELL_FIRST,
+    [(unsigned char) SECOND_PL_CHAR] = BIN_CELL_SECOND,
+};
+
+/**
+ * @brief Appends a board: the cells row by row in text, 2 bits per cell after the size in binary.
+ * @param msg The message
+ * @param g The game
+ */
+static void put_board(message_buffer *msg, const game *g) {
+    if (msg->protocol != PROTOCOL_BINARY) {
+        // One copy per row instead of one formatted call per cell
+        append_char(msg, MESS_DELIMITER[0]);
+        for (int row = 0; row < g->board_size; row++) {
+            append_bytes(msg, g->board[row], (size_t) g->board_size);
+        }
+        return;
+    }
+
+    append_char(msg, (char) g->board_size);
+    // Four cells per byte, filled in board order without dividing per cell
+    unsigned char *packed = (unsigned char *) msg->data + msg->len;
+    unsigned int current = 0;
+    int shift = 0;
+    for (int row = 0; row < g->board_size; row++) {
+        for (int col = 0; col < g->board_size; col++) {
+            current |= (unsigned int) g_cellCodes[(unsigned char) g->board[row][col]] << shift;
+            shift += 2;
+            if (shift == 8) {
+                *packed++ = (unsigned char) current;
+                current = 0;
+                shift = 0;
+            }
+        }
+    }
+    if (shift != 0) {
+        *packed++ = (unsigned char) current;
+    }
+    msg->len = (size_t) ((char *) packed - msg->data);
+}
+
+/**
+ * @brief Appends a set of squares: their count, then the coordinates of each one.
+ * @param msg The message
+ * @param squares The squares (NULL for none)
+ */
+static void put_squares(message_buffer *msg, const legal_squares *squares) {
+    bitboard cells = squares != NULL ? squares->cells : 0;
+    put_number(msg, __builtin_popcountll((uint64_t) cells) + __builtin_popcountll((uint64_t) (cells >> 64)));
+    for (; cells != 0; cells &= cells - 1) {
+        uint64_t low = (uint64_t) cells;
+        int cell = low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (cells >> 64));
+        put_number(msg, cell % squares->board_size);
+        put_number(msg, cell / squares->board_size);
+    }
+}
+
+void build_login_reply(message_buffer *msg, const client *cl) {
+    // The handshake stays textual; the reply confirms the encoding used from now on
+    init_message(msg, PROTOCOL_TEXT);
+    append_literal(msg, "LOGIN;");
+    append_bytes(msg, cl->username, cl->username_len);
+    if (cl->protocol == PROTOCOL_BINARY) {
+        append_literal(msg, ";" BINARY_LOGIN_FIELD);
+    }
+    append_char(msg, MESS_END_CHAR[0]);
+}
+
+void build_join_game(message_buffer *msg, char color) {
+    begin_literal(msg, "JOIN_GAME", BIN_JOIN_GAME_RESP);
+    put_char(msg, color);
+    end_message(msg);
+}
+
+void build_start_game(message_buffer *msg, const client *opponent, int starts) {
+    begin_literal(msg, "START_GAME", BIN_START_GAME);
+    put_name(msg, opponent->username, (size_t) opponent->username_len);
+    put_char(msg, opponent->client_char);
+    put_number(msg, starts ? 1 : 0);
+    end_message(msg);
+}
+
+void build_move_result(message_buffer *msg, int status, int x, int y) {
+    begin_literal(msg, "MOVE", BIN_MOVE_RESP);
+    put_number(msg, status);
+    put_number(msg, status == TRUE ? x : 0);
+    put_number(msg, status == TRUE ? y : 0);
+    end_message(msg);
+}
+
+void build_opp_move(message_buffer *msg, int x, int y, const legal_squares *next_moves) {
+    begin_literal(msg, "OPP_MOVE", BIN_OPP_MOVE);
+    put_number(msg, x);
+    put_number(msg, y);
+    put_squares(msg, next_moves);
+    end_message(msg);
+}
+
+void build_pass(message_buffer *msg, const legal_squares *next_moves) {
+    begin_literal(msg, "PASS", BIN_PASS);
+    put_squares(msg, next_moves);
+    end_message(msg);
+}
+
+void build_game_status(message_buffer *msg, const client *winner) {
+    begin_literal(msg, "GAME_STATUS", BIN_GAME_STATUS);
+    if (msg->protocol == PROTOCOL_BINARY) {
+        put_number(msg, winner != NULL ? BIN_STATUS_WIN : BIN_STATUS_DRAW);
+        put_name(msg, winner != NULL ? winner->username : "", winner != NULL ? (size_t) winner->username_len : 0);
+    } else if (winner != NULL) {
+        put_name(msg, winner->username, (size_t) winner->username_len);
+    } else {
+        append_literal(msg, ";DRAW");
+    }
+    end_message(msg);
+}
+
+void build_opp_gone_status(message_buffer *msg) {
+    begin_literal(msg, "GAME_STATUS", BIN_GAME_STATUS);
+    if (msg->protocol == PROTOCOL_BINARY) {
+        put_number(msg, BIN_STATUS_OPP_GONE);
+        put_name(msg, "", 0);
+    } else {
+        append_literal(msg, ";OPP_DISCONNECTED");
+    }
+    end_message(msg);
+}
+
+void build_ping(message_buffer *msg) {
+    begin_literal(msg, "PING", BIN_PING);
+    end_message(msg);
+}
+
+void build_opp_disconnected(message_buffer *msg) {
+    begin_literal(msg, "OPP_DISCONNECTED", BIN_OPP_DISCONNECTED);
+    end_message(msg);
+}
+
+size_t build_reconnect_state(message_buffer *msg, const game *g, const client *on_turn, const client *opponent) {
+    begin_literal(msg, "RECONNECT", BIN_RECONNECT);
+    put_board(msg, g);
+    put_name(msg, on_turn->username, (size_t) on_turn->username_len);
+    put_name(msg, opponent->username, (size_t) opponent->username_len);
+    return msg->len;
+}
+
+void finish_reconnect(message_buffer *msg, size_t shared_len, char color) {
+    msg->len = shared_len;
+    put_char(msg, color);
+    end_message(msg);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file message_builder.h
+ * @brief Declares the builders of the messages the server sends.
+ *
+ * A message is assembled in a caller-provided buffer with its length tracked along the way,
+ * so nothing is formatted by printf or measured again by strlen before it is queued.
+ * Every builder writes the encoding the buffer was initialized for: a text line, or a binary
+ * frame with a length header, one-byte opcode and fields (see BINARY PROTOCOL in def_n_struct.h).
+ */
+
+#ifndef __MESSAGE_BUILDER_H__
+#define __MESSAGE_BUILDER_H__
+
+#include <stddef.h>
+#include "def_n_struct.h"
+
+/**
+ * Room for the longest message the server sends (RECONNECT or OPP_MOVE).
+ */
+#define MESSAGE_BUFFER_SIZE \
+    (RECONNECT_MESSAGE_SIZE > OPP_MOVE_MESSAGE_SIZE ? RECONNECT_MESSAGE_SIZE : OPP_MOVE_MESSAGE_SIZE)
+
+/**
+ * An outgoing message.
+ */
+typedef struct {
+    int     protocol;                       /**< PROTOCOL_TEXT or PROTOCOL_BINARY. */
+    size_t  len;                            /**< Number of bytes in data. */
+    char    data[MESSAGE_BUFFER_SIZE];      /**< The message, not NUL-terminated. */
+} message_buffer;
+
+/**
+ * Empties a message and selects its encoding; call before the first builder. A buffer can
+ * then be reused for any number of messages in the same encoding.
+ *
+ * @param msg The message
+ * @param protocol PROTOCOL_TEXT or PROTOCOL_BINARY (usually the recipient's client::protocol)
+ */
+void init_message(message_buffer *msg, int protocol);
+
+/**
+ * Appends bytes to a message. The builders below never exceed the buffer.
+ *
+ * @param msg The message
+ * @param bytes The bytes
+ * @param len Number of bytes
+ */
+void append_bytes(message_buffer *msg, const char *bytes, size_t len);
+
+/**
+ * Appends one character to a message.
+ *
+ * @param msg The message
+ * @param c The character
+ */
+void append_char(message_buffer *msg, char c);
+
+/**
+ * Appends a string literal to a message (its length is known at compile time).
+ */
+#define append_literal(msg, text) append_bytes((msg), (text), sizeof(text) - 1)
+
+/**
+ * Builds "LOGIN;<name>\n", or "LOGIN;<name>;BIN\n" for a binary client: the answer to a
+ * successful login, always in text. Initializes msg itself.
+ *
+ * @param msg Receives the message
+ * @param cl The client that logged in
+ */
+void build_login_reply(message_buffer *msg, const client *cl);
+
+/**
+ * Builds "JOIN_GAME;<color>\n".
+ *
+ * @param msg Receives the message
+ * @param color The color assigned to the client
+ */
+void build_join_game(message_buffer *msg, char color);
+
+/**
+ * Builds "START_GAME;<opponent name>;<opponent color>;<1 if the recipient starts, else 0>\n".
+ *
+ * @param msg Receives the message
+ * @param opponent The recipient's opponent
+ * @param starts TRUE if the recipient makes the first move
+ */
+void build_start_game(message_buffer *msg, const client *opponent, int starts);
+
+/**
+ * Builds "MOVE;<status>;<x>;<y>\n" (x and y are 0 for a rejected move).
+ *
+ * @param msg Receives the message
+ * @param status TRUE if the move was accepted, otherwise the rejection reason
+ * @param x The x-coordinate of the move
+ * @param y The y-coordinate of the move
+ */
+void build_move_result(message_buffer *msg, int status, int x, int y);
+
+/**
+ * Builds "OPP_MOVE;<x>;<y>;<count>;<x1>;<y1>;...;<xn>;<yn>\n": the opponent's move, then the
+ * squares the recipient may now play (rows first), so a client needs no rules of its own.
+ *
+ * @param msg Receives the message
+ * @param x The x-coordinate of the opponent's move
+ * @param y The y-coordinate of the opponent's move
+ * @param next_moves The legal targets of the recipient, or NULL if it has none (it passes)
+ */
+void build_opp_move(message_buffer *msg, int x, int y, const legal_squares *next_moves);
+
+/**
+ * Builds "PASS;<count>;<x1>;<y1>;...;<xn>;<yn>\n", sent to both players when the player on turn
+ * has no legal move. The player that passes gets no squares; the other one moves again and
+ * gets the squares it may play.
+ *
+ * @param msg Receives the message
+ * @param next_moves The legal targets of the recipient, or NULL for the player that passes
+ */
+void build_pass(message_buffer *msg, const legal_squares *next_moves);
+
+/**
+ * Builds "GAME_STATUS;<winner name>\n", or "GAME_STATUS;DRAW\n" without a winner.
+ *
+ * @param msg Receives the message
+ * @param winner The winning client, or NULL for a draw
+ */
+void build_game_status(message_buffer *msg, const client *winner);
+
+/**
+ * Builds "GAME_STATUS;OPP_DISCONNECTED\n", sent when the opponent never came back.
+ *
+ * @param msg Receives the message
+ */
+void build_opp_gone_status(message_buffer *msg);
+
+/**
+ * Builds "PING\n".
+ *
+ * @param msg Receives the message
+ */
+void build_ping(message_buffer *msg);
+
+/**
+ * Builds "OPP_DISCONNECTED\n", sent when the opponent stopped answering.
+ *
+ * @param msg Receives the message
+ */
+void build_opp_disconnected(message_buffer *msg);
+
+/**
+ * Builds the part of "RECONNECT;<board>;<player on turn>;<opponent name>;<color>\n" that both
+ * players receive, i.e. everything before the color (in binary the board is packed to 2 bits
+ * per cell). Finish it with finish_reconnect.
+ *
+ * @param msg Receives the shared part
+ * @param g The game (locked by the caller)
+ * @param on_turn The player on turn
+ * @param opponent The opponent of the client that reconnects
+ * @return Length of the shared part
+ */
+size_t build_reconnect_state(message_buffer *msg, const game *g, const client *on_turn, const client *opponent);
+
+/**
+ * Completes a RECONNECT message for one recipient: cuts the message back to the shared part
+ * and appends the color and the terminator (the frame length in binary).
+ *
+ * @param msg The message built by build_reconnect_state
+ * @param shared_len The length returned by build_reconnect_state
+ * @param color The color of the recipient's opponent
+ */
+void finish_reconnect(message_buffer *msg, size_t shared_len, char color);
+
+#endif
@@ -0,0 +1,215 @@
+#include <string.h>
+
+#include "message_parser.h"
+
+/**
+ * @brief Cursor over the fields of a message, split on MESS_DELIMITER.
+ */
+typedef struct {
+    const char  *pos;   /**< Start of the next field. */
+    const char  *end;   /**< One past the last byte of the message. */
+    int         done;   /**< Set once the last field has been returned. */
+} field_cursor;
+
+/**
+ * @brief Returns the next field of the message.
+ * @param cursor The cursor
+ * @param field Receives the field (may be empty)
+ * @return TRUE if a field was returned, FALSE if the message has no more fields
+ */
+static int next_field(field_cursor *cursor, text_view *field) {
+    if (cursor->done) {
+        return FALSE;
+    }
+
+    const char *delimiter = memchr(cursor->pos, MESS_DELIMITER[0], (size_t) (cursor->end - cursor->pos));
+    field->ptr = cursor->pos;
+    if (delimiter == NULL) {
+        field->len = (size_t) (cursor->end - cursor->pos);
+        cursor->done = TRUE;
+    } else {
+        field->len = (size_t) (delimiter - cursor->pos);
+        cursor->pos = delimiter + 1;
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Parses a field made only of decimal digits.
+ * @param field The field
+ * @param max_value Largest accepted value
+ * @param value Receives the number
+ * @return TRUE if the field is a number in 0..max_value, FALSE otherwise
+ */
+static int parse_number(text_view field, int max_value, int *value) {
+    if (field.len == 0) {
+        return FALSE;
+    }
+
+    int number = 0;
+    for (size_t i = 0; i < field.len; i++) {
+        unsigned int digit = (unsigned char) field.ptr[i] - '0';
+        if (digit > 9) {
+            return FALSE;
+        }
+        number = number * 10 + (int) digit;
+        if (number > max_value) {
+            return FALSE;
+        }
+    }
+
+    *value = number;
+    return TRUE;
+}
+
+/**
+ * @brief Checks that a view holds exactly the given keyword.
+ */
+static int view_equals(text_view view, const char *keyword, size_t keyword_len) {
+    return view.len == keyword_len && memcmp(view.ptr, keyword, keyword_len) == 0;
+}
+
+/**
+ * @brief Maps a command name to its type: the length and first byte select a single
+ *        candidate, which is then confirmed with one comparison.
+ * @param name The first field of the message
+ * @return The command, or CMD_INVALID
+ */
+static command_type lookup_command(text_view name) {
+    switch (name.len) {
+        case 4:
+            if (name.ptr[0] == 'M') {
+                return view_equals(name, "MOVE", 4) ? CMD_MOVE : CMD_INVALID;
+            }
+            return view_equals(name, "PONG", 4) ? CMD_PONG : CMD_INVALID;
+        case 5:
+            return view_equals(name, "LOGIN", 5) ? CMD_LOGIN : CMD_INVALID;
+        case 6:
+            return view_equals(name, "LOGOUT", 6) ? CMD_LOGOUT : CMD_INVALID;
+        case 9:
+            return view_equals(name, "JOIN_GAME", 9) ? CMD_JOIN_GAME : CMD_INVALID;
+        case 10:
+            return view_equals(name, "WAIT_REPLY", 10) ? CMD_WAIT_REPLY : CMD_INVALID;
+        default:
+            return CMD_INVALID;
+    }
+}
+
+int parse_message(const char *message, size_t length, parsed_message *result) {
+    field_cursor cursor = {message, message + length, FALSE};
+    text_view name, field;
+
+    result->command = CMD_INVALID;
+    if (!next_field(&cursor, &name)) {
+        return FALSE;
+    }
+
+    command_type command = lookup_command(name);
+    switch (command) {
+        case CMD_LOGIN:
+            if (!next_field(&cursor, &field) || field.len == 0) {
+                return FALSE;
+            }
+            result->username = field;
+            // An optional third field asks for the binary encoding after the handshake
+            result->protocol = PROTOCOL_TEXT;
+            if (next_field(&cursor, &field) && view_equals(field, BINARY_LOGIN_FIELD, sizeof(BINARY_LOGIN_FIELD) - 1)) {
+                result->protocol = PROTOCOL_BINARY;
+            }
+            break;
+
+        case CMD_MOVE:
+            if (!next_field(&cursor, &field) || !parse_number(field, MOVE_COORD_MAX, &result->x) ||
+                !next_field(&cursor, &field) || !parse_number(field, MOVE_COORD_MAX, &result->y)) {
+                return FALSE;
+            }
+            break;
+
+        case CMD_JOIN_GAME:
+            // The board size is optional
+            result->board_size = DEFAULT_BOARD_SIZE;
+            if (next_field(&cursor, &field) && field.len > 0 &&
+                !parse_number(field, MAX_BOARD_SIZE, &result->board_size)) {
+                return FALSE;
+            }
+            break;
+
+        case CMD_WAIT_REPLY:
+            if (!next_field(&cursor, &field) || field.len == 0) {
+                return FALSE;
+            }
+            result->wait = field.len >= 4 && memcmp(field.ptr, "WAIT", 4) == 0;
+            break;
+
+        case CMD_LOGOUT:
+        case CMD_PONG:
+            break;
+
+        default:
+            return FALSE;
+    }
+
+    result->command = command;
+    return TRUE;
+}
+
+int parse_binary_message(const char *frame, size_t length, parsed_message *result) {
+    const unsigned char *bytes = (const unsigned char *) frame;
+    command_type command = CMD_INVALID;
+
+    result->command = CMD_INVALID;
+    if (length == 0) {
+        return FALSE;
+    }
+
+    switch (bytes[0]) {
+        case BIN_MOVE:
+            if (length < 3) {
+                return FALSE;
+            }
+            result->x = bytes[1];
+            result->y = bytes[2];
+            command = CMD_MOVE;
+            break;
+
+        case BIN_JOIN_GAME:
+            // The board size is optional, as in text
+            result->board_size = DEFAULT_BOARD_SIZE;
+            if (length >= 2) {
+                if (bytes[1] > MAX_BOARD_SIZE) {
+                    return FALSE;
+                }
+                result->board_size = bytes[1];
+            }
+            command = CMD_JOIN_GAME;
+            break;
+
+        case BIN_WAIT_REPLY:
+            if (length < 2) {
+                return FALSE;
+            }
+            result->wait = bytes[1] != 0;
+            command = CMD_WAIT_REPLY;
+            break;
+
+        case BIN_LOGOUT:
+            command = CMD_LOGOUT;
+            break;
+
+        case BIN_PONG:
+            command = CMD_PONG;
+            break;
+
+        default:
+            return FALSE;
+    }
+
+    result->command = command;
+    return TRUE;
+}
+
+void copy_view(text_view view, char *buffer, size_t size) {
+    size_t len = view.len < size - 1 ? view.len : size - 1;
+    memcpy(buffer, view.ptr, len);
+    buffer[len] = '\0';
+}
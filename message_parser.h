@@ -0,0 +1,85 @@
+/**
+ * @file message_parser.h
+ * @brief Declares the reentrant single-pass parsers of client protocol messages, text lines
+ *        and binary frames alike.
+ */
+
+#ifndef __MESSAGE_PARSER_H__
+#define __MESSAGE_PARSER_H__
+
+#include <stddef.h>
+#include "def_n_struct.h"
+
+/**
+ * Client commands recognized by parse_message and parse_binary_message.
+ */
+typedef enum {
+    CMD_INVALID = 0,    /**< Unknown command or malformed fields. */
+    CMD_LOGIN,          /**< LOGIN;<name>[;BIN] */
+    CMD_MOVE,           /**< MOVE;<x>;<y> */
+    CMD_JOIN_GAME,      /**< JOIN_GAME[;<board size>] */
+    CMD_LOGOUT,         /**< LOGOUT */
+    CMD_PONG,           /**< PONG */
+    CMD_WAIT_REPLY      /**< WAIT_REPLY;WAIT or WAIT_REPLY;NOT_WAIT */
+} command_type;
+
+/**
+ * Largest coordinate accepted in a MOVE; whether it lies on the board is up to the rules.
+ */
+#define MOVE_COORD_MAX          999
+
+/**
+ * A (pointer, length) view into a message; not NUL-terminated.
+ */
+typedef struct {
+    const char  *ptr;   /**< First byte of the field. */
+    size_t      len;    /**< Number of bytes in the field. */
+} text_view;
+
+/**
+ * Result of parsing one message. Views point into the parsed message.
+ */
+typedef struct {
+    command_type    command;    /**< The recognized command, CMD_INVALID if the message is malformed. */
+    text_view       username;   /**< CMD_LOGIN: the player's name (at least one byte). */
+    int             protocol;   /**< CMD_LOGIN: PROTOCOL_BINARY if the BIN field follows the name. */
+    int             x;          /**< CMD_MOVE: column, 0..MOVE_COORD_MAX. */
+    int             y;          /**< CMD_MOVE: row, 0..MOVE_COORD_MAX. */
+    int             board_size; /**< CMD_JOIN_GAME: requested size, or DEFAULT_BOARD_SIZE if omitted. */
+    int             wait;       /**< CMD_WAIT_REPLY: TRUE for WAIT, FALSE otherwise. */
+} parsed_message;
+
+/**
+ * Parses one message (without its MESS_END_CHAR) in a single pass. The input is not
+ * modified and no memory is allocated, so the parser may run on any thread. Fields after
+ * the ones a command needs are ignored, as are trailing delimiters.
+ *
+ * @param message First byte of the message
+ * @param length Number of bytes in the message
+ * @param result Receives the command and its fields
+ * @return TRUE if the message is a well-formed command, FALSE otherwise (result->command is CMD_INVALID)
+ */
+int parse_message(const char *message, size_t length, parsed_message *result);
+
+/**
+ * Parses one binary frame body (without its length header) into the same result as
+ * parse_message, so both encodings share the command handling. The opcodes are listed
+ * under BINARY PROTOCOL in def_n_struct.h; extra bytes after the fields are ignored.
+ *
+ * @param frame First byte of the frame body (the opcode)
+ * @param length Number of bytes in the body
+ * @param result Receives the command and its fields
+ * @return TRUE if the frame is a well-formed command, FALSE otherwise (result->command is CMD_INVALID)
+ */
+int parse_binary_message(const char *frame, size_t length, parsed_message *result);
+
+/**
+ * Copies a view into a NUL-terminated buffer, truncating it to the buffer size.
+ *
+ * @param view The view
+ * @param buffer Destination buffer
+ * @param size Size of the destination buffer (at least 1)
+ */
+void copy_view(text_view view, char *buffer, size_t size);
+
+#endif
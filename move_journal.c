@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "move_journal.h"
+
+/**
+ * An append buffer with its spare: the writer swaps them and writes the full one out
+ * while threads keep appending to the other.
+ */
+typedef struct {
+    pthread_mutex_t lock;           /**< Guards active, count and the swap. */
+    pthread_cond_t  drained;        /**< Signalled when the writer swapped a full buffer out. */
+    journal_record  *active;        /**< Buffer records are appended to. */
+    journal_record  *spare;         /**< Buffer owned by the writer between two flushes. */
+    int             count;          /**< Records in active. */
+} journal_stripe;
+
+/**
+ * Descriptor of the journal file, -1 without a journal.
+ */
+static int g_journalFd = -1;
+
+static journal_stripe g_stripes[JOURNAL_STRIPES];
+
+/**
+ * Wakes the writer before its next period when a buffer fills up.
+ */
+static pthread_mutex_t g_writerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_writerWake = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Stripe of the calling thread (-1 until its first record); threads take the stripes in turn.
+ */
+static __thread int t_stripe = -1;
+static int g_nextStripe = 0;
+
+/**
+ * @brief Returns the wall-clock time in microseconds.
+ */
+static uint64_t wall_clock_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Counts the discs on a game's board.
+ */
+static int count_discs(const game *g) {
+    bitboard all = g->discs[0] | g->discs[1];
+    return __builtin_popcountll((uint64_t) all) + __builtin_popcountll((uint64_t) (all >> 64));
+}
+
+/**
+ * @brief Fills the fields every record of a game shares.
+ */
+static void init_record(journal_record *record, int type, const game *g) {
+    memset(record, 0, sizeof(*record));
+    record->type = (uint8_t) type;
+    record->game = g->handle;
+    record->time_us = wall_clock_us();
+    record->board_size = (uint8_t) g->board_size;
+    record->ply = (uint8_t) count_discs(g);
+}
+
+/**
+ * @brief Copies a username into a record.
+ */
+static void set_record_name(journal_record *record, const char *name, int name_len) {
+    memcpy(record->name, name, (size_t) name_len);
+    record->name_len = (uint8_t) name_len;
+}
+
+/**
+ * @brief Appends a record to the calling thread's buffer, waiting for the writer if it is full.
+ */
+static void append_record(const journal_record *record) {
+    if (t_stripe < 0) {
+        t_stripe = __atomic_fetch_add(&g_nextStripe, 1, __ATOMIC_RELAXED) % JOURNAL_STRIPES;
+    }
+    journal_stripe *stripe = &g_stripes[t_stripe];
+
+    pthread_mutex_lock(&stripe->lock);
+    while (stripe->count == JOURNAL_BATCH) {
+        pthread_mutex_lock(&g_writerMutex);
+        pthread_cond_signal(&g_writerWake);
+        pthread_mutex_unlock(&g_writerMutex);
+        pthread_cond_wait(&stripe->drained, &stripe->lock);
+    }
+    stripe->active[stripe->count++] = *record;
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+/**
+ * @brief Writes a batch completely, retrying after partial writes.
+ * @return TRUE on success
+ */
+static int write_batch(struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(g_journalFd, iov, count);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= (size_t) written;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Group commit: every JOURNAL_FLUSH_MS (or as soon as a buffer fills) the buffers are
+ *        swapped out and written by one writev, and the file is synced every JOURNAL_SYNC_MS.
+ * @param arg Unused
+ * @return NULL (never returns)
+ */
+static void *run_journal_writer(void *arg) {
+    (void) arg;
+    struct timespec lastSync;
+    clock_gettime(CLOCK_MONOTONIC, &lastSync);
+    int unsynced = FALSE;
+
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += JOURNAL_FLUSH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&g_writerMutex);
+        pthread_cond_timedwait(&g_writerWake, &g_writerMutex, &deadline);
+        pthread_mutex_unlock(&g_writerMutex);
+
+        struct iovec iov[JOURNAL_STRIPES];
+        int batches = 0;
+        for (int i = 0; i < JOURNAL_STRIPES; i++) {
+            journal_stripe *stripe = &g_stripes[i];
+            pthread_mutex_lock(&stripe->lock);
+            if (stripe->count > 0) {
+                journal_record *full = stripe->active;
+                iov[batches].iov_base = full;
+                iov[batches].iov_len = (size_t) stripe->count * sizeof(journal_record);
+                batches++;
+                stripe->active = stripe->spare;
+                stripe->spare = full;
+                stripe->count = 0;
+                pthread_cond_broadcast(&stripe->drained);
+            }
+            pthread_mutex_unlock(&stripe->lock);
+        }
+
+        if (batches > 0) {
+            if (!write_batch(iov, batches)) {
+                perror("Failed to write the move journal");
+            }
+            unsynced = TRUE;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long sinceSync = (now.tv_sec - lastSync.tv_sec) * 1000LL + (now.tv_nsec - lastSync.tv_nsec) / 1000000;
+        if (unsynced && sinceSync >= JOURNAL_SYNC_MS) {
+            if (fdatasync(g_journalFd) == -1) {
+                perror("Failed to sync the move journal");
+            }
+            lastSync = now;
+            unsynced = FALSE;
+        }
+    }
+    return NULL;
+}
+
+int open_move_journal(const char *path) {
+    g_journalFd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (g_journalFd == -1) {
+        perror("Failed to open the move journal");
+        return FALSE;
+    }
+
+    for (int i = 0; i < JOURNAL_STRIPES; i++) {
+        journal_stripe *stripe = &g_stripes[i];
+        pthread_mutex_init(&stripe->lock, NULL);
+        pthread_cond_init(&stripe->drained, NULL);
+        stripe->active = malloc(JOURNAL_BATCH * sizeof(journal_record));
+        stripe->spare = malloc(JOURNAL_BATCH * sizeof(journal_record));
+        stripe->count = 0;
+        if (stripe->active == NULL || stripe->spare == NULL) {
+            perror("Failed to allocate the journal buffers");
+            return FALSE;
+        }
+    }
+
+    // The start of the run goes straight to the file, ahead of any buffered record
+    journal_record start;
+    memset(&start, 0, sizeof(start));
+    start.type = JOURNAL_OPEN;
+    start.time_us = wall_clock_us();
+    set_record_name(&start, JOURNAL_MAGIC, (int) strlen(JOURNAL_MAGIC));
+    struct iovec iov = {&start, sizeof(start)};
+    if (!write_batch(&iov, 1)) {
+        perror("Failed to write the move journal");
+        return FALSE;
+    }
+
+    pthread_t thWriter;
+    if (pthread_create(&thWriter, NULL, run_journal_writer, NULL) != 0) {
+        perror("Failed to launch the journal writer");
+        return FALSE;
+    }
+    pthread_detach(thWriter);
+    return TRUE;
+}
+
+void journal_seat(const game *g, int seat, int on_turn, const char *name, int name_len) {
+    if (g_journalFd == -1) {
+        return;
+    }
+    journal_record record;
+    init_record(&record, JOURNAL_SEAT, g);
+    record.discs[0] = g->discs[0];
+    record.discs[1] = g->discs[1];
+    record.seat = (uint8_t) seat;
+    record.x = (uint8_t) on_turn;
+    set_record_name(&record, name, name_len);
+    append_record(&record);
+}
+
+void journal_move(const game *g, const client *cl, int x, int y, bitboard flips) {
+    if (g_journalFd == -1) {
+        return;
+    }
+    journal_record record;
+    init_record(&record, JOURNAL_MOVE, g);
+    record.discs[0] = flips;
+    record.seat = cl->client_char == FIRST_PL_CHAR ? 0 : 1;
+    record.x = (uint8_t) x;
+    record.y = (uint8_t) y;
+    set_record_name(&record, cl->username, cl->username_len);
+    append_record(&record);
+}
+
+void journal_result(const game *g, int winner_seat) {
+    if (g_journalFd == -1) {
+        return;
+    }
+    journal_record record;
+    init_record(&record, JOURNAL_RESULT, g);
+    record.discs[0] = g->discs[0];
+    record.discs[1] = g->discs[1];
+    record.seat = (uint8_t) winner_seat;
+    append_record(&record);
+}
+
+void journal_end(const game *g, const client *cl) {
+    if (g_journalFd == -1) {
+        return;
+    }
+    journal_record record;
+    init_record(&record, JOURNAL_END, g);
+    record.seat = JOURNAL_NO_SEAT;
+    if (cl != NULL) {
+        record.seat = cl->client_char == FIRST_PL_CHAR ? 0 : 1;
+        set_record_name(&record, cl->username, cl->username_len);
+    }
+    append_record(&record);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file move_journal.h
+ * @brief Declares the move journal: an append-only file recording every game, move and
+ *        result for later audit (see tools/journal_replay.c).
+ *
+ * Records are fixed-size and are appended to in-memory buffers, one of JOURNAL_STRIPES picked
+ * per thread, so a move never waits for the disk. A writer thread empties all buffers every
+ * JOURNAL_FLUSH_MS with a single write and syncs the file every JOURNAL_SYNC_MS; a crash loses
+ * at most what was not synced yet. A thread whose buffer is full waits for the writer.
+ *
+ * Records of one game can reach the file out of order when its players are served by
+ * different threads; each record carries the number of discs on the board, which orders
+ * the records of a game.
+ */
+
+#ifndef __MOVE_JOURNAL_H__
+#define __MOVE_JOURNAL_H__
+
+#include <stdint.h>
+#include "def_n_struct.h"
+
+/**
+ * Record types.
+ */
+#define JOURNAL_OPEN            1   /**< The server started; game handles are unique until the next one. */
+#define JOURNAL_SEAT            2   /**< A player's seat in a new or restored game, with the position. */
+#define JOURNAL_MOVE            3   /**< A move and the discs it flipped. */
+#define JOURNAL_RESULT          4   /**< The game ended by the rules, with the final position. */
+#define JOURNAL_END             5   /**< The game was abandoned (disconnect, logout, restore expired). */
+
+/**
+ * Seat of a RESULT without a winner, or of an END nobody triggered.
+ */
+#define JOURNAL_NO_SEAT         2
+
+/**
+ * Written into the name of every JOURNAL_OPEN record.
+ */
+#define JOURNAL_MAGIC           "UPSJRNL1"
+
+/**
+ * One journal record (80 bytes, host byte order).
+ */
+typedef struct {
+    bitboard    discs[2];                   /**< SEAT, RESULT: the position; MOVE: [0] the flipped discs. */
+    uint64_t    game;                       /**< Handle of the game. */
+    uint64_t    time_us;                    /**< Wall-clock time in microseconds since the epoch. */
+    char        name[PLAYER_NAME_SIZE];     /**< SEAT, MOVE, END: username of the player (not NUL-terminated). */
+    uint8_t     name_len;                   /**< Length of name. */
+    uint8_t     type;                       /**< One of the record types above. */
+    uint8_t     seat;                       /**< Seat of the player (of the winner for RESULT), 0 or 1. */
+    uint8_t     x;                          /**< MOVE: x-coordinate; SEAT: seat on turn. */
+    uint8_t     y;                          /**< MOVE: y-coordinate. */
+    uint8_t     board_size;                 /**< Width and height of the board. */
+    uint8_t     ply;                        /**< Discs on the board before the record. */
+} journal_record;
+
+/**
+ * Opens (or creates) the journal for appending, records the start of this run and starts
+ * the writer thread; call once at startup, before the first game is created or restored.
+ *
+ * @param path The journal file
+ * @return TRUE on success, FALSE if the file could not be opened
+ */
+int open_move_journal(const char *path);
+
+/**
+ * Records a player's seat in a game that starts or is restored. No-op without a journal.
+ *
+ * @param g The game (locked by the caller)
+ * @param seat 0 for the first player, 1 for the second
+ * @param on_turn Seat that moves next
+ * @param name Username of the player
+ * @param name_len Length of the username
+ */
+void journal_seat(const game *g, int seat, int on_turn, const char *name, int name_len);
+
+/**
+ * Records a move. No-op without a journal.
+ *
+ * @param g The game (locked by the caller), before the move is applied
+ * @param cl The client who made the move
+ * @param x The x-coordinate
+ * @param y The y-coordinate
+ * @param flips The opponent discs the move flips
+ */
+void journal_move(const game *g, const client *cl, int x, int y, bitboard flips);
+
+/**
+ * Records the end of a game by the rules. No-op without a journal.
+ *
+ * @param g The game (locked by the caller)
+ * @param winner_seat Seat of the winner, or JOURNAL_NO_SEAT for a draw
+ */
+void journal_result(const game *g, int winner_seat);
+
+/**
+ * Records that a game was abandoned. No-op without a journal.
+ *
+ * @param g The game (locked by the caller)
+ * @param cl The client on whose behalf the game was ended (the one leaving, or the one left
+ *           behind), or NULL
+ */
+void journal_end(const game *g, const client *cl);
+
+#endif
@@ -1,11 +1,26 @@
 #include <stdio.h>
+#include <errno.h>
+#include <assert.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
 #include "network_interface.h"
 #include "player_manager.h"
 #include "rules_engine.h"
+#include "event_loop.h"
+#include "matchmaker.h"
+#include "message_parser.h"
+#include "outbound.h"
+#include "timer_wheel.h"
+#include "slab_pool.h"
+#include "message_builder.h"
+#include "game_snapshot.h"
+#include "server_metrics.h"
+#include "server_log.h"
 
 /**
  * A helper function that sends RECONNECT details if the client was in a game.
@@ -14,32 +29,29 @@
  * @param cl Pointer to the client
  */
 void reconnect_message(client *cl) {
-    game *theGame = locate_game_for_client(cl);
+    client *opponent = get_opponent(cl);
+    game *theGame = opponent != NULL ? lock_client_game(cl) : NULL;
 
     if (theGame == NULL) {
-        printf("Game not found\n");
+        log_warn("Game not found");
     } else {
-        // Rebuild the board state for both players
-        char response[RECONNECT_MESSAGE_SIZE] = {0};
-        sprintf(response, "RECONNECT;");
-
-        for (int row = 0; row < BOARD_SIZE; row++) {
-            for (int col = 0; col < BOARD_SIZE; col++) {
-                sprintf(response + strlen(response), "%c", theGame->board[row][col]);
-            }
+        // Rebuild the board state once per encoding; only the final color differs between the players
+        message_buffer response, oppResponse;
+        client *onTurn = theGame->current_player == cl->handle ? cl : opponent;
+        init_message(&response, cl->protocol);
+        size_t sharedLen = build_reconnect_state(&response, theGame, onTurn, opponent);
+        size_t oppSharedLen = sharedLen;
+        if (opponent->protocol != cl->protocol) {
+            init_message(&oppResponse, opponent->protocol);
+            oppSharedLen = build_reconnect_state(&oppResponse, theGame, onTurn, opponent);
         }
+        unlock_game(theGame);
 
-        sprintf(response + strlen(response), ";%s;%s;", theGame->current_player->username, cl->opponent->username);
-
-        char oppResponse[RECONNECT_MESSAGE_SIZE] = {0};
-        strcpy(oppResponse, response);
-
-        sprintf(response + strlen(response), "%c\n", cl->opponent->client_char);
-        sprintf(oppResponse + strlen(oppResponse), "%c\n", cl->client_char);
-
-        printf("Response: %s\n", response);
-        transmit_message(cl, response);
-        transmit_message(cl->opponent, oppResponse);
+        finish_reconnect(&response, sharedLen, opponent->client_char);
+        transmit_bytes(cl, response.data, response.len);
+        message_buffer *oppMsg = opponent->protocol != cl->protocol ? &oppResponse : &response;
+        finish_reconnect(oppMsg, oppSharedLen, cl->client_char);
+        transmit_bytes(opponent, oppMsg->data, oppMsg->len);
     }
 }
 
@@ -48,28 +60,42 @@ void reconnect_message(client *cl) {
  * and sends a response to the client if an opponent is found.
  *
  * @param cl Pointer to the client struct
+ * @return TRUE if the client's connection was handed over to another reactor (see
+ *         request_shard_match), FALSE otherwise
  */
-void handle_game_request(client *cl) {
-    printf("Client %d wants to play\n", cl->id);
-    set_game_request(cl, TRUE);
-    int matchFound = match_waiting_opponent(cl);
+int handle_game_request(client *cl) {
+    log_debug("Client %d wants to play", cl->id);
+    cl->join_requested_at = metrics_clock_ns();
 
-    char response[WANT_GAME_RESP_SIZE] = {0};
-    if (matchFound == FALSE) {
-        sprintf(response, "JOIN_GAME;%c\n", FIRST_PL_CHAR);
-    } else {
-        sprintf(response, "JOIN_GAME;%c\n", SECOND_PL_CHAR);
+    // Reactor clients are matched through the cross-shard lobby
+    if (cl->conn != NULL) {
+        return request_shard_match(cl);
     }
-    transmit_message(cl, response);
 
-    if (matchFound == TRUE) {
+    // The matchmaker answers with JOIN_GAME (and START_GAME once paired)
+    set_game_request(cl, TRUE);
+    submit_match_request(cl);
+    return FALSE;
+}
+
+/**
+ * Answers a JOIN_GAME request: tells the client its color and, if an opponent was found,
+ * sends the START_GAME message.
+ *
+ * @param cl Pointer to the requesting client
+ * @param matchFound TRUE if the client was paired with a waiting opponent
+ */
+void announce_match_result(client *cl, int matchFound) {
+    message_buffer response;
+    init_message(&response, cl->protocol);
+    build_join_game(&response, matchFound == FALSE ? FIRST_PL_CHAR : SECOND_PL_CHAR);
+    transmit_bytes(cl, response.data, response.len);
+
+    client *opponent = matchFound == TRUE ? get_opponent(cl) : NULL;
+    if (opponent != NULL) {
         // Start the game
-        char startMsg[START_GAME_MESSAGE_SIZE] = {0};
-        sprintf(startMsg, "START_GAME;%s;%c;%c\n",
-                cl->opponent->username,
-                cl->opponent->client_char,
-                cl->is_in_game ? '1' : '0');
-        transmit_message(cl, startMsg);
+        build_start_game(&response, opponent, cl->is_in_game);
+        transmit_bytes(cl, response.data, response.len);
     }
 }
 
@@ -78,81 +104,116 @@ void handle_game_request(client *cl) {
  * messages (e.g., for "WAIT" or forced draw). Not exposed in the header.
  */
 void ping_game_status_response(client *cl, int status) {
-    char response[GAME_STATUS_RESP_SIZE] = {0};
-
-    if (status == GAME_WIN) {
-        sprintf(response, "GAME_STATUS;%s\n", cl->username);
-        transmit_message(cl, response);
-    } else if (status == GAME_DRAW) {
-        sprintf(response, "GAME_STATUS;DRAW\n");
-        transmit_message(cl, response);
+    if (status == GAME_WIN || status == GAME_DRAW) {
+        message_buffer response;
+        init_message(&response, cl->protocol);
+        build_game_status(&response, status == GAME_WIN ? cl : NULL);
+        transmit_bytes(cl, response.data, response.len);
     }
 }
 
+/**
+ * A local helper function (not in .h) that removes a client while one of its messages is processed.
+ * Runs on the thread serving the client, which ends once process_client_message returns FALSE.
+ */
+void drop_client(client *cl) {
+    detach_client(cl);
+}
+
 /**
  * Processes an incoming message from a particular client and executes the necessary logic.
  *
  * @param cl Pointer to the client struct that sent the message
- * @param message The message itself
+ * @param message The message itself (a text line without its MESS_END_CHAR, or a binary frame body)
+ * @param length Number of bytes in the message
+ * @return TRUE if the client is still registered, FALSE if it was removed (cl is then freed),
+ *         CLIENT_HANDED_OVER if another reactor owns it now (cl must not be touched any more)
  */
-void process_client_message(client *cl, char *message) {
-    // Read the first token to determine the type of message
-    char *token = strtok(message, MESS_DELIMITER);
+int process_client_message(client *cl, const char *message, size_t length) {
+    parsed_message parsed;
+    long long parseStart = metrics_clock_ns();
+    if (cl->protocol == PROTOCOL_BINARY) {
+        parse_binary_message(message, length, &parsed);
+    } else {
+        parse_message(message, length, &parsed);
+    }
+    long long parseEnd = metrics_clock_ns();
+    record_latency(LATENCY_PARSE, parseEnd - parseStart, 1);
+    count_metric(METRIC_MESSAGES_IN, 1);
+
+    switch (parsed.command) {
+        case CMD_MOVE: {
+            // The game status and the squares sent along are taken under the lock that applied the move
+            legal_squares nextMoves;
+            int finalStatus;
+            int moveStatus = validate_move(cl, parsed.x, parsed.y, &finalStatus, &nextMoves);
+            record_latency(LATENCY_RULES, metrics_clock_ns() - parseEnd, 1);
+            count_metric(moveStatus == TRUE ? METRIC_MOVES : METRIC_MOVES_REJECTED, 1);
+
+            // A passing opponent gets no squares with OPP_MOVE; the PASS that follows names the mover's
+            respond_to_move(cl, moveStatus, parsed.x, parsed.y, finalStatus == GAME_PASS ? NULL : &nextMoves);
+            if (finalStatus == GAME_PASS) {
+                notify_pass(cl, &nextMoves);
+            } else {
+                notify_game_status(cl, finalStatus);
+            }
+            break;
+        }
 
-    if (strcmp(token, "MOVE") == 0) {
-        // Extract coordinates
-        int toX = atoi(strtok(NULL, MESS_DELIMITER));
-        int toY = atoi(strtok(NULL, MESS_DELIMITER));
+        case CMD_JOIN_GAME:
+            if (get_rules_kernel(parsed.board_size) == NULL) {
+                log_warn("Unsupported board size %d -> remove", parsed.board_size);
+                drop_client(cl);
+                return FALSE;
+            }
+            cl->hot->requested_board_size = parsed.board_size;
+            if (handle_game_request(cl)) {
+                return CLIENT_HANDED_OVER;
+            }
+            break;
 
-        int moveStatus = validate_move(cl, toX, toY);
-        int finalStatus = check_available_moves(cl);
+        case CMD_LOGOUT: {
+            client *opponent = get_opponent(cl);
+            if (opponent != NULL) {
+                finish_client_game(cl);
+                notify_game_status(opponent, GAME_WIN);
+            }
+            drop_client(cl);
+            return FALSE;
+        }
 
-        respond_to_move(cl, moveStatus, toX, toY);
-        notify_game_status(cl, finalStatus);
+        case CMD_PONG:
+            // Any received data counts as liveness (see note_client_activity)
+            log_debug("PONG - Client %d is connected", cl->id);
+            break;
 
-    } else if (strcmp(token, "JOIN_GAME") == 0) {
-        handle_game_request(cl);
+        case CMD_WAIT_REPLY:
+            if (parsed.wait) {
+                // The client chooses to wait
+                log_debug("Client %d waits for opponent %d", cl->id,
+                       cl->hot->opponent != NULL_HANDLE ? handle_slot(cl->hot->opponent) : -1);
+            } else {
+                // The client does not wait
+                ping_game_status_response(cl, GAME_DRAW);
+                pthread_mutex_lock(&clients_mutex);
+                client *opponent = get_opponent(cl);
+                if (opponent != NULL && opponent->hot->opponent == cl->handle) {
+                    opponent->hot->opponent = NULL_HANDLE;
+                }
+                pthread_mutex_unlock(&clients_mutex);
 
-    } else if (strcmp(token, "LOGOUT") == 0) {
-        if (cl->opponent != NULL) {
-            game *clientGame = locate_game_for_client(cl);
-            clientGame->game_status = GAME_OVER;
-            notify_game_status(cl->opponent, GAME_WIN);
-        }
-        pthread_t localThread = *cl->client_thread;
-        detach_client(cl);
-        pthread_join(localThread, NULL);
-
-    } else if (strcmp(token, "PONG") == 0) {
-        printf("PONG - Client %d is connected\n", cl->id);
-        update_client_ping(cl, 1);
-
-    } else if (strcmp(token, "WAIT_REPLY") == 0) {
-        token = strtok(NULL, MESS_DELIMITER);
-        // handle WAIT or NOT_WAIT
-        if (strncmp(token, "WAIT", 4) == 0) {
-            // The client chooses to wait
-            printf("Client %d waits for opponent %d\n", cl->id, cl->opponent->id);
-        } else {
-            // The client does not wait
-            ping_game_status_response(cl, GAME_DRAW);
-            pthread_mutex_lock(&clients_mutex);
-            if (cl->opponent != NULL) {
-                cl->opponent->opponent = NULL;
+                reset_client_game_data(cl);
+                log_debug("Serve opp disconnected: %d game cleaned", cl->id);
             }
-            pthread_mutex_unlock(&clients_mutex);
-
-            reset_client_game_data(cl);
-            printf("Serve opp disconnected: %d game cleaned\n", cl->id);
-        }
+            break;
 
-    } else {
-        // Invalid message, remove the client
-        printf("Invalid message -> remove\n");
-        pthread_t localThread = *cl->client_thread;
-        detach_client(cl);
-        pthread_join(localThread, NULL);
+        default:
+            // Invalid message (or LOGIN after the handshake), remove the client
+            log_warn("Invalid message -> remove");
+            drop_client(cl);
+            return FALSE;
     }
+    return TRUE;
 }
 
 /**
@@ -163,25 +224,43 @@ void process_client_message(client *cl, char *message) {
  * @param status Indicates success (TRUE) or an invalid move
  * @param x The x-coordinate of the move
  * @param y The y-coordinate of the move
+ * @param next_moves The legal targets of the opponent, sent along with OPP_MOVE (NULL if it passes)
  */
-void respond_to_move(client *cl, int status, int x, int y) {
-    char response[MOVE_MESS_RESP_SIZE] = {0};
+void respond_to_move(client *cl, int status, int x, int y, const legal_squares *next_moves) {
+    message_buffer response;
+    init_message(&response, cl->protocol);
+    build_move_result(&response, status, x, y);
+    transmit_bytes(cl, response.data, response.len);
 
     if (status == TRUE) {
-        sprintf(response, "MOVE;%c;%c;%c\n", status + '0', x + '0', y + '0');
-        transmit_message(cl, response);
-
-        if (cl->opponent != NULL) {
-            char oppMsg[OPP_MOVE_MESSAGE_SIZE] = {0};
-            sprintf(oppMsg, "OPP_MOVE;%c;%c\n", x + '0', y + '0');
-            transmit_message(cl->opponent, oppMsg);
+        client *opponent = get_opponent(cl);
+        if (opponent != NULL) {
+            init_message(&response, opponent->protocol);
+            build_opp_move(&response, x, y, next_moves);
+            transmit_bytes(opponent, response.data, response.len);
         }
-    } else {
-        sprintf(response, "MOVE;%c;0;0\n", status + '0');
-        transmit_message(cl, response);
     }
 }
 
+/**
+ * Tells both players that the opponent of the client passes: the client moves again.
+ *
+ * @param cl Pointer to the client whose move left the opponent without a legal move
+ * @param next_moves The legal targets of the client
+ */
+void notify_pass(client *cl, const legal_squares *next_moves) {
+    message_buffer response;
+    client *opponent = get_opponent(cl);
+    if (opponent != NULL) {
+        init_message(&response, opponent->protocol);
+        build_pass(&response, NULL);
+        transmit_bytes(opponent, response.data, response.len);
+    }
+    init_message(&response, cl->protocol);
+    build_pass(&response, next_moves);
+    transmit_bytes(cl, response.data, response.len);
+}
+
 /**
  * Sends a game status notification to the client (e.g., draw or win).
  *
@@ -189,28 +268,31 @@ void respond_to_move(client *cl, int status, int x, int y) {
  * @param status The final status of the game (e.g., GAME_DRAW, GAME_WIN)
  */
 void notify_game_status(client *cl, int status) {
-    char response[GAME_STATUS_RESP_SIZE] = {0};
-
-    if (status == GAME_WIN) {
-        sprintf(response, "GAME_STATUS;%s\n", cl->username);
-        if (cl->opponent != NULL) {
-            transmit_message(cl->opponent, response);
-            reset_client_game_data(cl->opponent);
-        }
-        transmit_message(cl, response);
-        purge_finished_game(cl);
-        reset_client_game_data(cl);
+    if (status != GAME_WIN && status != GAME_DRAW) {
+        return;
+    }
 
-    } else if (status == GAME_DRAW) {
-        sprintf(response, "GAME_STATUS;DRAW\n");
-        if (cl->opponent != NULL) {
-            transmit_message(cl->opponent, response);
-            reset_client_game_data(cl->opponent);
+    // The same message goes to both players (built twice only if they use different encodings)
+    message_buffer response;
+    client *winner = status == GAME_WIN ? cl : NULL;
+    init_message(&response, cl->protocol);
+    build_game_status(&response, winner);
+
+    client *opponent = get_opponent(cl);
+    if (opponent != NULL) {
+        if (opponent->protocol != cl->protocol) {
+            message_buffer oppResponse;
+            init_message(&oppResponse, opponent->protocol);
+            build_game_status(&oppResponse, winner);
+            transmit_bytes(opponent, oppResponse.data, oppResponse.len);
+        } else {
+            transmit_bytes(opponent, response.data, response.len);
         }
-        transmit_message(cl, response);
-        purge_finished_game(cl);
-        reset_client_game_data(cl);
+        reset_client_game_data(opponent);
     }
+    transmit_bytes(cl, response.data, response.len);
+    purge_finished_game(cl);
+    reset_client_game_data(cl);
 }
 
 
@@ -222,12 +304,26 @@ void notify_game_status(client *cl, int status) {
  * @return A void pointer (unused)
  */
 void *transmit_message(client *client, char *mess) {
-    printf("Sending client: %d -> message: %s", client->id, mess);
-    int sockDesc = client->socket;
-    send(sockDesc, mess, strlen(mess), 0);
+    transmit_bytes(client, mess, strlen(mess));
     return NULL;
 }
 
+void transmit_bytes(client *cl, const char *data, size_t len) {
+    count_metric(METRIC_MESSAGES_OUT, 1);
+    count_metric(METRIC_BYTES_OUT, len);
+    if (cl->protocol == PROTOCOL_BINARY) {
+        log_debug("Sending client: %d -> binary message of %zu bytes", cl->id, len);
+    } else {
+        int shown = (int) (len > 0 && data[len - 1] == MESS_END_CHAR[0] ? len - 1 : len);
+        log_debug("Sending client: %d -> message: %.*s", cl->id, shown, data);
+    }
+    if (cl->conn != NULL) {
+        queue_connection_output(cl->conn, data, len);
+    } else {
+        queue_client_output(cl, data, len);
+    }
+}
+
 /**
  * Sends a message to a client, identified only by its socket descriptor.
  *
@@ -236,140 +332,553 @@ void *transmit_message(client *client, char *mess) {
  * @return A void pointer (unused)
  */
 void *transmit_message_by_socket(int socket, char *mess) {
-    printf("Sending message: %s", mess);
+    log_debug("Sending message: %.*s", (int) strcspn(mess, MESS_END_CHAR), mess);
     send(socket, mess, strlen(mess), 0);
     return NULL;
 }
 
+void init_receive_buffer(recv_buffer *in) {
+    in->head = 0;
+    in->tail = 0;
+    in->scanned = 0;
+}
+
+ssize_t receive_into_buffer(int socket, recv_buffer *in) {
+    unsigned int used = in->tail - in->head;
+    unsigned int start = in->tail & (RECV_BUFFER_SIZE - 1);
+    unsigned int free = RECV_BUFFER_SIZE - used;
+
+    // The free space is at most two runs: up to the end of the array, then from its start
+    struct iovec parts[2];
+    int partCount = 1;
+    parts[0].iov_base = in->data + start;
+    parts[0].iov_len = free < RECV_BUFFER_SIZE - start ? free : RECV_BUFFER_SIZE - start;
+    if (parts[0].iov_len < free) {
+        parts[1].iov_base = in->data;
+        parts[1].iov_len = free - parts[0].iov_len;
+        partCount = 2;
+    }
+
+    ssize_t n = readv(socket, parts, partCount);
+    if (n > 0) {
+        in->tail += (unsigned int) n;
+        count_metric(METRIC_BYTES_IN, (uint64_t) n);
+    }
+    return n;
+}
+
+int next_message(recv_buffer *in, char *scratch, char **message, size_t *message_length) {
+    while (1) {
+        unsigned int pending = in->tail - in->head;
+
+        // Look for the terminator in the bytes not searched yet
+        int found = FALSE;
+        while (!found && in->scanned < pending) {
+            unsigned int pos = (in->head + in->scanned) & (RECV_BUFFER_SIZE - 1);
+            unsigned int run = pending - in->scanned;
+            if (run > RECV_BUFFER_SIZE - pos) {
+                run = RECV_BUFFER_SIZE - pos;
+            }
+            char *end = memchr(in->data + pos, MESS_END_CHAR[0], run);
+            if (end != NULL) {
+                in->scanned += (unsigned int) (end - (in->data + pos));
+                found = TRUE;
+            } else {
+                in->scanned += run;
+            }
+        }
+
+        unsigned int length = in->scanned;
+        if (!found) {
+            return pending >= MESSAGE_SIZE ? MESSAGE_TOO_LONG : FALSE;
+        }
+        if (length >= MESSAGE_SIZE) {
+            return MESSAGE_TOO_LONG;
+        }
+
+        // Consume the message together with its terminator
+        unsigned int start = in->head & (RECV_BUFFER_SIZE - 1);
+        in->head += length + 1;
+        in->scanned = 0;
+        if (length == 0) {
+            continue;
+        }
+
+        *message_length = length;
+        if (start + length < RECV_BUFFER_SIZE) {
+            in->data[start + length] = '\0';
+            *message = in->data + start;
+        } else {
+            unsigned int firstRun = RECV_BUFFER_SIZE - start;
+            memcpy(scratch, in->data + start, firstRun);
+            memcpy(scratch + firstRun, in->data, length - firstRun);
+            scratch[length] = '\0';
+            *message = scratch;
+        }
+        return TRUE;
+    }
+}
+
+int next_frame(recv_buffer *in, char *scratch, char **frame, size_t *frame_length) {
+    while (1) {
+        unsigned int pending = in->tail - in->head;
+        if (pending < BIN_HEADER_SIZE) {
+            return FALSE;
+        }
+
+        // Big-endian body length; the two header bytes may sit on both ends of the ring
+        unsigned int start = in->head & (RECV_BUFFER_SIZE - 1);
+        unsigned int length = (unsigned int) (unsigned char) in->data[start] << 8 |
+                              (unsigned char) in->data[(start + 1) & (RECV_BUFFER_SIZE - 1)];
+        if (length >= MESSAGE_SIZE) {
+            return MESSAGE_TOO_LONG;
+        }
+        if (pending < BIN_HEADER_SIZE + length) {
+            return FALSE;
+        }
+
+        // Consume the frame together with its header; empty frames are skipped like empty lines
+        in->head += BIN_HEADER_SIZE + length;
+        if (length == 0) {
+            continue;
+        }
+
+        unsigned int body = (start + BIN_HEADER_SIZE) & (RECV_BUFFER_SIZE - 1);
+        *frame_length = length;
+        if (body + length <= RECV_BUFFER_SIZE) {
+            *frame = in->data + body;
+        } else {
+            unsigned int firstRun = RECV_BUFFER_SIZE - body;
+            memcpy(scratch, in->data + body, firstRun);
+            memcpy(scratch + firstRun, in->data, length - firstRun);
+            *frame = scratch;
+        }
+        return TRUE;
+    }
+}
+
+int dispatch_received_messages(client *cl, recv_buffer *in) {
+    char scratch[MESSAGE_SIZE];
+    char *message;
+    size_t length;
+    int status, result;
+
+    note_client_activity(cl);
+    // Both readers hand out (pointer, length) messages, so the dispatch is the same
+    int (*next)(recv_buffer *, char *, char **, size_t *) = cl->protocol == PROTOCOL_BINARY ? next_frame
+                                                                                            : next_message;
+    while ((status = next(in, scratch, &message, &length)) == TRUE) {
+        log_debug("Client: %d sent message of %zu bytes", cl->id, length);
+        // A removed client is gone; a handed over one is served by its new reactor from here
+        if ((result = process_client_message(cl, message, length)) != TRUE) {
+            return result;
+        }
+    }
+
+    if (status == MESSAGE_TOO_LONG) {
+        log_warn("Message too long -> remove");
+        drop_client(cl);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 /**
  * Continuously listens for and processes incoming messages from the given client.
+ * Every read may carry several messages, or only part of one; both are handled by the
+ * receive buffer.
  *
  * @param cl Pointer to the client
  */
 void listen_for_messages(client *cl) {
     int client_socket = cl->socket;
-    char buffer[MESSAGE_SIZE] = {0};
-    int bytesRead;
+    recv_buffer in;
+    init_receive_buffer(&in);
 
     while (1) {
-        bytesRead = recv(client_socket, buffer, sizeof(buffer), 0);
+        ssize_t bytesRead = receive_into_buffer(client_socket, &in);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
         if (bytesRead <= 0) {
-            printf("Client must be disconnected...\n");
-            close(client_socket);
+            log_debug("Client must be disconnected...");
             detach_client(cl);
             break;
         }
-        printf("Client: %d sent message", cl->id);
-        process_client_message(cl, buffer);
+        // The replies to everything read at once leave together
+        long long received = metrics_clock_ns();
+        begin_output_batch();
+        int stillRegistered = dispatch_received_messages(cl, &in);
+        end_output_batch();
+        record_latency(LATENCY_REQUEST, metrics_clock_ns() - received, 1);
+        if (!stillRegistered) {
+            break;
+        }
+    }
+    log_debug("Client thread ends");
+}
 
-        memset(buffer, 0, sizeof(buffer));
+/**
+ * Parses a LOGIN handshake message ("LOGIN;<name>[;BIN]") and extracts the username
+ * (truncated to PLAYER_NAME_SIZE - 1 bytes) and the requested encoding.
+ *
+ * @param message The received message (not modified)
+ * @param length Number of bytes in the message, without its MESS_END_CHAR
+ * @param username Output buffer of PLAYER_NAME_SIZE bytes
+ * @param protocol Receives PROTOCOL_TEXT or PROTOCOL_BINARY
+ * @return TRUE if the message is a well-formed LOGIN, FALSE otherwise
+ */
+int parse_login_message(const char *message, size_t length, char *username, int *protocol) {
+    parsed_message parsed;
+    if (!parse_message(message, length, &parsed) || parsed.command != CMD_LOGIN) {
+        return FALSE;
     }
-    printf("Client thread ends\n");
+
+    copy_view(parsed.username, username, PLAYER_NAME_SIZE);
+    *protocol = parsed.protocol;
+    return TRUE;
 }
 
 /**
- * Periodically checks whether clients are still responsive and handles reconnection or removal.
+ * Confirms a successful login by echoing the LOGIN message back to the client.
  *
- * @return A void pointer (unused)
+ * @param cl Pointer to the freshly registered client
  */
-void *monitor_client_pings() {
-    pthread_mutex_lock(&clients_mutex);
+void confirm_login(client *cl) {
+    message_buffer response;
+    build_login_reply(&response, cl);
+    transmit_bytes(cl, response.data, response.len);
+}
 
-    while (1) {
-        // First pass: set is_connected to 0, send PING to each client
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i] != NULL) {
-                clients[i]->is_connected = 0;
-                transmit_message_by_socket(clients[i]->socket, "PING\n");
-            }
+/**
+ * Wheel of the thread-per-client clients, driven by the liveness monitor thread.
+ * In epoll mode every reactor has its own wheel (see shard_timer_wheel).
+ */
+static pthread_mutex_t g_threadTimersMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_threadTimersChanged;
+static timer_wheel g_threadTimers;
+
+/**
+ * When the liveness monitor wakes up next; an earlier deadline has to wake it.
+ */
+static long long g_threadTimersWake = 0;
+
+/**
+ * @brief Returns a client's wheel, taking the lock of the thread-mode wheel.
+ *        In epoll mode the calling reactor owns the wheel, no lock is needed; a client
+ *        handed over to another shard is never touched by its former reactor.
+ * @param cl The client
+ * @return The wheel holding the client's deadlines
+ */
+static timer_wheel *lock_client_timers(client *cl) {
+    if (cl->conn != NULL) {
+        assert(cl->conn->shard == current_shard());
+        return shard_timer_wheel(cl->conn->shard);
+    }
+    pthread_mutex_lock(&g_threadTimersMutex);
+    return &g_threadTimers;
+}
+
+/**
+ * @brief Releases the lock taken by lock_client_timers.
+ * @param cl The client
+ */
+static void unlock_client_timers(client *cl) {
+    if (cl->conn == NULL) {
+        pthread_mutex_unlock(&g_threadTimersMutex);
+    }
+}
+
+/**
+ * @brief (Re)schedules one of a client's deadlines. The caller holds the wheel (lock_client_timers).
+ * @param cl The client
+ * @param wheel The client's wheel
+ * @param entry cl->ping_timer or cl->zombie_timer
+ * @param deadline Monotonic time in milliseconds
+ */
+static void set_client_timer(client *cl, timer_wheel *wheel, timer_entry *entry, long long deadline) {
+    // A detached client keeps no deadline (detach_client cancelled them under the same lock)
+    if (__atomic_load_n(&cl->is_detached, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    schedule_timer(wheel, entry, deadline);
+    if (cl->conn == NULL && deadline < g_threadTimersWake) {
+        pthread_cond_signal(&g_threadTimersChanged);
+    }
+}
+
+/**
+ * @brief Returns the client's offset within the ping interval, so that clients who logged in
+ *        together are not all pinged in the same tick.
+ * @param cl The client
+ * @return Offset in milliseconds, below half of PING_SLEEP
+ */
+static long long ping_phase(client *cl) {
+    return (long long) (((unsigned int) cl->id * 2654435761u) % (PING_SLEEP * 1000 / 2));
+}
+
+void arm_liveness_timers(client *cl) {
+    long long now = monotonic_ms();
+    __atomic_store_n(&cl->hot->last_seen, now, __ATOMIC_RELAXED);
+
+    timer_wheel *wheel = lock_client_timers(cl);
+    set_client_timer(cl, wheel, &cl->ping_timer, now + PING_SLEEP * 1000 + ping_phase(cl));
+    set_client_timer(cl, wheel, &cl->zombie_timer, now + PING_ZOMBIE * 1000);
+    unlock_client_timers(cl);
+}
+
+void disarm_liveness_timers(client *cl) {
+    lock_client_timers(cl);
+    cancel_timer(&cl->ping_timer);
+    cancel_timer(&cl->zombie_timer);
+    unlock_client_timers(cl);
+}
+
+void note_client_activity(client *cl) {
+    __atomic_store_n(&cl->hot->last_seen, monotonic_ms(), __ATOMIC_RELAXED);
+    __atomic_store_n(&cl->hot->is_connected, TRUE, __ATOMIC_RELAXED);
+
+    // A client that was reported as disconnected gets its reconnection handled right away
+    if (__atomic_load_n(&cl->hot->need_reconnect_mess, __ATOMIC_RELAXED)) {
+        timer_wheel *wheel = lock_client_timers(cl);
+        set_client_timer(cl, wheel, &cl->ping_timer, 0);
+        unlock_client_timers(cl);
+    }
+}
+
+/**
+ * @brief Handles a client that sent data again after it had been reported as disconnected:
+ *        resends the game state, or ends the game if the opponent is gone.
+ * @param cl The client
+ */
+static void handle_client_return(client *cl) {
+    log_debug("Run ping: NEED RECONNECT MESSAGE");
+    __atomic_store_n(&cl->hot->need_reconnect_mess, FALSE, __ATOMIC_RELAXED);
+
+    if (get_opponent(cl) != NULL) {
+        reconnect_message(cl);
+
+    } else if (awaiting_restored_opponent(cl)) {
+        // The opponent of a restored game may still log in
+        __atomic_store_n(&cl->hot->need_reconnect_mess, TRUE, __ATOMIC_RELAXED);
+
+    } else if (cl->hot->is_requesting_game == FALSE) {
+        // Opponent is not there -> remove the game and notify client
+        message_buffer response;
+        init_message(&response, cl->protocol);
+        build_opp_gone_status(&response);
+        transmit_bytes(cl, response.data, response.len);
+
+        finish_client_game(cl);
+        purge_finished_game(cl);
+
+        reset_client_game_data(cl);
+    }
+}
+
+void resume_previous_session(client *cl) {
+    client *previous = cl->previous_session;
+    if (previous == NULL) {
+        // After a restart the client's game may wait for it in the snapshot
+        if (claim_restored_seat(cl)) {
+            handle_client_return(cl);
         }
-        pthread_mutex_unlock(&clients_mutex);
-
-        sleep(PING_SLEEP);
-
-        // Second pass: check who responded
-        pthread_mutex_lock(&clients_mutex);
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i] != NULL) {
-                printf("Run ping: client %d is connected: %d\n", clients[i]->id, clients[i]->is_connected);
-
-                // If the client is unresponsive for too long -> remove
-                if (clients[i]->is_connected == 0 && clients[i]->last_ping + PING_ZOMBIE < time(NULL)) {
-                    printf("Run ping: Client %d disconnected\n", clients[i]->id);
-
-                    pthread_t localThread = *clients[i]->client_thread;
-
-                    // Possibly inform the opponent
-                    if (clients[i]->opponent != NULL) {
-                        printf("Run ping: MUST SEND GAME STATUS TO OPPONENT\n");
-                        pthread_mutex_unlock(&clients_mutex);
-                        ping_game_status_response(clients[i]->opponent, GAME_WIN);
-                        pthread_mutex_lock(&clients_mutex);
-                    }
-
-                    // Remove the game if not already removed
-                    if (clients[i]->active_game_id != GAME_NULL_ID) {
-                        game *cGame = locate_game_for_client(clients[i]);
-                        pthread_mutex_lock(&g_gamesMutex);
-                        cGame->game_status = GAME_OVER;
-                        pthread_mutex_unlock(&g_gamesMutex);
-                        purge_finished_game(clients[i]);
-
-                        pthread_mutex_unlock(&clients_mutex);
-                        if (clients[i]->opponent != NULL) {
-                            reset_client_game_data(clients[i]->opponent);
-                        }
-                        reset_client_game_data(clients[i]);
-                        pthread_mutex_lock(&clients_mutex);
-                    }
-
-                    // Finally remove the client
-                    pthread_mutex_unlock(&clients_mutex);
-                    detach_client(clients[i]);
-                    pthread_cancel(localThread);
-                    pthread_mutex_lock(&clients_mutex);
-                    printf("Run ping:  Client removed\n");
-
-                    // If the client is connected but needs a reconnection message
-                } else if (clients[i]->is_connected && clients[i]->need_reconnect_mess == 1) {
-                    printf("Run ping: NEED RECONNECT MESSAGE\n");
-                    clients[i]->need_reconnect_mess = 0;
-
-                    if (clients[i]->opponent != NULL) {
-                        pthread_mutex_unlock(&clients_mutex);
-                        reconnect_message(clients[i]);
-                        pthread_mutex_lock(&clients_mutex);
-
-                    } else if (clients[i]->is_requesting_game == FALSE) {
-                        // Opponent is not there -> remove the game and notify client
-                        char tmpResponse[GAME_STATUS_RESP_SIZE] = {0};
-                        sprintf(tmpResponse, "GAME_STATUS;OPP_DISCONNECTED\n");
-                        pthread_mutex_unlock(&clients_mutex);
-                        transmit_message_by_socket(clients[i]->socket, tmpResponse);
-
-                        game *cGame = locate_game_for_client(clients[i]);
-                        pthread_mutex_lock(&g_gamesMutex);
-                        cGame->game_status = GAME_OVER;
-                        pthread_mutex_unlock(&g_gamesMutex);
-                        purge_finished_game(clients[i]);
-
-                        reset_client_game_data(clients[i]);
-                        pthread_mutex_lock(&clients_mutex);
-                    }
-                }
-                    // If client didn't respond yet, but not zombie timed out, set need_reconnect_mess = 1
-                else if (clients[i]->is_connected == 0) {
-                    printf("Run ping: SET NEED RECONNECT MESSAGE\n");
-                    if (clients[i]->opponent != NULL && clients[i]->need_reconnect_mess == 0) {
-                        transmit_message_by_socket(clients[i]->opponent->socket, "OPP_DISCONNECTED\n");
-                    }
-                    clients[i]->need_reconnect_mess = 1;
-                }
+        return;
+    }
+    cl->previous_session = NULL;
+
+    int inGame = FALSE;
+    if (!__atomic_load_n(&previous->is_detached, __ATOMIC_ACQUIRE)) {
+        log_info("Client %d resumes the session of client %d", cl->id, previous->id);
+        inGame = take_over_session(previous, cl);
+        detach_client(previous);
+    }
+    release_client(previous);
+
+    // Both players get the game state now, not on the next ping deadline
+    if (inGame) {
+        handle_client_return(cl);
+    }
+}
+
+/**
+ * @brief Sends a PING in the client's encoding.
+ * @param cl The client
+ */
+static void send_ping(client *cl) {
+    message_buffer ping;
+    init_message(&ping, cl->protocol);
+    build_ping(&ping);
+    transmit_bytes(cl, ping.data, ping.len);
+}
+
+/**
+ * @brief Ping deadline: a client quiet for PING_SLEEP seconds is sent a PING; one that did
+ *        not answer the previous PING is reported to its opponent as disconnected.
+ * @param cl The client
+ * @param wheel The client's wheel (locked by the caller only around the rescheduling)
+ * @param now Current monotonic time in milliseconds
+ */
+static void handle_ping_deadline(client *cl, timer_wheel *wheel, long long now) {
+    long long lastSeen = __atomic_load_n(&cl->hot->last_seen, __ATOMIC_RELAXED);
+    long long next;
+
+    if (!__atomic_load_n(&cl->hot->is_connected, __ATOMIC_RELAXED)) {
+        // Nothing arrived since the last PING; the zombie deadline removes the client eventually
+        log_debug("Run ping: SET NEED RECONNECT MESSAGE");
+        client *opponent = get_opponent(cl);
+        if (opponent != NULL && !cl->hot->need_reconnect_mess) {
+            message_buffer notice;
+            init_message(&notice, opponent->protocol);
+            build_opp_disconnected(&notice);
+            transmit_bytes(opponent, notice.data, notice.len);
+        }
+        __atomic_store_n(&cl->hot->need_reconnect_mess, TRUE, __ATOMIC_RELAXED);
+        send_ping(cl);
+        next = now + PING_SLEEP * 1000;
+
+    } else {
+        if (cl->hot->need_reconnect_mess) {
+            handle_client_return(cl);
+        }
+
+        if (now - lastSeen >= PING_SLEEP * 1000) {
+            __atomic_store_n(&cl->hot->is_connected, FALSE, __ATOMIC_RELAXED);
+            send_ping(cl);
+            next = now + PING_SLEEP * 1000;
+        } else {
+            // Recent traffic proves the client alive, no PING needed yet
+            next = lastSeen + PING_SLEEP * 1000 + ping_phase(cl);
+        }
+    }
+
+    lock_client_timers(cl);
+    set_client_timer(cl, wheel, &cl->ping_timer, next);
+    unlock_client_timers(cl);
+}
+
+/**
+ * @brief Zombie deadline: removes a client that sent nothing for PING_ZOMBIE seconds
+ *        (the opponent wins), or postpones the deadline if data arrived meanwhile.
+ * @param cl The client
+ * @param wheel The client's wheel (locked by the caller only around the rescheduling)
+ * @param now Current monotonic time in milliseconds
+ */
+static void handle_zombie_deadline(client *cl, timer_wheel *wheel, long long now) {
+    long long deadline = __atomic_load_n(&cl->hot->last_seen, __ATOMIC_RELAXED) + PING_ZOMBIE * 1000;
+    if (now < deadline) {
+        lock_client_timers(cl);
+        set_client_timer(cl, wheel, &cl->zombie_timer, deadline);
+        unlock_client_timers(cl);
+        return;
+    }
+
+    log_debug("Run ping: Client %d disconnected", cl->id);
+
+    // Possibly inform the opponent
+    client *opponent = get_opponent(cl);
+    if (opponent != NULL) {
+        log_debug("Run ping: MUST SEND GAME STATUS TO OPPONENT");
+        ping_game_status_response(opponent, GAME_WIN);
+    }
+
+    // Remove the game if not already removed
+    if (cl->hot->current_game != NULL_HANDLE) {
+        finish_client_game(cl);
+        purge_finished_game(cl);
+
+        if (opponent != NULL) {
+            reset_client_game_data(opponent);
+        }
+        reset_client_game_data(cl);
+    }
+
+    // Finally remove the client (its thread, if any, wakes up and ends)
+    detach_client(cl);
+    log_debug("Run ping:  Client removed");
+}
+
+void expire_liveness_timers(int shard) {
+    int threadMode = shard == NO_SHARD;
+    timer_wheel *wheel = threadMode ? &g_threadTimers : shard_timer_wheel(shard);
+    long long now = monotonic_ms();
+
+    if (threadMode) {
+        pthread_mutex_lock(&g_threadTimersMutex);
+    }
+    advance_timer_wheel(wheel, now);
+
+    timer_entry *entry;
+    while ((entry = pop_expired_timer(wheel)) != NULL) {
+        client *cl = entry->data;
+
+        // The handlers send messages and may detach the client; the wheel is not held meanwhile
+        if (threadMode) {
+            retain_client(cl);
+            pthread_mutex_unlock(&g_threadTimersMutex);
+        }
+        if (!__atomic_load_n(&cl->is_detached, __ATOMIC_ACQUIRE)) {
+            if (entry == &cl->ping_timer) {
+                handle_ping_deadline(cl, wheel, now);
+            } else {
+                handle_zombie_deadline(cl, wheel, now);
             }
         }
-        pthread_mutex_unlock(&clients_mutex);
+        if (threadMode) {
+            release_client(cl);
+            pthread_mutex_lock(&g_threadTimersMutex);
+        }
+    }
+
+    if (threadMode) {
+        pthread_mutex_unlock(&g_threadTimersMutex);
     }
 }
 
+/**
+ * @brief Liveness monitor of the thread-per-client clients: sleeps until the next deadline
+ *        of their wheel and handles the deadlines that passed.
+ * @param arg Unused
+ * @return A void pointer (unused)
+ */
+static void *monitor_client_pings(void *arg) {
+    (void) arg;
 
+    while (1) {
+        pthread_mutex_lock(&g_threadTimersMutex);
+        long long wake = next_timer_deadline(&g_threadTimers);
+        while (monotonic_ms() < wake) {
+            g_threadTimersWake = wake;
+            struct timespec until;
+            until.tv_sec = wake / 1000;
+            until.tv_nsec = (wake % 1000) * 1000000;
+            pthread_cond_timedwait(&g_threadTimersChanged, &g_threadTimersMutex, &until);
+            wake = next_timer_deadline(&g_threadTimers);
+        }
+        g_threadTimersWake = 0;
+        pthread_mutex_unlock(&g_threadTimersMutex);
 
+        // The messages sent for the deadlines of one tick leave together
+        begin_output_batch();
+        expire_liveness_timers(NO_SHARD);
+        end_output_batch();
+    }
+    return NULL;
+}
+
+int start_liveness_monitor() {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_threadTimersChanged, &attr);
+    pthread_condattr_destroy(&attr);
+    init_timer_wheel(&g_threadTimers, monotonic_ms());
+
+    pthread_t thPing;
+    if (pthread_create(&thPing, NULL, monitor_client_pings, NULL) != 0) {
+        perror("Could not initiate ping thread");
+        return FALSE;
+    }
+    pthread_detach(thPing);
+    return TRUE;
+}
@@ -1,23 +1,49 @@
 #ifndef __NETWORK_INTERFACE_H__
 #define __NETWORK_INTERFACE_H__
 
+#include <sys/types.h>
 #include "def_n_struct.h"
 
+/**
+ * Returned by next_message when a message exceeds MESSAGE_SIZE - 1 bytes.
+ */
+#define MESSAGE_TOO_LONG        (-1)
+
+/**
+ * Returned by process_client_message and dispatch_received_messages when a JOIN_GAME handed the
+ * client's connection over to another reactor, which dispatches the messages pipelined behind it.
+ */
+#define CLIENT_HANDED_OVER      2
+
 /**
  * Declares that a client wants to participate in a game
  * and sends a response to the client if an opponent is found.
  *
  * @param cl Pointer to the client struct
+ * @return TRUE if the client's connection was handed over to another reactor (see
+ *         request_shard_match), FALSE otherwise
  */
-void handle_game_request(client *cl);
+int handle_game_request(client *cl);
+
+/**
+ * Answers a JOIN_GAME request: tells the client its color and, if an opponent was found,
+ * sends the START_GAME message.
+ *
+ * @param cl Pointer to the requesting client
+ * @param matchFound TRUE if the client was paired with a waiting opponent
+ */
+void announce_match_result(client *cl, int matchFound);
 
 /**
  * Processes an incoming message from a particular client and executes the necessary logic.
  *
  * @param cl Pointer to the client struct that sent the message
- * @param message The message itself
+ * @param message The message itself (without its MESS_END_CHAR)
+ * @param length Number of bytes in the message
+ * @return TRUE if the client is still registered, FALSE if it was removed (cl is then freed),
+ *         CLIENT_HANDED_OVER if another reactor owns it now (cl must not be touched any more)
  */
-void process_client_message(client *cl, char *message);
+int process_client_message(client *cl, const char *message, size_t length);
 
 /**
  * Sends feedback to the client (and possibly the opponent) after a move attempt,
@@ -27,8 +53,18 @@ void process_client_message(client *cl, char *message);
  * @param status Indicates success (TRUE) or an invalid move
  * @param x The x-coordinate of the move
  * @param y The y-coordinate of the move
+ * @param next_moves The legal targets of the opponent, sent along with OPP_MOVE (NULL if it passes)
+ */
+void respond_to_move(client *cl, int status, int x, int y, const legal_squares *next_moves);
+
+/**
+ * Tells both players that the opponent of the client has no legal move and passes
+ * (PASS with no squares), and the client that it moves again (PASS with its legal targets).
+ *
+ * @param cl Pointer to the client whose move left the opponent without a legal move
+ * @param next_moves The legal targets of the client
  */
-void respond_to_move(client *cl, int status, int x, int y);
+void notify_pass(client *cl, const legal_squares *next_moves);
 
 /**
  * Sends a game status notification to the client (e.g., draw or win).
@@ -47,6 +83,15 @@ void notify_game_status(client *cl, int status);
  */
 void *transmit_message(client *client, char *mess);
 
+/**
+ * Sends a message of known length to a client using its client structure.
+ *
+ * @param cl Pointer to the recipient's client struct
+ * @param data The message bytes
+ * @param len Number of bytes in the message
+ */
+void transmit_bytes(client *cl, const char *data, size_t len);
+
 /**
  * Sends a message to a client, identified only by its socket descriptor.
  *
@@ -56,6 +101,61 @@ void *transmit_message(client *client, char *mess);
  */
 void *transmit_message_by_socket(int socket, char *mess);
 
+/**
+ * Empties a receive buffer.
+ *
+ * @param in The buffer
+ */
+void init_receive_buffer(recv_buffer *in);
+
+/**
+ * Appends whatever the socket has ready to the receive buffer (one readv call, also when the
+ * free space wraps around the end of the ring).
+ *
+ * @param socket The socket descriptor
+ * @param in The buffer
+ * @return Number of bytes received, 0 if the peer closed the connection, -1 on error (errno is set)
+ */
+ssize_t receive_into_buffer(int socket, recv_buffer *in);
+
+/**
+ * Takes the next complete message (terminated by MESS_END_CHAR) out of the receive buffer.
+ * The terminator is replaced by '\0'; a message wrapping around the ring is copied to scratch.
+ * Empty lines are skipped; partial messages stay in the buffer for the next read.
+ *
+ * @param in The buffer
+ * @param scratch Buffer of MESSAGE_SIZE bytes used for wrapped messages
+ * @param message Receives the NUL-terminated message (valid until the next read)
+ * @param message_length Receives the length of the message
+ * @return TRUE if a message was taken, FALSE if none is complete, MESSAGE_TOO_LONG on overflow
+ */
+int next_message(recv_buffer *in, char *scratch, char **message, size_t *message_length);
+
+/**
+ * Takes the next complete binary frame (a BIN_HEADER_SIZE length header, then the body) out
+ * of the receive buffer. A body wrapping around the ring is copied to scratch; empty frames
+ * are skipped and partial frames stay in the buffer for the next read.
+ *
+ * @param in The buffer
+ * @param scratch Buffer of MESSAGE_SIZE bytes used for wrapped frames
+ * @param frame Receives the body, not NUL-terminated (valid until the next read)
+ * @param frame_length Receives the length of the body
+ * @return TRUE if a frame was taken, FALSE if none is complete, MESSAGE_TOO_LONG if the header
+ *         announces a body of MESSAGE_SIZE bytes or more
+ */
+int next_frame(recv_buffer *in, char *scratch, char **frame, size_t *frame_length);
+
+/**
+ * Processes every complete message in the receive buffer, in order. Stops after a message that
+ * hands the client over to another reactor; the rest of the buffer travels with the connection.
+ *
+ * @param cl Pointer to the client that sent the data
+ * @param in The client's receive buffer
+ * @return TRUE if the client is still registered, FALSE if it was removed (cl is then freed),
+ *         CLIENT_HANDED_OVER if another reactor owns it now (cl must not be touched any more)
+ */
+int dispatch_received_messages(client *cl, recv_buffer *in);
+
 /**
  * Continuously listens for and processes incoming messages from the given client.
  *
@@ -64,10 +164,74 @@ void *transmit_message_by_socket(int socket, char *mess);
 void listen_for_messages(client *cl);
 
 /**
- * Periodically checks whether clients are still responsive and handles reconnection or removal.
+ * Parses a LOGIN handshake message ("LOGIN;<name>[;BIN]") and extracts the username
+ * (truncated to PLAYER_NAME_SIZE - 1 bytes) and the requested encoding.
  *
- * @return A void pointer (unused)
+ * @param message The received message (not modified)
+ * @param length Number of bytes in the message, without its MESS_END_CHAR
+ * @param username Output buffer of PLAYER_NAME_SIZE bytes
+ * @param protocol Receives PROTOCOL_TEXT or PROTOCOL_BINARY
+ * @return TRUE if the message is a well-formed LOGIN, FALSE otherwise
+ */
+int parse_login_message(const char *message, size_t length, char *username, int *protocol);
+
+/**
+ * Confirms a successful login by echoing the LOGIN message back to the client.
+ *
+ * @param cl Pointer to the freshly registered client
+ */
+void confirm_login(client *cl);
+
+/**
+ * Schedules the ping and zombie deadlines of a client that has just logged in (or has just
+ * been adopted by another reactor). Must be called by the thread owning the client's wheel:
+ * the reactor of its shard in epoll mode, any thread in thread mode.
+ *
+ * @param cl The client
+ */
+void arm_liveness_timers(client *cl);
+
+/**
+ * Cancels the deadlines of a client that is being detached or handed over to another shard.
+ *
+ * @param cl The client
+ */
+void disarm_liveness_timers(client *cl);
+
+/**
+ * Completes a re-LOGIN: the session that was registered under the client's name (see
+ * register_client) hands its game over to the client and is removed, and both players are
+ * sent RECONNECT right away. A LOGIN that superseded no session claims the client's seat in
+ * a restored game instead, if it has one (see claim_restored_seat). In epoll mode the calling
+ * reactor must serve the superseded session, or the restored game's shard.
+ *
+ * @param cl The client that has just logged in (after its LOGIN was confirmed)
+ */
+void resume_previous_session(client *cl);
+
+/**
+ * Records that data arrived from the client. Any traffic counts as an answer to a PING, so
+ * clients that are playing are never pinged; a client reported as disconnected gets its
+ * reconnection handled on the next tick.
+ *
+ * @param cl The client
+ */
+void note_client_activity(client *cl);
+
+/**
+ * Handles every ping and zombie deadline that has passed: quiet clients are pinged, clients
+ * that did not answer are reported to their opponent, zombies are removed.
+ *
+ * @param shard The reactor shard whose wheel to advance, or NO_SHARD for thread-per-client clients
+ */
+void expire_liveness_timers(int shard);
+
+/**
+ * Starts the thread that handles the deadlines of the thread-per-client clients
+ * (reactors handle the deadlines of their own clients).
+ *
+ * @return TRUE if the thread was started, FALSE otherwise
  */
-void *monitor_client_pings();
+int start_liveness_monitor();
 
 #endif
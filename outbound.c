@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "outbound.h"
+#include "player_manager.h"
+#include "server_metrics.h"
+#include "server_log.h"
+
+/**
+ * Number of distinct clients whose output one batch can collect before it is flushed early.
+ */
+#define OUT_BATCH_CLIENTS       16
+
+/**
+ * Epoll instance of the output writer: clients waiting for EPOLLOUT, plus g_writerWakeFd.
+ */
+static int g_writerEpollFd = -1;
+static int g_writerWakeFd = -1;
+
+/**
+ * Clients whose writer registration was cancelled; the writer drops its reference to them
+ * after the current batch of events, so no event can still point at a freed client.
+ */
+static pthread_mutex_t g_retiredMutex = PTHREAD_MUTEX_INITIALIZER;
+static client *g_retired = NULL;
+
+/**
+ * Output batch of the calling thread.
+ */
+static __thread int t_batchDepth = 0;
+static __thread client *t_batchClients[OUT_BATCH_CLIENTS];
+static __thread int t_batchCount = 0;
+
+void init_out_queue(out_queue *queue) {
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->head_sent = 0;
+    queue->queued = 0;
+}
+
+int append_output(out_queue *queue, const char *data, size_t len) {
+    if (queue->queued + len > OUT_QUEUE_LIMIT) {
+        return FALSE;
+    }
+
+    out_chunk *chunk = malloc(sizeof(out_chunk) + len);
+    if (chunk == NULL) {
+        perror("Failed to allocate memory for outgoing message");
+        return FALSE;
+    }
+    chunk->next = NULL;
+    chunk->len = len;
+    memcpy(chunk->data, data, len);
+
+    if (queue->tail == NULL) {
+        queue->head = chunk;
+    } else {
+        queue->tail->next = chunk;
+    }
+    queue->tail = chunk;
+    queue->queued += len;
+    count_metric(METRIC_OUT_QUEUED, len);
+    return TRUE;
+}
+
+int write_output(out_queue *queue, int socket) {
+    while (queue->head != NULL) {
+        // Gather the queued messages into one vector
+        struct iovec parts[OUT_QUEUE_MAX_IOV];
+        int partCount = 0;
+        for (out_chunk *chunk = queue->head; chunk != NULL && partCount < OUT_QUEUE_MAX_IOV; chunk = chunk->next) {
+            size_t skip = chunk == queue->head ? queue->head_sent : 0;
+            parts[partCount].iov_base = chunk->data + skip;
+            parts[partCount].iov_len = chunk->len - skip;
+            partCount++;
+        }
+
+        struct msghdr msg = {0};
+        msg.msg_iov = parts;
+        msg.msg_iovlen = (size_t) partCount;
+        long long sendStart = metrics_clock_ns();
+        ssize_t n = sendmsg(socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        record_latency(LATENCY_SEND, metrics_clock_ns() - sendStart, 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? OUTPUT_PENDING : OUTPUT_FAILED;
+        }
+
+        // Free what was written completely
+        size_t written = (size_t) n;
+        queue->queued -= written;
+        count_metric(METRIC_OUT_DRAINED, written);
+        while (written > 0) {
+            out_chunk *head = queue->head;
+            size_t rest = head->len - queue->head_sent;
+            if (written < rest) {
+                queue->head_sent += written;
+                break;
+            }
+            written -= rest;
+            queue->head = head->next;
+            queue->head_sent = 0;
+            free(head);
+        }
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        } else if (queue->head_sent > 0) {
+            // Short write: the socket buffer is full
+            return OUTPUT_PENDING;
+        }
+    }
+    return OUTPUT_DRAINED;
+}
+
+void discard_output(out_queue *queue) {
+    if (queue->queued > 0) {
+        count_metric(METRIC_OUT_DRAINED, queue->queued);
+    }
+    while (queue->head != NULL) {
+        out_chunk *next = queue->head->next;
+        free(queue->head);
+        queue->head = next;
+    }
+    init_out_queue(queue);
+}
+
+/**
+ * @brief Handles a failed or overflowing client: drops its output and shuts the socket down,
+ *        which makes the client's own thread detach it. The caller holds cl->out_lock.
+ * @param cl The client
+ */
+static void abort_client_output(client *cl) {
+    discard_output(&cl->out);
+    shutdown(cl->socket, SHUT_RDWR);
+}
+
+/**
+ * @brief Writes a thread-mode client's queue; hands the rest to the writer if the socket is full.
+ * @param cl The client
+ */
+static void flush_client_output(client *cl) {
+    pthread_mutex_lock(&cl->out_lock);
+
+    // While armed, the writer owns the flushing (keeps the byte order)
+    if (!cl->out_armed && cl->out.head != NULL && !__atomic_load_n(&cl->is_detached, __ATOMIC_ACQUIRE)) {
+        int result = write_output(&cl->out, cl->socket);
+        if (result == OUTPUT_PENDING) {
+            struct epoll_event ev = {0};
+            ev.events = EPOLLOUT | EPOLLONESHOT;
+            ev.data.ptr = cl;
+            retain_client(cl);
+            if (epoll_ctl(g_writerEpollFd, EPOLL_CTL_ADD, cl->socket, &ev) == 0) {
+                cl->out_armed = TRUE;
+            } else {
+                perror("Failed to wait for a full client socket");
+                release_client(cl);
+                abort_client_output(cl);
+            }
+        } else if (result == OUTPUT_FAILED) {
+            abort_client_output(cl);
+        }
+    }
+
+    pthread_mutex_unlock(&cl->out_lock);
+}
+
+void queue_client_output(client *cl, const char *data, size_t len) {
+    pthread_mutex_lock(&cl->out_lock);
+    if (__atomic_load_n(&cl->is_detached, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&cl->out_lock);
+        return;
+    }
+    if (!append_output(&cl->out, data, len)) {
+        log_warn("Output queue of client %d overflowed -> disconnect", cl->id);
+        abort_client_output(cl);
+        pthread_mutex_unlock(&cl->out_lock);
+        return;
+    }
+    pthread_mutex_unlock(&cl->out_lock);
+
+    if (t_batchDepth == 0) {
+        flush_client_output(cl);
+        return;
+    }
+
+    // Deferred until the end of the batch; the batch keeps the client alive until then
+    for (int i = 0; i < t_batchCount; i++) {
+        if (t_batchClients[i] == cl) {
+            return;
+        }
+    }
+    if (t_batchCount == OUT_BATCH_CLIENTS) {
+        flush_client_output(cl);
+        return;
+    }
+    retain_client(cl);
+    t_batchClients[t_batchCount++] = cl;
+}
+
+void begin_output_batch() {
+    t_batchDepth++;
+}
+
+void end_output_batch() {
+    if (--t_batchDepth > 0) {
+        return;
+    }
+
+    for (int i = 0; i < t_batchCount; i++) {
+        flush_client_output(t_batchClients[i]);
+        release_client(t_batchClients[i]);
+    }
+    t_batchCount = 0;
+}
+
+void close_client_output(client *cl) {
+    pthread_mutex_lock(&cl->out_lock);
+    discard_output(&cl->out);
+    int wasArmed = cl->out_armed;
+    if (wasArmed) {
+        epoll_ctl(g_writerEpollFd, EPOLL_CTL_DEL, cl->socket, NULL);
+        cl->out_armed = FALSE;
+    }
+    pthread_mutex_unlock(&cl->out_lock);
+
+    if (wasArmed) {
+        // The writer drops its reference once no event of this batch can refer to the client
+        pthread_mutex_lock(&g_retiredMutex);
+        cl->out_next_retired = g_retired;
+        g_retired = cl;
+        pthread_mutex_unlock(&g_retiredMutex);
+
+        uint64_t one = 1;
+        if (write(g_writerWakeFd, &one, sizeof(one)) == -1) {
+            perror("Failed to wake the output writer");
+        }
+    }
+}
+
+/**
+ * @brief Output writer thread: finishes the writes of clients whose sockets were full.
+ * @param arg Unused
+ * @return A void pointer (unused)
+ */
+static void *output_writer_main(void *arg) {
+    (void) arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (1) {
+        int ready = epoll_wait(g_writerEpollFd, events, REACTOR_MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno != EINTR) {
+                perror("Output writer epoll_wait failed");
+            }
+            continue;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            client *cl = events[i].data.ptr;
+            if (cl == NULL) {
+                uint64_t counter;
+                if (read(g_writerWakeFd, &counter, sizeof(counter)) == -1 && errno != EAGAIN) {
+                    perror("Failed to read the output writer wake counter");
+                }
+                continue;
+            }
+
+            pthread_mutex_lock(&cl->out_lock);
+            if (!cl->out_armed) {
+                // Cancelled by close_client_output; the reference is dropped through the retire list
+                pthread_mutex_unlock(&cl->out_lock);
+                continue;
+            }
+
+            int result = write_output(&cl->out, cl->socket);
+            int keepWaiting = result == OUTPUT_PENDING;
+            if (keepWaiting) {
+                struct epoll_event ev = {0};
+                ev.events = EPOLLOUT | EPOLLONESHOT;
+                ev.data.ptr = cl;
+                keepWaiting = epoll_ctl(g_writerEpollFd, EPOLL_CTL_MOD, cl->socket, &ev) == 0;
+            }
+            if (!keepWaiting) {
+                if (result != OUTPUT_DRAINED) {
+                    abort_client_output(cl);
+                }
+                epoll_ctl(g_writerEpollFd, EPOLL_CTL_DEL, cl->socket, NULL);
+                cl->out_armed = FALSE;
+            }
+            pthread_mutex_unlock(&cl->out_lock);
+
+            if (!keepWaiting) {
+                release_client(cl);
+            }
+        }
+
+        // No event of this batch refers to the retired clients any more
+        pthread_mutex_lock(&g_retiredMutex);
+        client *retired = g_retired;
+        g_retired = NULL;
+        pthread_mutex_unlock(&g_retiredMutex);
+        while (retired != NULL) {
+            client *next = retired->out_next_retired;
+            release_client(retired);
+            retired = next;
+        }
+    }
+    return NULL;
+}
+
+int start_output_writer() {
+    g_writerEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    g_writerWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_writerEpollFd == -1 || g_writerWakeFd == -1) {
+        perror("Failed to create the output writer");
+        return FALSE;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(g_writerEpollFd, EPOLL_CTL_ADD, g_writerWakeFd, &ev) == -1) {
+        perror("Failed to create the output writer");
+        return FALSE;
+    }
+
+    pthread_t thWriter;
+    if (pthread_create(&thWriter, NULL, output_writer_main, NULL) != 0) {
+        perror("Could not start the output writer thread");
+        return FALSE;
+    }
+    pthread_detach(thWriter);
+    return TRUE;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file outbound.h
+ * @brief Declares the outbound message queues and the writer that drains them in thread mode.
+ *
+ * Messages are appended to a per-connection queue and written later with one sendmsg per
+ * batch, so the replies caused by one request (MOVE, OPP_MOVE, GAME_STATUS, ...) leave in a
+ * single system call and a slow reader never blocks the thread that produced its output.
+ */
+
+#ifndef __OUTBOUND_H__
+#define __OUTBOUND_H__
+
+#include <stddef.h>
+#include "def_n_struct.h"
+
+/**
+ * Results of write_output.
+ */
+#define OUTPUT_DRAINED          0
+#define OUTPUT_PENDING          1
+#define OUTPUT_FAILED           (-1)
+
+/**
+ * Empties a queue without freeing anything (the queue must be empty or new).
+ *
+ * @param queue The queue
+ */
+void init_out_queue(out_queue *queue);
+
+/**
+ * Appends a copy of a message to the queue.
+ *
+ * @param queue The queue
+ * @param data The message bytes
+ * @param len Number of bytes
+ * @return TRUE if queued, FALSE if the queue would exceed OUT_QUEUE_LIMIT or memory ran out
+ */
+int append_output(out_queue *queue, const char *data, size_t len);
+
+/**
+ * Writes as much of the queue as the socket accepts without blocking, up to
+ * OUT_QUEUE_MAX_IOV messages per sendmsg call.
+ *
+ * @param queue The queue
+ * @param socket The destination socket (blocking or not)
+ * @return OUTPUT_DRAINED if the queue is empty, OUTPUT_PENDING if the socket is full,
+ *         OUTPUT_FAILED on a write error
+ */
+int write_output(out_queue *queue, int socket);
+
+/**
+ * Frees every queued message.
+ *
+ * @param queue The queue
+ */
+void discard_output(out_queue *queue);
+
+/**
+ * Starts the thread that finishes writes to thread-mode clients whose sockets were full.
+ *
+ * @return TRUE if the writer was started, FALSE otherwise
+ */
+int start_output_writer();
+
+/**
+ * Queues a message for a thread-mode client. Inside an output batch the write is deferred
+ * to end_output_batch; otherwise it is attempted immediately. Whatever the socket does not
+ * accept is finished by the output writer. A client over OUT_QUEUE_LIMIT is shut down.
+ *
+ * @param cl The destination client
+ * @param data The message bytes
+ * @param len Number of bytes
+ */
+void queue_client_output(client *cl, const char *data, size_t len);
+
+/**
+ * Starts collecting the output of the calling thread; batches may nest.
+ */
+void begin_output_batch();
+
+/**
+ * Ends a batch started by begin_output_batch and writes the output queued by the calling
+ * thread, one sendmsg per client.
+ */
+void end_output_batch();
+
+/**
+ * Drops the pending output of a thread-mode client that is being detached and
+ * stops the writer from waiting on its socket.
+ *
+ * @param cl The client
+ */
+void close_client_output(client *cl);
+
+#endif
@@ -1,11 +1,22 @@
 #include "player_manager.h"
 #include <stdio.h>
-#include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
 #include "def_n_struct.h"
 #include "network_interface.h"
+#include "event_loop.h"
+#include "outbound.h"
+#include "timer_wheel.h"
+#include "slab_pool.h"
+#include "message_builder.h"
+#include "match_manager.h"
+#include "game_snapshot.h"
+#include "server_metrics.h"
+#include "server_log.h"
 
 /**
  * Mutex used to safely synchronize access to the global clients array.
@@ -13,86 +24,263 @@
 pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Global array storing all current client pointers (NULL if slot is free).
+ * Global array storing all current client pointers (NULL if slot is free), indexed by client id.
  */
-client *clients[MAX_CLIENTS] = {0};
+client **clients = NULL;
 
 /**
- * Prints a list of clients, showing their IDs, assigned game ID, and socket descriptor.
+ * Capacity of the clients array.
  */
-void display_all_clients() {
+int clients_capacity = 0;
+
+/**
+ * One past the highest slot ever handed out; loops over clients stop here.
+ */
+int clients_high_water = 0;
+
+/**
+ * Liveness and matchmaking state of every client slot (see client_hot), cache-line aligned.
+ */
+client_hot *client_hot_table = NULL;
+
+/**
+ * Clients indexed by socket descriptor (NULL if no client uses the descriptor).
+ */
+static client **g_clientsByFd = NULL;
+static int g_fdTableSize = 0;
+
+/**
+ * Registered clients indexed by username: open addressing with linear probing, at least twice
+ * as many buckets as the pool has clients. Protected by clients_mutex; a name maps to the
+ * session that logged in last.
+ */
+static client **g_nameIndex = NULL;
+static unsigned int g_nameIndexMask = 0;
+
+/**
+ * Pool holding every client; a client's id is its slot. The pool is larger than the number of
+ * clients that may be registered, because a detached client stays allocated while another
+ * thread still holds a reference to it.
+ */
+static slab_pool g_clientPool;
+
+/**
+ * Maximum number of registered clients.
+ */
+static int g_maxClients = 0;
+
+/**
+ * Number of registered clients (live counter, written under clients_mutex).
+ */
+static int g_connectedCount = 0;
+
+/**
+ * Allocates the client tables and raises the descriptor limit to its hard maximum,
+ * which also sizes the socket-indexed table.
+ *
+ * @param max_clients Capacity of the clients array
+ * @return TRUE on success, FALSE if the tables could not be allocated
+ */
+int init_client_registry(int max_clients) {
+    struct rlimit fdLimit;
+    if (getrlimit(RLIMIT_NOFILE, &fdLimit) == 0) {
+        fdLimit.rlim_cur = fdLimit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fdLimit);
+        getrlimit(RLIMIT_NOFILE, &fdLimit);
+        g_fdTableSize = fdLimit.rlim_cur == RLIM_INFINITY ? max_clients * 2 : (int) fdLimit.rlim_cur;
+    } else {
+        g_fdTableSize = max_clients * 2;
+    }
+
+    int poolCapacity = max_clients * CLIENT_POOL_FACTOR;
+    unsigned int buckets = 1;
+    while (buckets < 2u * (unsigned int) poolCapacity) {
+        buckets <<= 1;
+    }
+    g_nameIndex = calloc(buckets, sizeof(client *));
+    g_nameIndexMask = buckets - 1;
+    clients = calloc(poolCapacity, sizeof(client *));
+    g_clientsByFd = calloc(g_fdTableSize, sizeof(client *));
+    client_hot_table = aligned_alloc(64, poolCapacity * sizeof(client_hot));
+    if (clients == NULL || g_clientsByFd == NULL || client_hot_table == NULL || g_nameIndex == NULL ||
+        !init_slab_pool(&g_clientPool, sizeof(client), poolCapacity)) {
+        perror("Failed to allocate the client tables");
+        return FALSE;
+    }
+    memset(client_hot_table, 0, poolCapacity * sizeof(client_hot));
+
+    clients_capacity = poolCapacity;
+    g_maxClients = max_clients;
+    return TRUE;
+}
+
+/**
+ * Returns the number of currently connected clients (constant time).
+ *
+ * @return The count of connected clients
+ */
+int get_connected_clients_count() {
+    return __atomic_load_n(&g_connectedCount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief FNV-1a hash of a username.
+ * @param name The name
+ * @param len Length of the name
+ * @return The hash
+ */
+static unsigned int hash_username(const char *name, int len) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the bucket of a username: the one holding it, or the empty one ending its probe
+ *        sequence. The caller holds clients_mutex.
+ * @param name The name
+ * @param len Length of the name
+ * @return The bucket
+ */
+static client **find_name_bucket(const char *name, int len) {
+    unsigned int idx = hash_username(name, len) & g_nameIndexMask;
+    while (g_nameIndex[idx] != NULL &&
+           (g_nameIndex[idx]->username_len != len || memcmp(g_nameIndex[idx]->username, name, (size_t) len) != 0)) {
+        idx = (idx + 1) & g_nameIndexMask;
+    }
+    return &g_nameIndex[idx];
+}
+
+/**
+ * @brief Removes a client from the username index if it is the session indexed under its name.
+ *        The following entries of the probe sequence are shifted back, so no tombstones are left.
+ *        The caller holds clients_mutex.
+ * @param cl The client
+ */
+static void unindex_username(client *cl) {
+    client **bucket = find_name_bucket(cl->username, cl->username_len);
+    if (*bucket != cl) {
+        return;
+    }
+
+    unsigned int hole = (unsigned int) (bucket - g_nameIndex);
+    unsigned int idx = hole;
+    while (1) {
+        idx = (idx + 1) & g_nameIndexMask;
+        client *entry = g_nameIndex[idx];
+        if (entry == NULL) {
+            break;
+        }
+        // An entry may fill the hole unless its home bucket lies cyclically in (hole, idx]
+        unsigned int home = hash_username(entry->username, entry->username_len) & g_nameIndexMask;
+        if (((idx - home) & g_nameIndexMask) >= ((idx - hole) & g_nameIndexMask)) {
+            g_nameIndex[hole] = entry;
+            hole = idx;
+        }
+    }
+    g_nameIndex[hole] = NULL;
+}
+
+/**
+ * Writes a list of clients, showing their IDs, assigned game ID, and socket descriptor.
+ */
+void display_all_clients(FILE *out) {
     pthread_mutex_lock(&clients_mutex);
-    printf("Connected clients:\n");
-    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+    fprintf(out, "Connected clients:\n");
+    for (int idx = 0; idx < clients_high_water; idx++) {
         if (clients[idx] != NULL) {
-            printf("    Client: %d; Game: %d; Socket: %d\n",
-                   clients[idx]->id,
-                   clients[idx]->active_game_id,
-                   clients[idx]->socket);
+            game_handle currentGame = __atomic_load_n(&client_hot_table[idx].current_game, __ATOMIC_RELAXED);
+            fprintf(out, "    Client: %d; Game: %d; Socket: %d\n",
+                    clients[idx]->id,
+                    currentGame != NULL_HANDLE ? handle_slot(currentGame) : -1,
+                    clients[idx]->socket);
         }
     }
     pthread_mutex_unlock(&clients_mutex);
 }
 
 /**
- * Registers a new client by inserting its reference into the global array,
- * provided the array is not full and no client with the same socket exists.
+ * Registers a new client by inserting its reference into the global array, the socket table and
+ * the username index, provided the array is not full and no client with the same socket exists.
+ * A session already registered under the same name is superseded: it leaves the index and is
+ * kept (with a reference) in previous_session until resume_previous_session takes it over.
  *
  * @param socket The client's socket descriptor
  * @param username The chosen username for this client
+ * @param protocol The encoding chosen at LOGIN (PROTOCOL_TEXT or PROTOCOL_BINARY)
  * @param thread Reference to the pthread managing this client
  * @return TRUE if successfully added; FALSE otherwise
  */
-int register_client(int socket, char *username, pthread_t *thread) {
-    // First, ensure no existing client with the same socket
-    if (locate_client_by_socket(socket) != NULL) {
+int register_client(int socket, char *username, int protocol, pthread_t *thread) {
+    if (socket < 0 || socket >= g_fdTableSize) {
         return FALSE;
     }
 
     pthread_mutex_lock(&clients_mutex);
 
-    // Check the current number of active slots
-    int connectedCount = 0;
-    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
-        if (clients[idx] != NULL) {
-            connectedCount++;
-        }
-    }
-
-    // If array is already at capacity, fail
-    if (connectedCount >= MAX_CLIENTS) {
+    // Ensure no existing client with the same socket and room for another client
+    if (g_clientsByFd[socket] != NULL || g_connectedCount >= g_maxClients) {
         pthread_mutex_unlock(&clients_mutex);
         return FALSE;
     }
 
-    // Allocate memory for a new client struct
-    client *pNewClient = malloc(sizeof(client));
+    // Take a client struct from the pool
+    client_handle handle;
+    client *pNewClient = slab_alloc(&g_clientPool, &handle);
     if (pNewClient == NULL) {
-        perror("Failed to allocate memory for client");
+        log_warn("Client pool exhausted");
         pthread_mutex_unlock(&clients_mutex);
         return FALSE;
     }
 
     // Initialize fields
+    int idx = handle_slot(handle);
+    client_hot *hot = &client_hot_table[idx];
+    pNewClient->id = idx;
+    pNewClient->handle = handle;
+    pNewClient->hot = hot;
     pNewClient->socket = socket;
     strcpy(pNewClient->username, username);
-    pNewClient->active_game_id = GAME_NULL_ID;
+    pNewClient->username_len = (int) strlen(username);
+    pNewClient->protocol = protocol;
     pNewClient->is_in_game = FALSE;
-    pNewClient->is_connected = TRUE;
-    pNewClient->need_reconnect_mess = FALSE;
-    pNewClient->last_ping = time(NULL);
+    hot->is_connected = TRUE;
+    hot->need_reconnect_mess = FALSE;
+    hot->last_seen = monotonic_ms();
+    init_timer(&pNewClient->ping_timer, pNewClient);
+    init_timer(&pNewClient->zombie_timer, pNewClient);
     pNewClient->client_char = EMPTY_CHAR;
-    pNewClient->opponent = NULL;
+    hot->is_requesting_game = FALSE;
+    hot->requested_board_size = DEFAULT_BOARD_SIZE;
+    hot->opponent = NULL_HANDLE;
+    hot->current_game = NULL_HANDLE;
     pNewClient->client_thread = thread;
+    pNewClient->conn = NULL;
+    pNewClient->refs = 1;
+    pNewClient->is_detached = FALSE;
+    pthread_mutex_init(&pNewClient->out_lock, NULL);
+    init_out_queue(&pNewClient->out);
+    pNewClient->out_armed = FALSE;
+    pNewClient->out_next_retired = NULL;
+
+    // Take the name over from a session that is still registered (constant time, no scan)
+    client **nameBucket = find_name_bucket(username, pNewClient->username_len);
+    pNewClient->previous_session = *nameBucket;
+    if (pNewClient->previous_session != NULL) {
+        retain_client(pNewClient->previous_session);
+    }
+    *nameBucket = pNewClient;
 
-    // Insert the new client into the global array
-    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
-        if (clients[idx] == NULL) {
-            pNewClient->id = idx;
-            clients[idx] = pNewClient;
-            break;
-        }
+    // Insert the new client into the global array and the socket table
+    clients[idx] = pNewClient;
+    if (idx >= clients_high_water) {
+        clients_high_water = idx + 1;
     }
+    __atomic_store_n(&g_clientsByFd[socket], pNewClient, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_connectedCount, g_connectedCount + 1, __ATOMIC_RELAXED);
+    count_metric(METRIC_LOGINS, 1);
 
     pthread_mutex_unlock(&clients_mutex);
     return TRUE;
@@ -106,7 +294,7 @@ int register_client(int socket, char *username, pthread_t *thread) {
  */
 void set_game_request(client *cl, int want_game) {
     pthread_mutex_lock(&clients_mutex);
-    cl->is_requesting_game = want_game;
+    cl->hot->is_requesting_game = want_game;
     pthread_mutex_unlock(&clients_mutex);
 }
 
@@ -117,98 +305,220 @@ void set_game_request(client *cl, int want_game) {
  */
 void reset_client_game_data(client *cl) {
     pthread_mutex_lock(&clients_mutex);
-    cl->active_game_id = GAME_NULL_ID;
     cl->is_in_game = FALSE;
     cl->client_char = EMPTY_CHAR;
-    cl->opponent = NULL;
+    cl->hot->opponent = NULL_HANDLE;
+    __atomic_store_n(&cl->hot->current_game, NULL_HANDLE, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&clients_mutex);
 }
 
 /**
- * Updates the client's connection status and last ping timestamp.
+ * Creates a game between a waiting client and the requesting client and configures both.
+ * The board size is the one requested by both clients.
+ * The waiting client is notified with START_GAME; the requester is answered by the caller.
+ * The caller must own both clients (the matchmaker in thread mode, the shard's reactor in epoll mode).
+ *
+ * @param waiting The client who has been waiting for an opponent
+ * @param cl The client ready to play
+ * @return TRUE if the game was created; FALSE otherwise
+ */
+int start_match(client *waiting, client *cl) {
+    game *newMatch = initiate_game_session(waiting, cl, cl->hot->requested_board_size);
+    if (newMatch == NULL) {
+        return FALSE;
+    }
+
+    // Configure the waiting client (they become 'X')
+    waiting->client_char = FIRST_PL_CHAR;
+    waiting->is_in_game = TRUE;
+    waiting->hot->opponent = cl->handle;
+    __atomic_store_n(&waiting->hot->current_game, newMatch->handle, __ATOMIC_RELEASE);
+    waiting->hot->is_requesting_game = FALSE;
+
+    // Configure the new client (they become 'O')
+    cl->client_char = SECOND_PL_CHAR;
+    cl->is_in_game = FALSE;
+    cl->hot->opponent = waiting->handle;
+    __atomic_store_n(&cl->hot->current_game, newMatch->handle, __ATOMIC_RELEASE);
+    cl->hot->is_requesting_game = FALSE;
+
+    long long now = metrics_clock_ns();
+    record_latency(LATENCY_MATCH_WAIT, now - waiting->join_requested_at, 1);
+    record_latency(LATENCY_MATCH_WAIT, now - cl->join_requested_at, 1);
+    count_metric(METRIC_GAMES_STARTED, 1);
+
+    // Notify the waiting client
+    message_buffer startMsg;
+    init_message(&startMsg, waiting->protocol);
+    build_start_game(&startMsg, cl, waiting->is_in_game);
+    transmit_bytes(waiting, startMsg.data, startMsg.len);
+
+    return TRUE;
+}
+
+/**
+ * Moves a superseded session's seat in its game to the client that logged in under the same
+ * name: the game, the opponent and the turn refer to the new client from now on, and the old
+ * session no longer has a game. Runs under the game's lock, so a move of either session is
+ * either finished before or rejected after. The caller must own both clients and the opponent.
+ *
+ * @param previous The superseded session
+ * @param cl The client taking its place
+ * @return TRUE if a game was taken over; FALSE if the previous session had none
+ */
+int take_over_session(client *previous, client *cl) {
+    game *g = lock_client_game(previous);
+    if (g == NULL) {
+        return FALSE;
+    }
+
+    if (g->player1 == previous->handle) {
+        g->player1 = cl->handle;
+    } else {
+        g->player2 = cl->handle;
+    }
+    if (g->current_player == previous->handle) {
+        g->current_player = cl->handle;
+    }
+
+    cl->client_char = previous->client_char;
+    cl->is_in_game = previous->is_in_game;
+    cl->hot->opponent = previous->hot->opponent;
+    cl->hot->is_requesting_game = FALSE;
+    __atomic_store_n(&cl->hot->current_game, g->handle, __ATOMIC_RELEASE);
+
+    client *opponent = get_opponent(cl);
+    if (opponent != NULL) {
+        opponent->hot->opponent = cl->handle;
+    }
+    unlock_game(g);
+
+    // The old session leaves without ending the game
+    reset_client_game_data(previous);
+    return TRUE;
+}
+
+int claim_restored_seat(client *cl) {
+    restored_seat seat;
+    if (!lock_restored_seat(cl->username, cl->username_len, &seat)) {
+        return FALSE;
+    }
+
+    __atomic_store_n(&cl->hot->current_game, seat.game, __ATOMIC_RELEASE);
+    game *g = lock_client_game(cl);
+    if (g == NULL) {
+        // The game ended while the seat was free
+        __atomic_store_n(&cl->hot->current_game, NULL_HANDLE, __ATOMIC_RELEASE);
+        release_restored_seat(&seat, FALSE);
+        return FALSE;
+    }
+
+    client_handle opponentHandle;
+    if (seat.seat == 0) {
+        g->player1 = cl->handle;
+        opponentHandle = g->player2;
+    } else {
+        g->player2 = cl->handle;
+        opponentHandle = g->player1;
+    }
+    cl->client_char = seat.seat == 0 ? FIRST_PL_CHAR : SECOND_PL_CHAR;
+    cl->is_in_game = seat.seat == 0;
+    cl->hot->is_requesting_game = FALSE;
+    log_info("Client %d claims seat %d of restored game %d", cl->id, seat.seat, handle_slot(seat.game));
+
+    int complete = opponentHandle != NULL_HANDLE;
+    if (complete) {
+        g->current_player = seat.on_turn == 0 ? g->player1 : g->player2;
+        cl->hot->opponent = opponentHandle;
+        client *opponent = get_opponent(cl);
+        if (opponent != NULL) {
+            opponent->hot->opponent = cl->handle;
+            __atomic_store_n(&opponent->hot->need_reconnect_mess, FALSE, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&cl->hot->need_reconnect_mess, TRUE, __ATOMIC_RELAXED);
+    }
+    unlock_game(g);
+
+    release_restored_seat(&seat, TRUE);
+    return complete;
+}
+
+/**
+ * Reports the shard of a client as long as it is registered; the connection of a detached
+ * client may already be released by its reactor.
  *
  * @param cl The client
- * @param is_connected TRUE if the client is connected; FALSE otherwise
+ * @param shard Receives the shard index (see client_shard)
+ * @return TRUE if the client is registered, FALSE once it has been detached
  */
-void update_client_ping(client *cl, int is_connected) {
+int locate_registered_shard(client *cl, int *shard) {
     pthread_mutex_lock(&clients_mutex);
-    cl->is_connected = is_connected;
-    cl->last_ping = time(NULL);
+    int registered = clients[cl->id] == cl;
+    if (registered) {
+        *shard = cl->conn != NULL ? __atomic_load_n(&cl->conn->shard, __ATOMIC_ACQUIRE) : NO_SHARD;
+    }
     pthread_mutex_unlock(&clients_mutex);
+    return registered;
 }
 
 /**
- * Attempts to find another client who is waiting for a match. If successful,
- * sets up a new game for both the waiting client and the requesting client.
+ * Returns the client registered in the given slot.
  *
- * @param cl The client ready to play
- * @return TRUE if a waiting opponent was found and a game starts; FALSE otherwise
+ * @param id The client identifier (slot index)
+ * @return Pointer to the client, or NULL if the slot is free or out of range
  */
-int match_waiting_opponent(client *cl) {
-    pthread_mutex_lock(&clients_mutex);
-    int wasFound = FALSE;
-
-    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
-        // Ensure we have a different client, no game in progress, and the client wants a game
-        if (clients[idx] != NULL &&
-            strcmp(clients[idx]->username, cl->username) != 0 &&
-            clients[idx]->active_game_id == GAME_NULL_ID &&
-            clients[idx]->is_requesting_game == TRUE) {
-
-            // Create a game with the first waiting client
-            game *newMatch = initiate_game_session(clients[idx], cl);
-            if (newMatch == NULL) {
-                break;
-            }
-
-            // Configure the waiting client (they become 'X')
-            clients[idx]->client_char = FIRST_PL_CHAR;
-            clients[idx]->is_in_game = TRUE;
-            clients[idx]->active_game_id = newMatch->id;
-            clients[idx]->opponent = cl;
-            clients[idx]->is_requesting_game = FALSE;
-
-            // Configure the new client (they become 'O')
-            cl->client_char = SECOND_PL_CHAR;
-            cl->is_in_game = FALSE;
-            cl->active_game_id = newMatch->id;
-            cl->opponent = clients[idx];
-            cl->is_requesting_game = FALSE;
-
-            // Notify the waiting client
-            char buffer[START_GAME_MESSAGE_SIZE] = {0};
-            sprintf(buffer, "START_GAME;%s;%c;%c\n",
-                    clients[idx]->opponent->username,
-                    clients[idx]->opponent->client_char,
-                    clients[idx]->is_in_game ? '1' : '0');
-            transmit_message(clients[idx], buffer);
-
-            wasFound = TRUE;
-            break;
-        }
+client *fetch_client_by_id(int id) {
+    if (id < 0 || id >= clients_capacity) {
+        return NULL;
     }
-
+    pthread_mutex_lock(&clients_mutex);
+    client *pMatch = clients[id];
     pthread_mutex_unlock(&clients_mutex);
-    return wasFound;
+    return pMatch;
+}
+
+/**
+ * Returns the client a handle refers to (constant time).
+ *
+ * @param handle The client's handle
+ * @return Pointer to the client, or NULL if the handle is stale or NULL_HANDLE
+ */
+client *resolve_client(client_handle handle) {
+    return slab_resolve(&g_clientPool, handle);
 }
 
 /**
- * Locates and returns a reference to a client object by its socket descriptor.
+ * Returns the client's current opponent.
+ *
+ * @param cl The client
+ * @return Pointer to the opponent, or NULL if the client has none or the opponent is gone
+ */
+client *get_opponent(client *cl) {
+    return slab_resolve(&g_clientPool, cl->hot->opponent);
+}
+
+/**
+ * Returns the reactor shard serving the client.
+ *
+ * @param cl The client
+ * @return The shard index, NO_SHARD in thread mode or SHARD_IN_TRANSIT during a handoff
+ */
+int client_shard(client *cl) {
+    return cl->conn != NULL ? cl->conn->shard : NO_SHARD;
+}
+
+/**
+ * Locates and returns a reference to a client object by its socket descriptor (constant time).
  *
  * @param socket The socket descriptor
  * @return Pointer to the found client, or NULL if none match
  */
 client *locate_client_by_socket(int socket) {
-    pthread_mutex_lock(&clients_mutex);
-    client *pMatch = NULL;
-    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
-        if (clients[idx] != NULL && clients[idx]->socket == socket) {
-            pMatch = clients[idx];
-            break;
-        }
+    if (socket < 0 || socket >= g_fdTableSize) {
+        return NULL;
     }
-    pthread_mutex_unlock(&clients_mutex);
-    return pMatch;
+    return __atomic_load_n(&g_clientsByFd[socket], __ATOMIC_ACQUIRE);
 }
 
 /**
@@ -227,7 +537,35 @@ int detach_client_by_socket(int socket) {
 
 
 /**
- * Removes the specified client from the global array, closes its socket, and frees its memory.
+ * Takes an additional reference on a client so that it outlives detach_client.
+ *
+ * @param cl The client
+ */
+void retain_client(client *cl) {
+    __atomic_add_fetch(&cl->refs, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Drops a reference on a client and frees it when the last one is gone.
+ *
+ * @param cl The client
+ */
+void release_client(client *cl) {
+    if (__atomic_sub_fetch(&cl->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        // A superseded session that was never resumed
+        if (cl->previous_session != NULL) {
+            release_client(cl->previous_session);
+        }
+        discard_output(&cl->out);
+        pthread_mutex_destroy(&cl->out_lock);
+        slab_free(&g_clientPool, cl->handle);
+    }
+}
+
+/**
+ * Removes the specified client from the global array, closes its socket (in thread mode only
+ * shuts it down; the client thread closes it when it ends), and frees its memory once no
+ * other reference (see retain_client) is left.
  *
  * @param cl The client to remove
  * @return TRUE if the client was found and removed; FALSE otherwise
@@ -235,28 +573,39 @@ int detach_client_by_socket(int socket) {
 int detach_client(client *cl) {
     pthread_mutex_lock(&clients_mutex);
 
-    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
-        if (clients[idx] == cl) {
-            printf("Remove client: %d found\n", cl->id);
-
-            // Close the socket
-            close(cl->socket);
-            printf("Remove client: %d socket closed\n", cl->id);
+    if (cl->id < 0 || cl->id >= clients_capacity || clients[cl->id] != cl) {
+        pthread_mutex_unlock(&clients_mutex);
+        return FALSE;
+    }
+    log_debug("Remove client: %d found", cl->id);
 
-            // Free the structure and nullify the pointer
-            free(clients[idx]);
-            clients[idx] = NULL;
+    // Close the socket (through the reactor when it owns the connection)
+    if (g_clientsByFd[cl->socket] == cl) {
+        __atomic_store_n(&g_clientsByFd[cl->socket], NULL, __ATOMIC_RELEASE);
+    }
+    unindex_username(cl);
+    __atomic_store_n(&cl->is_detached, TRUE, __ATOMIC_RELEASE);
+    disarm_liveness_timers(cl);
+    if (cl->conn != NULL) {
+        withdraw_match_request(cl);
+        close_connection(cl->conn);
+    } else {
+        // Wakes the client thread, which closes the socket once it is done with it
+        close_client_output(cl);
+        shutdown(cl->socket, SHUT_RDWR);
+    }
+    log_debug("Remove client: %d socket closed", cl->id);
 
-            pthread_mutex_unlock(&clients_mutex);
+    // Nullify the pointer; the slot returns to the pool with the last reference
+    clients[cl->id] = NULL;
+    __atomic_store_n(&g_connectedCount, g_connectedCount - 1, __ATOMIC_RELAXED);
+    count_metric(METRIC_DISCONNECTS, 1);
 
-            display_all_clients();
-            return TRUE;
-        }
-    }
     pthread_mutex_unlock(&clients_mutex);
 
-    display_all_clients();
-    return FALSE;
+    // Free the structure unless the matchmaker, the output writer or the client thread still holds it
+    release_client(cl);
+    return TRUE;
 }
 
 
@@ -270,12 +619,16 @@ int detach_client(client *cl) {
 void *client_thread_main(void *arg) {
     client *pClient = (client *) arg;
 
-    char tempBuff[LOGIN_MESSAGE_RESP_SIZE] = {0};
-    sprintf(tempBuff, "LOGIN;%s\n", pClient->username);
-    transmit_message(pClient, tempBuff);
+    arm_liveness_timers(pClient);
+    confirm_login(pClient);
+    resume_previous_session(pClient);
 
     // This function does not return until the client disconnects or an error occurs
     listen_for_messages(pClient);
+
+    // The client is detached by now; drop the reference taken for this thread
+    close(pClient->socket);
+    release_client(pClient);
     return NULL;
 }
 
@@ -1,6 +1,7 @@
 #ifndef __PLAYER_MANAGER_H__
 #define __PLAYER_MANAGER_H__
 
+#include <stdio.h>
 #include <pthread.h>
 #include "def_n_struct.h"
 #include "match_manager.h"
@@ -11,19 +12,76 @@
 extern pthread_mutex_t clients_mutex;
 
 /**
- * Global array holding pointers to all connected clients (up to MAX_CLIENTS).
+ * Global array holding pointers to all connected clients, indexed by client id (NULL if free).
  */
-extern client *clients[MAX_CLIENTS];
+extern client **clients;
 
 /**
- * Attempts to register a new client into the global clients array.
+ * Liveness and matchmaking state of every client slot, indexed by client id like clients
+ * (see client_hot); a client reaches its own entry through client::hot.
+ */
+extern client_hot *client_hot_table;
+
+/**
+ * Capacity of the clients array (the size of the client pool).
+ */
+extern int clients_capacity;
+
+/**
+ * One past the highest slot ever handed out; loops over clients stop here.
+ */
+extern int clients_high_water;
+
+/**
+ * Allocates the client tables and raises the descriptor limit to its hard maximum,
+ * which also sizes the socket-indexed table.
+ *
+ * @param max_clients Maximum number of registered clients
+ * @return TRUE on success, FALSE if the tables could not be allocated
+ */
+int init_client_registry(int max_clients);
+
+/**
+ * Attempts to register a new client into the global clients array and the username index.
+ * A session registered under the same name is superseded and kept in previous_session
+ * (see resume_previous_session).
  *
  * @param socket The socket descriptor for the new client
  * @param username The username of the new client
- * @param thread A reference to the thread handling this client
+ * @param protocol The encoding chosen at LOGIN (PROTOCOL_TEXT or PROTOCOL_BINARY)
+ * @param thread A reference to the thread handling this client, or NULL when served by the reactor
  * @return TRUE if the client was successfully added; FALSE if it already exists or the array is full
  */
-int register_client(int socket, char *username, pthread_t *thread);
+int register_client(int socket, char *username, int protocol, pthread_t *thread);
+
+/**
+ * Moves a superseded session's seat in its game to the client that logged in under its name.
+ *
+ * @param previous The superseded session
+ * @param cl The client taking its place
+ * @return TRUE if a game was taken over; FALSE if the previous session had none
+ */
+int take_over_session(client *previous, client *cl);
+
+/**
+ * Seats a client in the restored game that holds a seat under its username (see
+ * game_snapshot.h). Once both seats are taken the players are linked and the game goes on;
+ * until then the client waits for its opponent with need_reconnect_mess set.
+ *
+ * @param cl The client that has just logged in
+ * @return TRUE if the client took the second seat (both players should get RECONNECT),
+ *         FALSE if it took the first one or holds no restored seat
+ */
+int claim_restored_seat(client *cl);
+
+/**
+ * Reports the shard of a client as long as it is registered.
+ *
+ * @param cl The client
+ * @param shard Receives the shard index (see client_shard)
+ * @return TRUE if the client is registered, FALSE once it has been detached
+ */
+int locate_registered_shard(client *cl, int *shard);
 
 /**
  * Resets the specified client's game-related fields, such as current game ID.
@@ -33,23 +91,51 @@ int register_client(int socket, char *username, pthread_t *thread);
 void reset_client_game_data(client *cl);
 
 /**
- * Updates ping information for the specified client.
+ * Creates a game between a waiting client and the requesting client and configures both.
+ * The board size is the one requested by both clients.
+ * The waiting client is notified with START_GAME; the requester is answered by the caller.
+ * The caller must own both clients (the matchmaker in thread mode, the shard's reactor in epoll mode).
  *
- * @param cl The client to be updated
- * @param is_connected TRUE if the client is currently connected, FALSE otherwise
+ * @param waiting The client who has been waiting for an opponent
+ * @param cl The client ready to play
+ * @return TRUE if the game was created; FALSE otherwise
  */
-void update_client_ping(client *cl, int is_connected);
+int start_match(client *waiting, client *cl);
 
 /**
- * Searches for a client who is already waiting for an opponent; if found, creates a new game.
+ * Returns the client registered in the given slot.
  *
- * @param cl The client ready to play
- * @return TRUE if a waiting opponent was found and a game can start; FALSE otherwise
+ * @param id The client identifier (slot index)
+ * @return Pointer to the client, or NULL if the slot is free or out of range
+ */
+client *fetch_client_by_id(int id);
+
+/**
+ * Returns the client a handle refers to (constant time).
+ *
+ * @param handle The client's handle
+ * @return Pointer to the client, or NULL if the handle is stale or NULL_HANDLE
+ */
+client *resolve_client(client_handle handle);
+
+/**
+ * Returns the client's current opponent.
+ *
+ * @param cl The client
+ * @return Pointer to the opponent, or NULL if the client has none or the opponent is gone
+ */
+client *get_opponent(client *cl);
+
+/**
+ * Returns the reactor shard serving the client.
+ *
+ * @param cl The client
+ * @return The shard index, NO_SHARD in thread mode or SHARD_IN_TRANSIT during a handoff
  */
-int match_waiting_opponent(client *cl);
+int client_shard(client *cl);
 
 /**
- * Retrieves a client that has the given socket descriptor.
+ * Retrieves a client that has the given socket descriptor (constant time).
  *
  * @param socket The socket descriptor
  * @return The client pointer if found; NULL otherwise
@@ -57,19 +143,38 @@ int match_waiting_opponent(client *cl);
 client *locate_client_by_socket(int socket);
 
 /**
- * Returns the number of currently connected clients.
+ * Returns the number of currently connected clients (constant time).
  *
  * @return The count of connected clients
  */
 int get_connected_clients_count();
 
 /**
- * Prints a summary of all registered clients to stdout.
+ * Writes a summary of all registered clients (takes clients_mutex while writing).
+ *
+ * @param out The stream to write to
+ */
+void display_all_clients(FILE *out);
+
+/**
+ * Takes an additional reference on a client so that its structure outlives detach_client.
+ *
+ * @param cl The client
+ */
+void retain_client(client *cl);
+
+/**
+ * Drops a reference taken by retain_client (or the registry's own) and frees the client
+ * when none is left.
+ *
+ * @param cl The client
  */
-void display_all_clients();
+void release_client(client *cl);
 
 /**
- * Removes a specific client from the global clients array and closes its socket.
+ * Removes a specific client from the global clients array and closes its socket (a thread-mode
+ * client's socket is only shut down; its thread closes it).
+ * The structure is freed once the last reference is released.
  *
  * @param cl The client to be removed
  * @return TRUE if the client was removed; FALSE if it wasn't found
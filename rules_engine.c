@@ -1,211 +1,364 @@
 #include "rules_engine.h"
 #include "match_manager.h"
+#include "slab_pool.h"
+#include "game_snapshot.h"
+#include "move_journal.h"
+#include "server_log.h"
 #include <stdio.h>
+#include <stdlib.h>
 
+/**
+ * Direction indexes used by the shift helpers.
+ */
+enum {
+    DIR_EAST, DIR_WEST, DIR_SOUTH, DIR_NORTH,
+    DIR_SOUTH_EAST, DIR_SOUTH_WEST, DIR_NORTH_EAST, DIR_NORTH_WEST,
+    DIR_COUNT
+};
 
 /**
- * Helper function to check if a move is valid for a player in a specific direction.
+ * Column and row steps of every direction.
  */
-int is_valid_move(char player_char, int x, int y, int dx, int dy, game *g) {
-    char opponent_char = (player_char == 'R') ? 'B' : 'R';
-    int i = x + dx;
-    int j = y + dy;
-    int found_opponent = 0;
-
-    // Step through the direction
-    while (i >= 0 && i < BOARD_SIZE && j >= 0 && j < BOARD_SIZE) {
-        if (g->board[i][j] == opponent_char) {
-            found_opponent = 1;
-        } else if (g->board[i][j] == player_char) {
-            return found_opponent; // Valid move if opponent's stones are enclosed
-        } else {
-            break; // Empty or invalid space
-        }
-        i += dx;
-        j += dy;
+static const int g_directionSteps[DIR_COUNT][2] = {
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}
+};
+
+/**
+ * Helper function returning the index of the highest set bit of a 64-bit mask (b must not be 0).
+ */
+static inline int highest_bit_64(uint64_t b) {
+    return 63 - __builtin_clzll(b);
+}
+
+/**
+ * Helper function returning the index of the highest set bit of a 128-bit mask (b must not be 0).
+ */
+static inline int highest_bit_128(unsigned __int128 b) {
+    uint64_t high = (uint64_t) (b >> 64);
+    return high != 0 ? 127 - __builtin_clzll(high) : highest_bit_64((uint64_t) b);
+}
+
+#define highest_bit(b) _Generic((b), uint64_t: highest_bit_64, unsigned __int128: highest_bit_128)(b)
+
+/*
+ * One kernel per supported board size.
+ */
+#define KERNEL_SIZE 4
+#define KERNEL_BITS uint64_t
+#include "rules_kernel_impl.h"
+
+#define KERNEL_SIZE 6
+#define KERNEL_BITS uint64_t
+#include "rules_kernel_impl.h"
+
+#define KERNEL_SIZE 8
+#define KERNEL_BITS uint64_t
+#include "rules_kernel_impl.h"
+
+#define KERNEL_SIZE 10
+#define KERNEL_BITS unsigned __int128
+#include "rules_kernel_impl.h"
+
+void init_rules_engine() {
+    init_kernel_4();
+    init_kernel_6();
+    init_kernel_8();
+    init_kernel_10();
+}
+
+const rules_kernel *get_rules_kernel(int board_size) {
+    switch (board_size) {
+        case 4:  return &g_kernel_4;
+        case 6:  return &g_kernel_6;
+        case 8:  return &g_kernel_8;
+        case 10: return &g_kernel_10;
+        default: return NULL;
     }
-    return 0; // No valid move in this direction
 }
 
 /**
- * Helper function to get the opponent client.
+ * Helper function counting the discs of a bitboard.
  */
-client *get_opponent_client(client *cl, game *g) {
-    return (cl == g->player1) ? g->player2 : g->player1;
+static inline int count_bits(bitboard b) {
+    return __builtin_popcountll((uint64_t) b) + __builtin_popcountll((uint64_t) (b >> 64));
 }
 
 /**
- * @brief Validates the game status for the given client.
- *
- * This function checks if the current player has any available moves. If no moves are available,
- * it ends the game and determines the winner based on the current board state.
- *
- * @param cl Pointer to the client structure.
- * @param to_x The x-coordinate of the move.
- * @param to_y The y-coordinate of the move.
- * @return int Returns GAME_WIN if the game is won, GAME_DRAW if it's a draw, or 0 if the game continues.
+ * Helper function returning the index of the lowest set bit (b must not be 0).
  */
-int check_available_moves(client *cl) {
-    game *g = fetch_game_by_id(cl->active_game_id);
-    pthread_mutex_lock(&g_gamesMutex);
-
-    // Switch the player for opponent
-    cl = get_opponent_client(cl, g);
-
-    // Define directions: horizontal, vertical, and diagonals
-    int directions[8][2] = {
-            {1,  0},
-            {-1, 0},  // Horizontal
-            {0,  1},
-            {0,  -1},  // Vertical
-            {1,  1},
-            {-1, -1}, // Diagonal (\)
-            {1,  -1},
-            {-1, 1}  // Diagonal (/)
-    };
-
-    // Check if the current player has available moves
-    int available_moves = 0;
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            if (g->board[i][j] == EMPTY_CHAR) {
-                // Check all directions for a valid move
-                for (int d = 0; d < 8; d++) {
-                    int dx = directions[d][0];
-                    int dy = directions[d][1];
-                    if (is_valid_move(cl->client_char, i, j, dx, dy, g)) {
-                        available_moves++;
-                        break; // No need to check further directions
-                    }
-                }
+static inline int lowest_bit(bitboard b) {
+    uint64_t low = (uint64_t) b;
+    return low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (b >> 64));
+}
+
+/**
+ * Helper function mapping a player character to its index in game::discs.
+ */
+static inline int disc_index(char player_char) {
+    return player_char == FIRST_PL_CHAR ? 0 : 1;
+}
+
+void init_board_bits(game *g) {
+    g->discs[0] = 0;
+    g->discs[1] = 0;
+    for (int row = 0; row < g->board_size; row++) {
+        for (int col = 0; col < g->board_size; col++) {
+            bitboard cell = (bitboard) 1 << (row * g->board_size + col);
+            if (g->board[row][col] == FIRST_PL_CHAR) {
+                g->discs[0] |= cell;
+            } else if (g->board[row][col] == SECOND_PL_CHAR) {
+                g->discs[1] |= cell;
             }
         }
     }
+    init_legal_moves(g);
+}
 
-    // If the current player has no moves, end the game
-    if (available_moves == 0) {
-        g->game_status = GAME_OVER;
+void init_legal_moves(game *g) {
+    g->kernel->generate_both_moves(g->discs[0], g->discs[1], g->moves);
+}
 
-        // Count the score for both players
-        int score_X = 0, score_O = 0;
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (g->board[i][j] == 'R') score_X++;
-                else if (g->board[i][j] == 'B') score_O++;
+void init_board_chars(game *g) {
+    for (int row = 0; row < g->board_size; row++) {
+        for (int col = 0; col < g->board_size; col++) {
+            bitboard cell = (bitboard) 1 << (row * g->board_size + col);
+            if (g->discs[0] & cell) {
+                g->board[row][col] = FIRST_PL_CHAR;
+            } else if (g->discs[1] & cell) {
+                g->board[row][col] = SECOND_PL_CHAR;
+            } else {
+                g->board[row][col] = EMPTY_CHAR;
             }
         }
+    }
+}
 
-        // Determine the winner
-        if (score_X > score_O) {
-            g->winner = cl->client_char == 'R' ? get_opponent_client(cl, g) : cl;
-            pthread_mutex_unlock(&g_gamesMutex);
-            return GAME_WIN;
-        } else if (score_O > score_X) {
-            g->winner = cl->client_char == 'B' ? get_opponent_client(cl, g) : cl;
-            pthread_mutex_unlock(&g_gamesMutex);
-            return GAME_WIN;
-        } else {
-            g->winner = NULL; // It's a draw
-            pthread_mutex_unlock(&g_gamesMutex);
-            return GAME_DRAW;
+#ifdef RULES_CROSSCHECK
+/*
+ * Differential check of the bitboard engine against the former scalar engine, which walks the
+ * character board in 8 directions. Build with -DRULES_CROSSCHECK to verify every move the
+ * server handles; any disagreement aborts the server. "make crosscheck" builds rules_bench this
+ * way and runs its random playouts on every board size.
+ */
+/**
+ * Scalar reference: cells flipped by placing player_char at (x, y).
+ */
+static bitboard scalar_flips(const game *g, char player_char, int x, int y) {
+    char opponent_char = (player_char == FIRST_PL_CHAR) ? SECOND_PL_CHAR : FIRST_PL_CHAR;
+    int size = g->board_size;
+    bitboard flips = 0;
+
+    for (int d = 0; d < DIR_COUNT; d++) {
+        int dx = g_directionSteps[d][0];
+        int dy = g_directionSteps[d][1];
+        int nx = x + dx;
+        int ny = y + dy;
+        bitboard run = 0;
+
+        while (nx >= 0 && nx < size && ny >= 0 && ny < size && g->board[ny][nx] == opponent_char) {
+            run |= (bitboard) 1 << (ny * size + nx);
+            nx += dx;
+            ny += dy;
+        }
+        if (nx >= 0 && nx < size && ny >= 0 && ny < size && g->board[ny][nx] == player_char) {
+            flips |= run;
+        }
+    }
+    return flips;
+}
+
+/**
+ * Compares the bitboards with the character board and the move generator with the scalar engine.
+ */
+static void crosscheck_position(const game *g, char player_char) {
+    int own = disc_index(player_char);
+    bitboard scalarMoves = 0;
+
+    for (int y = 0; y < g->board_size; y++) {
+        for (int x = 0; x < g->board_size; x++) {
+            int cell = y * g->board_size + x;
+            bitboard cellBit = (bitboard) 1 << cell;
+            char expected = (g->discs[0] & cellBit) ? FIRST_PL_CHAR
+                                                     : (g->discs[1] & cellBit) ? SECOND_PL_CHAR : EMPTY_CHAR;
+            if (g->board[y][x] != expected) {
+                fprintf(stderr, "RULES_CROSSCHECK: board mismatch at %d;%d in game %d\n", x, y, handle_slot(g->handle));
+                abort();
+            }
+
+            if (g->board[y][x] != EMPTY_CHAR) {
+                continue;
+            }
+            bitboard flips = scalar_flips(g, player_char, x, y);
+            if (flips != 0) {
+                scalarMoves |= cellBit;
+            }
+            if (flips != g->kernel->compute_flips(g->discs[own], g->discs[1 - own], cell)) {
+                fprintf(stderr, "RULES_CROSSCHECK: flip mismatch at %d;%d in game %d\n", x, y, handle_slot(g->handle));
+                abort();
+            }
         }
     }
 
-    // Game continues if the player has available moves
-    pthread_mutex_unlock(&g_gamesMutex);
+    if (scalarMoves != g->kernel->generate_moves(g->discs[own], g->discs[1 - own])) {
+        fprintf(stderr, "RULES_CROSSCHECK: move generation mismatch in game %d\n", handle_slot(g->handle));
+        abort();
+    }
+    if (scalarMoves != g->moves[own]) {
+        fprintf(stderr, "RULES_CROSSCHECK: cached moves mismatch in game %d\n", handle_slot(g->handle));
+        abort();
+    }
+}
+#endif
 
-    return 0;
+/**
+ * Helper function to get the handle of the opponent client.
+ */
+client_handle get_opponent_handle(client *cl, game *g) {
+    return (cl->handle == g->player1) ? g->player2 : g->player1;
 }
 
+/**
+ * @brief Settles the game status after the client's accepted move. The caller holds the game's lock.
+ *
+ * The legal moves of both players were found by apply_move, so this is a lookup: the opponent
+ * moves next if it can, otherwise it passes and the client moves again. Only when neither
+ * player can move does the game end, and the winner is determined by counting the discs.
+ * A game that is already over is not ended again.
+ *
+ * @param g Pointer to the game structure.
+ * @param cl Pointer to the client structure.
+ * @param next_moves If not NULL, receives the legal targets of the player on turn next (the
+ *                   opponent, or the client itself when the opponent passes; none once the game is over).
+ * @return int Returns GAME_WIN if the game is won, GAME_DRAW if it's a draw, GAME_PASS if the
+ *         opponent passes, or 0 if the game continues with the opponent's move.
+ */
+int settle_game(game *g, client *cl, legal_squares *next_moves) {
+    int own = disc_index(cl->client_char);
+    if (next_moves != NULL) {
+        next_moves->cells = 0;
+        next_moves->board_size = g->board_size;
+    }
+
+#ifdef RULES_CROSSCHECK
+    crosscheck_position(g, FIRST_PL_CHAR);
+    crosscheck_position(g, SECOND_PL_CHAR);
+#endif
+
+    // If either player can still move, the game continues
+    if (g->moves[1 - own] != 0 || g->moves[own] != 0) {
+        int passes = g->moves[1 - own] == 0;
+        if (next_moves != NULL) {
+            next_moves->cells = g->moves[passes ? own : 1 - own];
+        }
+        return passes ? GAME_PASS : 0;
+    }
+
+    if (g->game_status != GAME_PLAYING) {
+        return g->winner != NULL_HANDLE ? GAME_WIN : GAME_DRAW;
+    }
+    g->game_status = GAME_OVER;
+    snapshot_game_over(g);
+
+    // Count the score for both players
+    int score_X = count_bits(g->discs[disc_index(FIRST_PL_CHAR)]);
+    int score_O = count_bits(g->discs[disc_index(SECOND_PL_CHAR)]);
+
+    // Determine the winner
+    int result;
+    if (score_X > score_O) {
+        g->winner = cl->client_char == FIRST_PL_CHAR ? cl->handle : get_opponent_handle(cl, g);
+        result = GAME_WIN;
+    } else if (score_O > score_X) {
+        g->winner = cl->client_char == SECOND_PL_CHAR ? cl->handle : get_opponent_handle(cl, g);
+        result = GAME_WIN;
+    } else {
+        g->winner = NULL_HANDLE; // It's a draw
+        result = GAME_DRAW;
+    }
+    journal_result(g, score_X > score_O ? 0 : score_O > score_X ? 1 : JOURNAL_NO_SEAT);
+    return result;
+}
 
 /**
  * @brief Validates a move for the given client.
  *
  * This function checks if the move to the specified coordinates is valid for the current player.
  * It ensures the move is within the board, the target field is empty, and the move encloses
- * the opponent's pieces in any direction.
+ * the opponent's pieces in at least one direction (a lookup in the game's cached legal moves).
+ *
+ * An accepted move is applied and the game status it leads to is settled under the same lock,
+ * so no other move can come in between (see settle_game); the legal targets sent along with the
+ * move are copied out under that lock too.
  *
  * @param cl Pointer to the client structure.
  * @param to_x The x-coordinate of the move.
  * @param to_y The y-coordinate of the move.
+ * @param outcome If not NULL, receives the status settle_game returned for an accepted move
+ *                (0 for a rejected one).
+ * @param next_moves If not NULL, receives the legal targets of the player on turn next after an
+ *                   accepted move (none after a rejected one).
  * @return int Returns TRUE if the move is valid, INVALID_MOVE if the move is invalid,
  *         GAME_NOT_FOUND if the game is not found, or NOT_MY_TURN if it's not the client's turn.
  */
-int validate_move(client *cl, int to_x, int to_y) {
-    // Fetch the game by client ID
-    game *g = fetch_game_by_id(cl->active_game_id);
-    if (g == NULL) {
-        return GAME_NOT_FOUND;
+int validate_move(client *cl, int to_x, int to_y, int *outcome, legal_squares *next_moves) {
+    if (outcome != NULL) {
+        *outcome = 0;
     }
-
-    if (g->game_status != GAME_PLAYING) {
-        return GAME_NOT_FOUND;
-    }
-
-    if (g->current_player != cl) {
-        return NOT_MY_TURN;
-    }
-
-    // Check if the move is within the board
-    if (to_x < 0 || to_x >= BOARD_SIZE || to_y < 0 || to_y >= BOARD_SIZE) {
-        return INVALID_MOVE;
+    if (next_moves != NULL) {
+        next_moves->cells = 0;
+        next_moves->board_size = 0;
     }
 
-    // The target field must be empty
-    if (g->board[to_y][to_x] != EMPTY_CHAR) {
-        return FIELD_TAKEN;
+    // Fetch and lock the game of the client
+    game *g = lock_client_game(cl);
+    if (g == NULL) {
+        return GAME_NOT_FOUND;
     }
 
-    char opponent_char = (cl->client_char == FIRST_PL_CHAR) ? SECOND_PL_CHAR : FIRST_PL_CHAR;
-    int valid = FALSE;
-
-    // Check all 8 directions
-    int directions[8][2] = {
-            {0,  1},
-            {1,  0},
-            {0,  -1},
-            {-1, 0}, // Vertical & horizontal
-            {1,  1},
-            {1,  -1},
-            {-1, 1},
-            {-1, -1} // Diagonal
-    };
-
-    for (int i = 0; i < 8; i++) {
-        int dx = directions[i][0];
-        int dy = directions[i][1];
-        int nx = to_x + dx;
-        int ny = to_y + dy;
-        int count = 0;
-
-        // Move in the direction and check for opponent's pieces
-        while (nx >= 0 && nx < BOARD_SIZE && ny >= 0 && ny < BOARD_SIZE && g->board[ny][nx] == opponent_char) {
-            nx += dx;
-            ny += dy;
-            count++;
-        }
+    int status = TRUE;
+    int own = disc_index(cl->client_char);
+    int cell = to_y * g->board_size + to_x;
 
-        // Ensure we end at the player's own piece after traversing opponent's pieces
-        if (count > 0 && nx >= 0 && nx < BOARD_SIZE && ny >= 0 && ny < BOARD_SIZE &&
-            g->board[ny][nx] == cl->client_char) {
-            valid = TRUE;
-            break; // No need to check further directions once a valid move is found
+    if (g->game_status != GAME_PLAYING) {
+        status = GAME_NOT_FOUND;
+    } else if (g->current_player != cl->handle) {
+        status = NOT_MY_TURN;
+    } else if (to_x < 0 || to_x >= g->board_size || to_y < 0 || to_y >= g->board_size) {
+        // The move must be within the board
+        status = INVALID_MOVE;
+    } else if ((g->discs[0] | g->discs[1]) & ((bitboard) 1 << cell)) {
+        // The target field must be empty
+        status = FIELD_TAKEN;
+    } else {
+#ifdef RULES_CROSSCHECK
+        crosscheck_position(g, cl->client_char);
+#endif
+
+        // The move is valid if it flips at least one opponent disc
+        if ((g->moves[own] & ((bitboard) 1 << cell)) == 0) {
+            status = INVALID_MOVE;
+        } else {
+            apply_move(g, cl, to_x, to_y);
+            int settled = settle_game(g, cl, next_moves);
+            if (outcome != NULL) {
+                *outcome = settled;
+            }
         }
     }
 
-    // If the move is valid, apply it
-    if (valid) {
-        apply_move(g, cl, to_x, to_y);
-    }
-
-    return valid ? TRUE : INVALID_MOVE;
+    unlock_game(g);
+    return status;
 }
 
 /**
  * @brief Applies a move for the given client.
  *
- * This function updates the game board by placing the client's piece at the specified coordinates
- * and flipping the opponent's pieces that are enclosed by the move.
+ * This function updates the bitboards by placing the client's piece at the specified coordinates
+ * and flipping the opponent's pieces that are enclosed by the move, then mirrors the changed
+ * cells into the character board. One pass over the board then finds the legal moves of both
+ * players: the opponent is on turn next unless it has none and the client has some (a pass).
+ * The caller holds the game's lock.
+ * Build with -DRULES_QUIET to leave out the board dump (the benchmarks do).
  *
  * @param g Pointer to the game structure.
  * @param cl Pointer to the client structure.
@@ -213,56 +366,40 @@ int validate_move(client *cl, int to_x, int to_y) {
  * @param to_y The y-coordinate of the move.
  */
 void apply_move(game *g, client *cl, int to_x, int to_y) {
-    int directions[8][2] = {
-            {0,  1},
-            {1,  0},
-            {0,  -1},
-            {-1, 0},
-            {1,  1},
-            {1,  -1},
-            {-1, 1},
-            {-1, -1}
-    };
-
-    char opponent_char = (cl->client_char == FIRST_PL_CHAR) ? SECOND_PL_CHAR : FIRST_PL_CHAR;
-
-    for (int i = 0; i < 8; i++) {
-        int dx = directions[i][0];
-        int dy = directions[i][1];
-        int nx = to_x + dx;
-        int ny = to_y + dy;
-        int count = 0;
-
-        while (nx >= 0 && nx < BOARD_SIZE && ny >= 0 && ny < BOARD_SIZE && g->board[ny][nx] == opponent_char) {
-            nx += dx;
-            ny += dy;
-            count++;
-        }
-
-        if (count > 0 && nx >= 0 && nx < BOARD_SIZE && ny >= 0 && ny < BOARD_SIZE &&
-            g->board[ny][nx] == cl->client_char) {
-            nx = to_x + dx;
-            ny = to_y + dy;
-            while (g->board[ny][nx] == opponent_char) {
-                g->board[ny][nx] = cl->client_char;
-                nx += dx;
-                ny += dy;
-            }
-        }
+    int own = disc_index(cl->client_char);
+    int cell = to_y * g->board_size + to_x;
+    bitboard move = (bitboard) 1 << cell;
+    bitboard flips = g->kernel->compute_flips(g->discs[own], g->discs[1 - own], cell);
+    journal_move(g, cl, to_x, to_y, flips);
+
+    g->discs[own] |= flips | move;
+    g->discs[1 - own] &= ~flips;
+    g->kernel->generate_both_moves(g->discs[0], g->discs[1], g->moves);
+
+    // Mirror the changed cells into the character snapshot
+    bitboard changed = flips | move;
+    while (changed != 0) {
+        int changedCell = lowest_bit(changed);
+        g->board[changedCell / g->board_size][changedCell % g->board_size] = cl->client_char;
+        changed &= changed - 1;
     }
 
-    g->board[to_y][to_x] = cl->client_char;
-
-    // Print the board
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            char pom = g->board[i][j];
-            if (pom == ' ') {
-                printf("-");
+#ifndef RULES_QUIET
+    // Print the board (built only when debug messages are logged)
+    if (log_enabled(LOG_LEVEL_DEBUG)) {
+        char dump[MAX_BOARD_SIZE * (MAX_BOARD_SIZE + 1) + 1];
+        int used = 0;
+        for (int i = 0; i < g->board_size; i++) {
+            for (int j = 0; j < g->board_size; j++) {
+                dump[used++] = g->board[i][j] == ' ' ? '-' : g->board[i][j];
             }
-            printf("%c", g->board[i][j]);
+            dump[used++] = '\n';
         }
-        printf("\n");
+        dump[used] = '\0';
+        log_debug("Board of game %d:\n%s", handle_slot(g->handle), dump);
     }
-    g->current_player = (cl == g->player1) ? g->player2 : g->player1;
+#endif
+    int opponentPasses = g->moves[1 - own] == 0 && g->moves[own] != 0;
+    g->current_player = opponentPasses ? cl->handle : get_opponent_handle(cl, g);
+    snapshot_move(g);
 }
@@ -13,23 +13,77 @@
 #define FIELD_TAKEN 8
 
 /**
- * @brief Validates the move of the player and updates the game board
+ * @brief Validates the move of the player, updates the game board, settles the game status and
+ *        copies the legal targets of the player on turn next, all under the game's lock
  * @param cl client who made the move
- * @param from_x from_x coordinate
- * @param from_y from_y coordinate
+ * @param to_x x coordinate
+ * @param to_y y coordinate
+ * @param outcome if not NULL, receives the game status after an accepted move (see settle_game),
+ *        0 after a rejected one
+ * @param next_moves if not NULL, receives the legal targets of the player on turn next after an
+ *        accepted move
  * @return TRUE if the move was successful, Error states for move otherwise
  */
-int validate_move(client *cl, int to_x, int to_y);
+int validate_move(client *cl, int to_x, int to_y, int *outcome, legal_squares *next_moves);
 
 /**
- * @brief Validates the game status
+ * @brief Settles the game status after an accepted move; the caller holds the game's lock
+ * @param g game in which the move was played
  * @param cl client who made the move
- * @param x x coordinate (last move)
- * @param y y coordinate (last move)
- * @return 0 game is not finished, 1 game wins someone, 2 game is draw
+ * @param next_moves if not NULL, receives the legal targets of the player on turn next
+ * @return 0 game is not finished, 1 game wins someone, 2 game is draw, 3 the opponent passes
+ *         (GAME_PASS) and cl moves again
  */
-int check_available_moves(client *cl);
+int settle_game(game *g, client *cl, legal_squares *next_moves);
 
+/**
+ * @brief Applies a (validated) move: places the disc and flips the enclosed opponent discs
+ * @param g game in which the move is played
+ * @param cl client who made the move
+ * @param to_x x coordinate
+ * @param to_y y coordinate
+ */
 void apply_move(game *g, client *cl, int to_x, int to_y);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Rules specialized for one board size (see rules_kernel_impl.h)
+ */
+struct rules_kernel {
+    int size;                                                   /**< Board width and height. */
+    bitboard (*generate_moves)(bitboard own, bitboard opp);     /**< Legal targets of the player owning own. */
+    bitboard (*compute_flips)(bitboard own, bitboard opp, int cell);  /**< Discs flipped by playing cell (0 if illegal). */
+    void (*generate_both_moves)(bitboard first, bitboard second, bitboard moves[2]);  /**< Legal targets of both players in one pass. */
+};
+
+/**
+ * @brief Prepares the masks and ray tables of all rules kernels; call once at startup
+ */
+void init_rules_engine();
+
+/**
+ * @brief Returns the rules kernel for a board size
+ * @param board_size width and height of the board
+ * @return the kernel, or NULL if the size is not supported (supported: 4, 6, 8, 10)
+ */
+const rules_kernel *get_rules_kernel(int board_size);
+
+/**
+ * @brief Builds the bitboards and the legal moves of a game from its character board
+ * @param g game whose discs are rebuilt
+ */
+void init_board_bits(game *g);
+
+/**
+ * @brief Computes the cached legal moves of both players from the bitboards (apply_move keeps
+ *        them up to date afterwards)
+ * @param g game whose legal moves are rebuilt
+ */
+void init_legal_moves(game *g);
+
+/**
+ * @brief Builds the character board of a game from its bitboards
+ * @param g game whose board is rebuilt
+ */
+void init_board_chars(game *g);
+
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file rules_kernel_impl.h
+ * @brief Board-size specialized rules kernel, instantiated by rules_engine.c once per supported size.
+ *
+ * Before every inclusion define KERNEL_SIZE (the board width) and KERNEL_BITS (the narrowest
+ * unsigned type holding KERNEL_SIZE * KERNEL_SIZE bits). The board size is a compile-time
+ * constant inside the kernel, the 8 directions are spelled out and flips are read from
+ * precomputed ray tables, so no per-cell bounds checks remain. This header has no include
+ * guard on purpose.
+ */
+
+#define KERNEL_CELLS            (KERNEL_SIZE * KERNEL_SIZE)
+#define KERNEL_GLUE2(name, n)   name##_##n
+#define KERNEL_GLUE(name, n)    KERNEL_GLUE2(name, n)
+#define KERNEL_NAME(name)       KERNEL_GLUE(name, KERNEL_SIZE)
+
+static KERNEL_BITS KERNEL_NAME(g_fullMask);
+static KERNEL_BITS KERNEL_NAME(g_notWestCol);
+static KERNEL_BITS KERNEL_NAME(g_notEastCol);
+
+/**
+ * For every cell and direction: the cells from the neighbour up to the board edge.
+ */
+static KERNEL_BITS KERNEL_NAME(g_rays)[KERNEL_CELLS][DIR_COUNT];
+
+/**
+ * Moves every disc one cell in the given direction, dropping discs that leave the board.
+ */
+static inline KERNEL_BITS KERNEL_NAME(shift_bits)(KERNEL_BITS b, int dir) {
+    switch (dir) {
+        case DIR_EAST:       return (b << 1) & KERNEL_NAME(g_notWestCol);
+        case DIR_WEST:       return (b >> 1) & KERNEL_NAME(g_notEastCol);
+        case DIR_SOUTH:      return (b << KERNEL_SIZE) & KERNEL_NAME(g_fullMask);
+        case DIR_NORTH:      return b >> KERNEL_SIZE;
+        case DIR_SOUTH_EAST: return (b << (KERNEL_SIZE + 1)) & KERNEL_NAME(g_notWestCol);
+        case DIR_SOUTH_WEST: return (b << (KERNEL_SIZE - 1)) & KERNEL_NAME(g_notEastCol);
+        case DIR_NORTH_EAST: return (b >> (KERNEL_SIZE - 1)) & KERNEL_NAME(g_notWestCol);
+        default:             return (b >> (KERNEL_SIZE + 1)) & KERNEL_NAME(g_notEastCol);
+    }
+}
+
+/**
+ * Legal targets in one direction: empty cells closing a run of opponent discs next to own discs.
+ */
+static inline KERNEL_BITS KERNEL_NAME(moves_in_direction)(KERNEL_BITS own, KERNEL_BITS opp,
+                                                          KERNEL_BITS empty, int dir) {
+    KERNEL_BITS run = KERNEL_NAME(shift_bits)(own, dir) & opp;
+    for (int step = 0; step < KERNEL_SIZE - 3; step++) {
+        run |= KERNEL_NAME(shift_bits)(run, dir) & opp;
+    }
+    return KERNEL_NAME(shift_bits)(run, dir) & empty;
+}
+
+static bitboard KERNEL_NAME(generate_moves)(bitboard own_bits, bitboard opp_bits) {
+    KERNEL_BITS own = (KERNEL_BITS) own_bits;
+    KERNEL_BITS opp = (KERNEL_BITS) opp_bits;
+    KERNEL_BITS empty = ~(own | opp) & KERNEL_NAME(g_fullMask);
+
+    return KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_EAST)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_WEST)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_SOUTH)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_NORTH)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_SOUTH_EAST)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_SOUTH_WEST)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_NORTH_EAST)
+           | KERNEL_NAME(moves_in_direction)(own, opp, empty, DIR_NORTH_WEST);
+}
+
+/**
+ * Legal targets of both players in one direction; the two runs are independent, so their
+ * shifts interleave instead of waiting on each other.
+ */
+static inline void KERNEL_NAME(both_in_direction)(KERNEL_BITS first, KERNEL_BITS second, KERNEL_BITS empty,
+                                                  int dir, KERNEL_BITS *first_moves, KERNEL_BITS *second_moves) {
+    KERNEL_BITS firstRun = KERNEL_NAME(shift_bits)(first, dir) & second;
+    KERNEL_BITS secondRun = KERNEL_NAME(shift_bits)(second, dir) & first;
+    for (int step = 0; step < KERNEL_SIZE - 3; step++) {
+        firstRun |= KERNEL_NAME(shift_bits)(firstRun, dir) & second;
+        secondRun |= KERNEL_NAME(shift_bits)(secondRun, dir) & first;
+    }
+    *first_moves |= KERNEL_NAME(shift_bits)(firstRun, dir) & empty;
+    *second_moves |= KERNEL_NAME(shift_bits)(secondRun, dir) & empty;
+}
+
+static void KERNEL_NAME(generate_both_moves)(bitboard first_bits, bitboard second_bits, bitboard moves[2]) {
+    KERNEL_BITS first = (KERNEL_BITS) first_bits;
+    KERNEL_BITS second = (KERNEL_BITS) second_bits;
+    KERNEL_BITS empty = ~(first | second) & KERNEL_NAME(g_fullMask);
+    KERNEL_BITS firstMoves = 0;
+    KERNEL_BITS secondMoves = 0;
+
+    // Two interleaved 128-bit runs no longer fit in registers; one player at a time is faster there
+    if (sizeof(KERNEL_BITS) > sizeof(uint64_t)) {
+        moves[0] = KERNEL_NAME(generate_moves)(first_bits, second_bits);
+        moves[1] = KERNEL_NAME(generate_moves)(second_bits, first_bits);
+        return;
+    }
+
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_EAST, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_WEST, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_SOUTH, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_NORTH, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_SOUTH_EAST, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_SOUTH_WEST, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_NORTH_EAST, &firstMoves, &secondMoves);
+    KERNEL_NAME(both_in_direction)(first, second, empty, DIR_NORTH_WEST, &firstMoves, &secondMoves);
+    moves[0] = firstMoves;
+    moves[1] = secondMoves;
+}
+
+/**
+ * Flips along a ray of increasing bit indexes: the opponent run ends at the lowest non-opponent cell.
+ */
+static inline KERNEL_BITS KERNEL_NAME(flips_up)(KERNEL_BITS ray, KERNEL_BITS own, KERNEL_BITS opp) {
+    KERNEL_BITS stops = ray & ~opp;
+    KERNEL_BITS first = stops & (~stops + 1);
+    return (first & own) ? ray & (first - 1) : 0;
+}
+
+/**
+ * Flips along a ray of decreasing bit indexes: the opponent run ends at the highest non-opponent cell.
+ */
+static inline KERNEL_BITS KERNEL_NAME(flips_down)(KERNEL_BITS ray, KERNEL_BITS own, KERNEL_BITS opp) {
+    KERNEL_BITS stops = ray & ~opp;
+    if (stops == 0) {
+        return 0;
+    }
+    KERNEL_BITS first = (KERNEL_BITS) 1 << highest_bit(stops);
+    return (first & own) ? ray & ~(first | (first - 1)) : 0;
+}
+
+static bitboard KERNEL_NAME(compute_flips)(bitboard own_bits, bitboard opp_bits, int cell) {
+    KERNEL_BITS own = (KERNEL_BITS) own_bits;
+    KERNEL_BITS opp = (KERNEL_BITS) opp_bits;
+    const KERNEL_BITS *rays = KERNEL_NAME(g_rays)[cell];
+
+    return KERNEL_NAME(flips_up)(rays[DIR_EAST], own, opp)
+           | KERNEL_NAME(flips_up)(rays[DIR_SOUTH], own, opp)
+           | KERNEL_NAME(flips_up)(rays[DIR_SOUTH_EAST], own, opp)
+           | KERNEL_NAME(flips_up)(rays[DIR_SOUTH_WEST], own, opp)
+           | KERNEL_NAME(flips_down)(rays[DIR_WEST], own, opp)
+           | KERNEL_NAME(flips_down)(rays[DIR_NORTH], own, opp)
+           | KERNEL_NAME(flips_down)(rays[DIR_NORTH_EAST], own, opp)
+           | KERNEL_NAME(flips_down)(rays[DIR_NORTH_WEST], own, opp);
+}
+
+/**
+ * Fills the masks and ray tables of the kernel.
+ */
+static void KERNEL_NAME(init_kernel)() {
+    KERNEL_BITS westCol = 0, eastCol = 0;
+    KERNEL_NAME(g_fullMask) = 0;
+    for (int cell = 0; cell < KERNEL_CELLS; cell++) {
+        KERNEL_NAME(g_fullMask) |= (KERNEL_BITS) 1 << cell;
+    }
+    for (int row = 0; row < KERNEL_SIZE; row++) {
+        westCol |= (KERNEL_BITS) 1 << (row * KERNEL_SIZE);
+        eastCol |= (KERNEL_BITS) 1 << (row * KERNEL_SIZE + KERNEL_SIZE - 1);
+    }
+    KERNEL_NAME(g_notWestCol) = KERNEL_NAME(g_fullMask) & ~westCol;
+    KERNEL_NAME(g_notEastCol) = KERNEL_NAME(g_fullMask) & ~eastCol;
+
+    for (int cell = 0; cell < KERNEL_CELLS; cell++) {
+        for (int dir = 0; dir < DIR_COUNT; dir++) {
+            KERNEL_BITS ray = 0;
+            int x = cell % KERNEL_SIZE + g_directionSteps[dir][0];
+            int y = cell / KERNEL_SIZE + g_directionSteps[dir][1];
+            while (x >= 0 && x < KERNEL_SIZE && y >= 0 && y < KERNEL_SIZE) {
+                ray |= (KERNEL_BITS) 1 << (y * KERNEL_SIZE + x);
+                x += g_directionSteps[dir][0];
+                y += g_directionSteps[dir][1];
+            }
+            KERNEL_NAME(g_rays)[cell][dir] = ray;
+        }
+    }
+}
+
+static const rules_kernel KERNEL_NAME(g_kernel) = {
+        KERNEL_SIZE,
+        KERNEL_NAME(generate_moves),
+        KERNEL_NAME(compute_flips),
+        KERNEL_NAME(generate_both_moves)
+};
+
+#undef KERNEL_NAME
+#undef KERNEL_GLUE
+#undef KERNEL_GLUE2
+#undef KERNEL_CELLS
+#undef KERNEL_BITS
+#undef KERNEL_SIZE
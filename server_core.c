@@ -10,6 +10,16 @@
 #include "def_n_struct.h"
 #include "player_manager.h"
 #include "network_interface.h"
+#include "event_loop.h"
+#include "matchmaker.h"
+#include "outbound.h"
+#include "rules_engine.h"
+#include "match_manager.h"
+#include "login_acceptor.h"
+#include "game_snapshot.h"
+#include "move_journal.h"
+#include "server_metrics.h"
+#include "server_log.h"
 
 /**
  * Global structure holding the server's IP and port information.
@@ -31,9 +41,16 @@ int is_valid_ip(const char *ip_address) {
 }
 
 /**
- * @brief Configures the server IP address and port based on user-supplied arguments or defaults.
+ * @brief Configures the server IP address, port and I/O model based on user-supplied arguments or defaults.
  *
+ * Usage: ups_server [-m thread|epoll] [-r reactors] [-c max_clients] [-g max_games] [-s snapshot_file]
+ *                   [-j journal_file] [-a admin_port] [-l debug|info|warn|error] [ip] [port]
  * If no address is provided, it binds to INADDR_ANY. If no port is specified, it uses a default PORT.
+ * The I/O model defaults to one thread per client; epoll mode runs one reactor unless -r is given.
+ * With -s the running games are kept in the given file and restored from it on the next start.
+ * With -j every game, move and result is appended to the given journal file.
+ * With -a the metrics page is served on the given port of 127.0.0.1.
+ * With -l only messages of the given level and above are logged (info by default).
  *
  * @param argc The number of arguments passed in.
  * @param argv The array of string arguments.
@@ -42,8 +59,56 @@ void configure_server_settings(int argc, char *argv[]) {
     // Default to empty IP (which means any available interface) and the standard port
     strcpy(server_info.ip_address, "");
     server_info.port = PORT;
+    server_info.io_mode = IO_MODE_THREAD;
+    server_info.reactor_count = 1;
+    server_info.max_clients = DEFAULT_MAX_CLIENTS;
+    server_info.max_games = DEFAULT_MAX_GAMES;
+    server_info.snapshot_path = NULL;
+    server_info.journal_path = NULL;
+    server_info.admin_port = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:r:c:g:s:j:a:l:")) != -1) {
+        if (opt == 'm' && strcmp(optarg, "thread") == 0) {
+            server_info.io_mode = IO_MODE_THREAD;
+        } else if (opt == 'm' && strcmp(optarg, "epoll") == 0) {
+            server_info.io_mode = IO_MODE_EPOLL;
+        } else if (opt == 'r') {
+            server_info.reactor_count = atoi(optarg);
+            if (server_info.reactor_count <= 0 || server_info.reactor_count > MAX_REACTORS) {
+                fprintf(stderr, "Reactor count out of range: %s (valid range is 1-%d)\n", optarg, MAX_REACTORS);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 'c' || opt == 'g') {
+            int limit = atoi(optarg);
+            if (limit <= 0) {
+                fprintf(stderr, "Limit must be positive: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            *(opt == 'c' ? &server_info.max_clients : &server_info.max_games) = limit;
+        } else if (opt == 's') {
+            server_info.snapshot_path = optarg;
+        } else if (opt == 'j') {
+            server_info.journal_path = optarg;
+        } else if (opt == 'a') {
+            server_info.admin_port = atoi(optarg);
+            if (server_info.admin_port <= 0 || server_info.admin_port > 65535) {
+                fprintf(stderr, "Admin port out of range: %s (valid range is 1-65535)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 'l' && parse_log_level(optarg) >= 0) {
+            log_threshold = parse_log_level(optarg);
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [-m thread|epoll] [-r reactors] [-c max_clients] [-g max_games] [-s snapshot_file] "
+                    "[-j journal_file] [-a admin_port] [-l debug|info|warn|error] [ip] [port]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
-    // Attempt to read arguments
+    // Attempt to read positional arguments
     if (argc > 1) {
         if (is_valid_ip(argv[1])) {
             strncpy(server_info.ip_address, argv[1], sizeof(server_info.ip_address) - 1);
@@ -64,21 +129,23 @@ void configure_server_settings(int argc, char *argv[]) {
 
 
 /**
- * @brief Creates a socket, binds it, and listens for incoming client connections in an infinite loop.
+ * @brief Creates the server socket, binds it to the configured address and starts listening.
  *
- * Whenever a valid connection is accepted, this function attempts to parse the login message.
- * If valid, a new thread is created for that client.
- *
- * @return A void pointer (unused).
+ * @param nonblocking TRUE to create a non-blocking socket (for a reactor or the login acceptor).
+ * @param reuseport TRUE to let several reactor sockets share the port (SO_REUSEPORT).
+ * @return The listening socket, or -1 if listen() failed.
  */
-void *start_server_socket() {
-    int sockSrv = socket(AF_INET, SOCK_STREAM, 0);
+int create_server_socket(int nonblocking, int reuseport) {
+    int sockSrv = socket(AF_INET, SOCK_STREAM | (nonblocking ? SOCK_NONBLOCK : 0), 0);
     if (sockSrv == -1) {
         perror("Server socket creation failed");
         exit(EXIT_FAILURE);
     }
 
     setsockopt(sockSrv, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+    if (reuseport) {
+        setsockopt(sockSrv, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int));
+    }
 
     struct sockaddr_in srvAddr;
     memset(&srvAddr, 0, sizeof(srvAddr));
@@ -88,10 +155,10 @@ void *start_server_socket() {
     // If no IP address was provided, bind to all interfaces
     if (strlen(server_info.ip_address) == 0) {
         srvAddr.sin_addr.s_addr = INADDR_ANY;
-        printf("[INFO] Listening on all available interfaces.\n");
+        log_info("Listening on all available interfaces.");
     } else {
         srvAddr.sin_addr.s_addr = inet_addr(server_info.ip_address);
-        printf("[INFO] Server configured for IP: %s\n", server_info.ip_address);
+        log_info("Server configured for IP: %s", server_info.ip_address);
     }
 
     // Attempt to bind
@@ -100,81 +167,57 @@ void *start_server_socket() {
         close(sockSrv);
         exit(EXIT_FAILURE);
     }
-    printf("[INFO] Bound to port %d successfully.\n", server_info.port);
+    log_info("Bound to port %d successfully.", server_info.port);
 
     // Switch to listening mode
-    if (listen(sockSrv, MAX_CLIENTS) == -1) {
+    // The backlog absorbs a connection storm until the next accept batch
+    if (listen(sockSrv, server_info.max_clients > SOMAXCONN ? server_info.max_clients : SOMAXCONN) == -1) {
         perror("Failed to set socket to listen");
         close(sockSrv);
-        return NULL;
+        return -1;
     }
 
-    printf("[INFO] Server is now running, waiting for clients...\n");
-
-    // Accept client connections indefinitely
-    struct sockaddr_in clAddr;
-    socklen_t lenClient = sizeof(clAddr);
-
-    while (1) {
-        int sockCl = accept(sockSrv, (struct sockaddr *)&clAddr, &lenClient);
-        if (sockCl == -1) {
-            perror("Unable to accept client connection");
-            continue;
-        }
-
-        printf("[CONNECTION] A client connected.\n");
-        char loginMsg[LOGIN_MESSAGE_SIZE] = {0};
-        recv(sockCl, loginMsg, sizeof(loginMsg), 0);
-
-        // Check protocol message
-        char *token = strtok(loginMsg, MESS_DELIMITER);
-        if (token && strcmp(token, "LOGIN") == 0) {
-            printf("[PROTOCOL] LOGIN request received.\n");
-
-            token = strtok(NULL, MESS_END_CHAR);
-            if (!token) {
-                perror("Invalid login message - closing client socket");
-                close(sockCl);
-                continue;
-            }
-
-            char tempUser[PLAYER_NAME_SIZE];
-            strncpy(tempUser, token, PLAYER_NAME_SIZE - 1);
-            tempUser[PLAYER_NAME_SIZE - 1] = '\0';
-
-            pthread_t thClient;
-            // Attempt client registration
-            if (!register_client(sockCl, tempUser, &thClient)) {
-                perror("Could not register the client - closing socket");
-                close(sockCl);
-                continue;
-            }
-
-            // Retrieve the newly created client reference
-            client *connectedClient = locate_client_by_socket(sockCl);
+    log_info("Server is now running, waiting for clients...");
+    return sockSrv;
+}
 
-            // Start the client thread
-            if (pthread_create(&thClient, NULL, client_thread_main, connectedClient) != 0) {
-                perror("Failed to launch client thread");
-                close(sockCl);
-                detach_client_by_socket(sockCl);
-                continue;
+/**
+ * @brief Creates the server socket and serves clients with the configured I/O model.
+ *
+ * In thread mode the login acceptor completes the LOGIN handshakes and starts a thread for
+ * every client that logged in. In epoll mode every
+ * reactor gets its own SO_REUSEPORT socket and the sockets are handed to the reactors.
+ *
+ * @return A void pointer (unused).
+ */
+void *start_server_socket() {
+    if (server_info.io_mode == IO_MODE_EPOLL) {
+        int listenFds[MAX_REACTORS];
+        for (int i = 0; i < server_info.reactor_count; i++) {
+            listenFds[i] = create_server_socket(TRUE, TRUE);
+            if (listenFds[i] == -1) {
+                return NULL;
             }
-
-            display_all_clients();
-        } else {
-            // If message doesn't match expected protocol
-            perror("Unrecognized message - closing client socket");
-            close(sockCl);
         }
+        log_info("Serving clients from %d epoll reactor(s).", server_info.reactor_count);
+        return run_event_loops(listenFds, server_info.reactor_count);
+    }
+
+    int sockSrv = create_server_socket(TRUE, FALSE);
+    if (sockSrv == -1) {
+        return NULL;
     }
+
+    // Handshakes run on the acceptor's own loop, so a silent connection delays nobody
+    return run_login_acceptor(sockSrv);
 }
 
 /**
  * @brief Entry point of the server program.
  *
- * Sets up the server configuration, starts the main server thread, and also
- * begins a separate monitoring thread that pings connected clients.
+ * Sets up the server configuration, starts the main server thread, and in thread mode also
+ * begins the threads that write output, pair players and watch the clients' ping deadlines
+ * (each reactor does all of that by itself).
  *
  * @param argc Number of command-line arguments.
  * @param argv Array of command-line arguments.
@@ -182,21 +225,36 @@ void *start_server_socket() {
  */
 int main(int argc, char *argv[]) {
     configure_server_settings(argc, argv);
+    start_log_writer();
+    init_rules_engine();
+    if (!init_client_registry(server_info.max_clients) || !init_game_registry(server_info.max_games)) {
+        exit(EXIT_FAILURE);
+    }
+    // The journal comes first: it records the games restored from the snapshot
+    if (server_info.journal_path != NULL && !open_move_journal(server_info.journal_path)) {
+        exit(EXIT_FAILURE);
+    }
+    if (server_info.snapshot_path != NULL && open_game_snapshot(server_info.snapshot_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (server_info.admin_port != 0 && !start_metrics_endpoint(server_info.admin_port)) {
+        exit(EXIT_FAILURE);
+    }
 
-    pthread_t thServer, thPing;
-    if (pthread_create(&thServer, NULL, start_server_socket, NULL) != 0) {
-        perror("Unable to launch server thread");
+    // Thread mode helpers run before the first client can connect
+    if (server_info.io_mode == IO_MODE_THREAD &&
+        (!start_output_writer() || !start_matchmaker() || !start_liveness_monitor())) {
         exit(EXIT_FAILURE);
     }
 
-    if (pthread_create(&thPing, NULL, monitor_client_pings, NULL) != 0) {
-        perror("Could not initiate ping thread");
+    pthread_t thServer;
+    if (pthread_create(&thServer, NULL, start_server_socket, NULL) != 0) {
+        perror("Unable to launch server thread");
         exit(EXIT_FAILURE);
     }
 
-    // Wait for threads to finish
+    // Wait for the server thread to finish
     pthread_join(thServer, NULL);
-    pthread_join(thPing, NULL);
 
     // Additional cleanup if necessary
     pthread_cancel(thServer);
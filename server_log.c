@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "server_log.h"
+
+/**
+ * One formatted message.
+ */
+typedef struct {
+    long long   time_ns;                            /**< Wall-clock time (ns since the epoch). */
+    int         level;                              /**< One of the LOG_LEVEL_* values. */
+    int         len;                                /**< Bytes in text. */
+    char        text[LOG_RECORD_SIZE - 16];         /**< The message, truncated to fit. */
+} log_record;
+
+typedef struct log_ring log_ring;
+
+/**
+ * Messages of one thread: the thread advances head, the writer advances tail.
+ */
+struct log_ring {
+    log_record      records[LOG_RING_RECORDS];
+    unsigned int    head;           /**< Records appended so far (written by the owning thread). */
+    unsigned int    tail;           /**< Records written out so far (written by the writer). */
+    unsigned int    collected;      /**< Head seen by the writer in its current round (writer). */
+    uint64_t        dropped;        /**< Records dropped because the ring was full (owning thread). */
+    uint64_t        reported;       /**< Drops already reported (writer). */
+    int             id;             /**< Number shown in the log lines. */
+    int             in_use;         /**< Set while a thread owns the ring. */
+    log_ring        *next;          /**< Next ring in g_rings (rings are never freed). */
+};
+
+int log_threshold = LOG_LEVEL_INFO;
+
+/**
+ * Every ring ever allocated; new rings are pushed at the head.
+ */
+static log_ring *g_rings = NULL;
+static int g_ringCount = 0;
+
+/**
+ * Ring of the calling thread; the key returns it to the free rings when the thread ends.
+ */
+static __thread log_ring *t_ring = NULL;
+static pthread_key_t g_ringKey;
+static pthread_once_t g_ringKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Set once the writer runs; before that, messages are written directly.
+ */
+static int g_writerRunning = FALSE;
+
+static const char *g_levelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+/**
+ * @brief Returns the wall-clock time in nanoseconds.
+ */
+static long long wall_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Gives the ring of an ending thread to the next thread that needs one (the writer
+ *        still drains what it holds).
+ * @param ring The ring
+ */
+static void release_ring(void *ring) {
+    __atomic_store_n(&((log_ring *) ring)->in_use, FALSE, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key() {
+    pthread_key_create(&g_ringKey, release_ring);
+}
+
+/**
+ * @brief Returns the calling thread's ring, taking a free one or allocating a new one.
+ * @return The ring, or NULL if memory ran out
+ */
+static log_ring *thread_ring() {
+    if (t_ring != NULL) {
+        return t_ring;
+    }
+    pthread_once(&g_ringKeyOnce, create_ring_key);
+
+    log_ring *ring;
+    for (ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        int expected = FALSE;
+        if (__atomic_compare_exchange_n(&ring->in_use, &expected, TRUE, FALSE, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(log_ring));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ring->in_use = TRUE;
+        ring->id = __atomic_add_fetch(&g_ringCount, 1, __ATOMIC_RELAXED);
+        ring->next = __atomic_load_n(&g_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_rings, &ring->next, ring, FALSE, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+
+    pthread_setspecific(g_ringKey, ring);
+    t_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Formats a record as one output line.
+ * @return Number of bytes written to line
+ */
+static int format_line(char *line, size_t size, const log_record *record, int ring_id) {
+    time_t seconds = (time_t) (record->time_ns / 1000000000LL);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    int len = (int) strftime(line, size, "%Y-%m-%d %H:%M:%S", &local);
+    len += snprintf(line + len, size - (size_t) len, ".%06lld %-5s [%d] %.*s\n",
+                    record->time_ns % 1000000000LL / 1000, g_levelNames[record->level], ring_id, record->len,
+                    record->text);
+    return len < (int) size ? len : (int) size - 1;
+}
+
+/**
+ * @brief Writes a whole buffer to stdout.
+ */
+static void write_stdout(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= (size_t) n;
+    }
+}
+
+void append_log(int level, const char *format, ...) {
+    log_record direct;
+    log_ring *ring = __atomic_load_n(&g_writerRunning, __ATOMIC_ACQUIRE) ? thread_ring() : NULL;
+    log_record *record = &direct;
+    unsigned int head = 0;
+
+    if (ring != NULL) {
+        head = ring->head;
+        if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == LOG_RING_RECORDS) {
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            return;
+        }
+        record = &ring->records[head % LOG_RING_RECORDS];
+    }
+
+    record->time_ns = wall_clock_ns();
+    record->level = level;
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(record->text, sizeof(record->text), format, args);
+    va_end(args);
+    record->len = len < 0 ? 0 : len < (int) sizeof(record->text) ? len : (int) sizeof(record->text) - 1;
+
+    if (ring != NULL) {
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // Before the writer runs (and when a ring cannot be allocated) the message goes out now
+    char line[LOG_RECORD_SIZE + 64];
+    write_stdout(line, (size_t) format_line(line, sizeof(line), record, 0));
+}
+
+int parse_log_level(const char *name) {
+    const char *names[] = {"debug", "info", "warn", "error"};
+    for (int level = LOG_LEVEL_DEBUG; level <= LOG_LEVEL_ERROR; level++) {
+        if (strcmp(name, names[level]) == 0) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+/**
+ * A record picked up by the writer, with its ring.
+ */
+typedef struct {
+    const log_record    *record;
+    int                 ring_id;
+    size_t              order;      /**< Position of collection (keeps a ring's records in order). */
+} pending_record;
+
+/**
+ * @brief Orders records by time (threads' clocks are the same wall clock), then by collection.
+ */
+static int compare_records(const void *a, const void *b) {
+    const pending_record *x = a;
+    const pending_record *y = b;
+    if (x->record->time_ns != y->record->time_ns) {
+        return x->record->time_ns < y->record->time_ns ? -1 : 1;
+    }
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+/**
+ * @brief Log writer: every LOG_FLUSH_MS collects the records of all rings, writes them in
+ *        time order with one write per LOG_WRITE_BATCH bytes, then frees the ring slots.
+ * @param arg Unused
+ * @return NULL (never returns)
+ */
+static void *run_log_writer(void *arg) {
+    (void) arg;
+    pending_record *pending = NULL;
+    size_t capacity = 0;
+    char *out = malloc(LOG_WRITE_BATCH);
+    if (out == NULL) {
+        perror("Failed to allocate the log buffer");
+        return NULL;
+    }
+
+    while (1) {
+        struct timespec pause = {0, LOG_FLUSH_MS * 1000000L};
+        nanosleep(&pause, NULL);
+
+        // Every ring is read up to the head seen now; later records wait for the next round
+        size_t count = 0;
+        for (log_ring *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            unsigned int tail = ring->tail;
+            ring->collected = tail;
+            if (count + (head - tail) > capacity) {
+                size_t grown = capacity * 2 + (head - tail) + 64;
+                pending_record *larger = realloc(pending, grown * sizeof(pending_record));
+                if (larger == NULL) {
+                    continue;
+                }
+                pending = larger;
+                capacity = grown;
+            }
+            ring->collected = head;
+            for (unsigned int i = tail; i != head; i++) {
+                pending[count].record = &ring->records[i % LOG_RING_RECORDS];
+                pending[count].ring_id = ring->id;
+                pending[count].order = count;
+                count++;
+            }
+        }
+        if (count > 1) {
+            qsort(pending, count, sizeof(pending_record), compare_records);
+        }
+
+        size_t used = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (used + LOG_RECORD_SIZE + 64 > LOG_WRITE_BATCH) {
+                write_stdout(out, used);
+                used = 0;
+            }
+            used += (size_t) format_line(out + used, LOG_RECORD_SIZE + 64, pending[i].record, pending[i].ring_id);
+        }
+
+        // Release the slots that were written, and report drops
+        for (log_ring *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            __atomic_store_n(&ring->tail, ring->collected, __ATOMIC_RELEASE);
+
+            uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+            if (dropped != ring->reported && used + 128 <= LOG_WRITE_BATCH) {
+                used += (size_t) snprintf(out + used, 128, "%lu log messages of [%d] dropped (ring full)\n",
+                                          (unsigned long) (dropped - ring->reported), ring->id);
+                ring->reported = dropped;
+            }
+        }
+        if (used > 0) {
+            write_stdout(out, used);
+        }
+    }
+    return NULL;
+}
+
+int start_log_writer() {
+    pthread_t thWriter;
+    if (pthread_create(&thWriter, NULL, run_log_writer, NULL) != 0) {
+        perror("Failed to launch the log writer");
+        return FALSE;
+    }
+    pthread_detach(thWriter);
+    __atomic_store_n(&g_writerRunning, TRUE, __ATOMIC_RELEASE);
+    return TRUE;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file server_log.h
+ * @brief Declares the leveled, asynchronous server log.
+ *
+ * A message below the current level costs one comparison. An enabled message is formatted
+ * into a ring owned by the calling thread (no lock; the ring has one producer and one
+ * consumer) and written to stdout by the log writer thread every LOG_FLUSH_MS, in time order
+ * across threads. A full ring drops the message instead of blocking; the writer reports how
+ * many were dropped. Until the writer is started, messages are written synchronously.
+ *
+ * Errors that come with errno are still reported with perror on stderr.
+ */
+
+#ifndef __SERVER_LOG_H__
+#define __SERVER_LOG_H__
+
+#include "def_n_struct.h"
+
+/**
+ * Log levels, from the most verbose.
+ */
+#define LOG_LEVEL_DEBUG         0   /**< Every message, move and timer event, board dumps. */
+#define LOG_LEVEL_INFO          1   /**< Startup, restores and session changes. */
+#define LOG_LEVEL_WARN          2   /**< Clients removed for protocol errors, exhausted pools. */
+#define LOG_LEVEL_ERROR         3
+
+/**
+ * Messages below this level are discarded (LOG_LEVEL_INFO unless changed at startup).
+ */
+extern int log_threshold;
+
+#define log_enabled(level)      ((level) >= log_threshold)
+
+#define log_message(level, ...) \
+    do { \
+        if (log_enabled(level)) { \
+            append_log((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_debug(...)          log_message(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...)           log_message(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warn(...)           log_message(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_error(...)          log_message(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+/**
+ * Formats a message (one line, without its newline) into the calling thread's ring.
+ * Use the log_* macros, which skip the call below the threshold.
+ *
+ * @param level One of the LOG_LEVEL_* values
+ * @param format printf format of the message
+ */
+void append_log(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Returns the level a name ("debug", "info", "warn" or "error") stands for.
+ *
+ * @param name The name
+ * @return The level, or -1 if the name is unknown
+ */
+int parse_log_level(const char *name);
+
+/**
+ * Starts the thread that writes the rings to stdout.
+ *
+ * @return TRUE if the writer was started, FALSE otherwise
+ */
+int start_log_writer();
+
+#endif
@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "server_metrics.h"
+#include "player_manager.h"
+#include "match_manager.h"
+#include "server_log.h"
+
+/**
+ * Histogram layout: latencies below 8 ns are exact, larger ones fall into one of 8 sub-buckets
+ * of their power of two (within 12.5%), up to 2^40 ns (about 18 minutes).
+ */
+#define METRICS_SUB_BITS        3
+#define METRICS_MAX_EXPONENT    40
+#define METRICS_BUCKETS         ((METRICS_MAX_EXPONENT - METRICS_SUB_BITS + 2) << METRICS_SUB_BITS)
+
+/**
+ * One latency histogram.
+ */
+typedef struct {
+    uint64_t    counts[METRICS_BUCKETS];
+    uint64_t    samples;
+    uint64_t    sum;
+    uint64_t    max;
+} latency_histogram;
+
+typedef struct metrics_block metrics_block;
+
+/**
+ * The metrics of one thread. Only the owning thread writes the values.
+ */
+struct metrics_block {
+    uint64_t            counters[METRIC_COUNTERS];
+    latency_histogram   latencies[METRIC_LATENCIES];
+    int                 in_use;     /**< Set while a thread owns the block. */
+    metrics_block       *next;      /**< Next block in g_blocks (blocks are never freed). */
+};
+
+/**
+ * Every block ever allocated; new blocks are pushed at the head.
+ */
+static metrics_block *g_blocks = NULL;
+
+/**
+ * Block of the calling thread; the key returns it to the free blocks when the thread ends.
+ */
+static __thread metrics_block *t_block = NULL;
+static pthread_key_t g_blockKey;
+static pthread_once_t g_blockKeyOnce = PTHREAD_ONCE_INIT;
+
+static const char *g_counterNames[METRIC_COUNTERS] = {
+    "ups_messages_received_total", "ups_received_bytes_total", "ups_messages_sent_total",
+    "ups_sent_bytes_total", "ups_moves_total", "ups_moves_rejected_total", "ups_games_started_total",
+    "ups_logins_total", "ups_disconnects_total", "ups_output_queued_bytes_total",
+    "ups_output_drained_bytes_total", "ups_match_requests_total", "ups_match_requests_taken_total",
+    "ups_handoffs_sent_total", "ups_handoffs_taken_total"
+};
+
+static const char *g_latencyNames[METRIC_LATENCIES] = {"parse", "rules", "request", "send", "match_wait"};
+
+long long metrics_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Gives the block of an ending thread to the next thread that needs one.
+ * @param block The block
+ */
+static void release_block(void *block) {
+    __atomic_store_n(&((metrics_block *) block)->in_use, FALSE, __ATOMIC_RELEASE);
+}
+
+static void create_block_key() {
+    pthread_key_create(&g_blockKey, release_block);
+}
+
+/**
+ * @brief Returns the calling thread's block, taking a free one or allocating a new one.
+ * @return The block, or NULL if memory ran out
+ */
+static metrics_block *thread_block() {
+    if (t_block != NULL) {
+        return t_block;
+    }
+    pthread_once(&g_blockKeyOnce, create_block_key);
+
+    metrics_block *block;
+    for (block = __atomic_load_n(&g_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        int expected = FALSE;
+        if (__atomic_compare_exchange_n(&block->in_use, &expected, TRUE, FALSE, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (block == NULL) {
+        block = calloc(1, sizeof(metrics_block));
+        if (block == NULL) {
+            return NULL;
+        }
+        block->in_use = TRUE;
+        block->next = __atomic_load_n(&g_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_blocks, &block->next, block, FALSE, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+
+    pthread_setspecific(g_blockKey, block);
+    t_block = block;
+    return block;
+}
+
+/**
+ * @brief Adds to a value owned by the calling thread; readers see either the old or the new value.
+ */
+static inline void add_owned(uint64_t *value, uint64_t amount) {
+    __atomic_store_n(value, *value + amount, __ATOMIC_RELAXED);
+}
+
+void count_metric(int counter, uint64_t amount) {
+    metrics_block *block = thread_block();
+    if (block != NULL) {
+        add_owned(&block->counters[counter], amount);
+    }
+}
+
+/**
+ * @brief Maps a latency to its histogram bucket.
+ */
+static int bucket_of(uint64_t ns) {
+    if (ns < (1 << METRICS_SUB_BITS)) {
+        return (int) ns;
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    int bucket = ((exponent - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) |
+                 (int) ((ns >> (exponent - METRICS_SUB_BITS)) & ((1 << METRICS_SUB_BITS) - 1));
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+/**
+ * @brief Returns the lowest latency of a histogram bucket.
+ */
+static uint64_t bucket_floor(int bucket) {
+    if (bucket < (1 << METRICS_SUB_BITS)) {
+        return (uint64_t) bucket;
+    }
+    int exponent = (bucket >> METRICS_SUB_BITS) + METRICS_SUB_BITS - 1;
+    uint64_t mantissa = (1 << METRICS_SUB_BITS) | (bucket & ((1 << METRICS_SUB_BITS) - 1));
+    return mantissa << (exponent - METRICS_SUB_BITS);
+}
+
+void record_latency(int stage, long long ns, uint64_t samples) {
+    metrics_block *block = thread_block();
+    if (block == NULL) {
+        return;
+    }
+    uint64_t value = ns > 0 ? (uint64_t) ns : 0;
+    latency_histogram *h = &block->latencies[stage];
+    add_owned(&h->counts[bucket_of(value)], samples);
+    add_owned(&h->samples, samples);
+    add_owned(&h->sum, value * samples);
+    if (value > h->max) {
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Returns the highest latency of the bucket holding the given fraction of the samples.
+ */
+static uint64_t percentile(const latency_histogram *h, double fraction) {
+    uint64_t rank = (uint64_t) (fraction * (double) h->samples);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < METRICS_BUCKETS - 1; bucket++) {
+        seen += h->counts[bucket];
+        if (seen > rank) {
+            uint64_t highest = bucket_floor(bucket + 1) - 1;
+            return highest < h->max ? highest : h->max;
+        }
+    }
+    return h->max;
+}
+
+/**
+ * @brief Returns the difference of two counters as a gauge (0 while the counters are read
+ *        in between two updates).
+ */
+static uint64_t gauge_of(const uint64_t *counters, int added, int removed) {
+    return counters[added] > counters[removed] ? counters[added] - counters[removed] : 0;
+}
+
+/**
+ * @brief Sums the blocks of all threads and writes the metrics page.
+ * @param page The stream receiving the page
+ */
+static void write_metrics_page(FILE *page) {
+    uint64_t counters[METRIC_COUNTERS] = {0};
+    static latency_histogram latencies[METRIC_LATENCIES];
+    memset(latencies, 0, sizeof(latencies));
+    int threads = 0;
+
+    for (metrics_block *block = __atomic_load_n(&g_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        threads += __atomic_load_n(&block->in_use, __ATOMIC_RELAXED) ? 1 : 0;
+        for (int i = 0; i < METRIC_COUNTERS; i++) {
+            counters[i] += __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+        }
+        for (int stage = 0; stage < METRIC_LATENCIES; stage++) {
+            const latency_histogram *from = &block->latencies[stage];
+            latency_histogram *to = &latencies[stage];
+            for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+                to->counts[bucket] += __atomic_load_n(&from->counts[bucket], __ATOMIC_RELAXED);
+            }
+            to->samples += __atomic_load_n(&from->samples, __ATOMIC_RELAXED);
+            to->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+            to->max = max > to->max ? max : to->max;
+        }
+    }
+
+    fprintf(page, "# TYPE ups_clients gauge\nups_clients %d\n", get_connected_clients_count());
+    fprintf(page, "# TYPE ups_games_active gauge\nups_games_active %d\n", count_games());
+    fprintf(page, "# TYPE ups_match_queue_depth gauge\nups_match_queue_depth %lu\n",
+            (unsigned long) gauge_of(counters, METRIC_MATCH_SUBMITTED, METRIC_MATCH_TAKEN));
+    fprintf(page, "# TYPE ups_handoffs_pending gauge\nups_handoffs_pending %lu\n",
+            (unsigned long) gauge_of(counters, METRIC_HANDOFFS_SENT, METRIC_HANDOFFS_TAKEN));
+    fprintf(page, "# TYPE ups_output_pending_bytes gauge\nups_output_pending_bytes %lu\n",
+            (unsigned long) gauge_of(counters, METRIC_OUT_QUEUED, METRIC_OUT_DRAINED));
+    fprintf(page, "# TYPE ups_metric_threads gauge\nups_metric_threads %d\n", threads);
+
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        fprintf(page, "# TYPE %s counter\n%s %lu\n", g_counterNames[i], g_counterNames[i],
+                (unsigned long) counters[i]);
+    }
+
+    fprintf(page, "# TYPE ups_latency_ns summary\n");
+    for (int stage = 0; stage < METRIC_LATENCIES; stage++) {
+        const latency_histogram *h = &latencies[stage];
+        const char *name = g_latencyNames[stage];
+        fprintf(page, "ups_latency_ns{stage=\"%s\",quantile=\"0.5\"} %lu\n", name,
+                (unsigned long) percentile(h, 0.5));
+        fprintf(page, "ups_latency_ns{stage=\"%s\",quantile=\"0.99\"} %lu\n", name,
+                (unsigned long) percentile(h, 0.99));
+        fprintf(page, "ups_latency_ns{stage=\"%s\",quantile=\"0.999\"} %lu\n", name,
+                (unsigned long) percentile(h, 0.999));
+        fprintf(page, "ups_latency_ns{stage=\"%s\",quantile=\"1\"} %lu\n", name, (unsigned long) h->max);
+        fprintf(page, "ups_latency_ns_sum{stage=\"%s\"} %lu\n", name, (unsigned long) h->sum);
+        fprintf(page, "ups_latency_ns_count{stage=\"%s\"} %lu\n", name, (unsigned long) h->samples);
+    }
+}
+
+/**
+ * @brief Writes a whole buffer to a blocking socket.
+ * @return TRUE on success
+ */
+static int write_all(int socket, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(socket, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return FALSE;
+        }
+        data += n;
+        len -= (size_t) n;
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Answers one scrape: reads the request (if any arrives within a second) and sends the page
+ *        its path names.
+ * @param socket The accepted connection
+ */
+static void serve_scrape(int socket) {
+    struct timeval timeout = {1, 0};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char request[1024];
+    request[0] = '\0';
+    size_t received = 0;
+    while (received < sizeof(request) - 1) {
+        ssize_t n = recv(socket, request + received, sizeof(request) - 1 - received, 0);
+        if (n <= 0) {
+            break;
+        }
+        received += (size_t) n;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            break;
+        }
+    }
+
+    char *body = NULL;
+    size_t bodyLen = 0;
+    FILE *page = open_memstream(&body, &bodyLen);
+    if (page == NULL) {
+        perror("Failed to build the metrics page");
+        return;
+    }
+    // The request line names the page: /clients and /games list the tables, anything else the metrics
+    char *path = strchr(request, ' ');
+    size_t pathLen = path != NULL ? strcspn(++path, " \r\n") : 0;
+    if (pathLen == strlen("/clients") && strncmp(path, "/clients", pathLen) == 0) {
+        display_all_clients(page);
+    } else if (pathLen == strlen("/games") && strncmp(path, "/games", pathLen) == 0) {
+        display_active_games(page);
+    } else {
+        write_metrics_page(page);
+    }
+    fclose(page);
+
+    char header[128];
+    int headerLen = snprintf(header, sizeof(header),
+                             "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                             "Content-Length: %zu\r\nConnection: close\r\n\r\n", bodyLen);
+    if (write_all(socket, header, (size_t) headerLen)) {
+        write_all(socket, body, bodyLen);
+    }
+    free(body);
+}
+
+/**
+ * @brief Admin endpoint thread: serves the scrapes one at a time.
+ * @param arg The listening socket
+ * @return NULL (never returns)
+ */
+static void *run_metrics_endpoint(void *arg) {
+    int listenFd = (int) (long) arg;
+    while (1) {
+        int socket = accept(listenFd, NULL, NULL);
+        if (socket == -1) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("Unable to accept metrics connection");
+            }
+            continue;
+        }
+        serve_scrape(socket);
+        close(socket);
+    }
+    return NULL;
+}
+
+int start_metrics_endpoint(int port) {
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd == -1) {
+        perror("Metrics socket creation failed");
+        return FALSE;
+    }
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+    // Only local scrapers may connect
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listenFd, 16) == -1) {
+        perror("Failed to open the metrics port");
+        close(listenFd);
+        return FALSE;
+    }
+
+    pthread_t thMetrics;
+    if (pthread_create(&thMetrics, NULL, run_metrics_endpoint, (void *) (long) listenFd) != 0) {
+        perror("Could not start the metrics endpoint");
+        close(listenFd);
+        return FALSE;
+    }
+    pthread_detach(thMetrics);
+    log_info("Metrics served on 127.0.0.1:%d", port);
+    return TRUE;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file server_metrics.h
+ * @brief Declares the server metrics: per-thread counters and latency histograms, and the
+ *        admin endpoint that serves them as a plaintext page.
+ *
+ * Every thread that records a metric gets its own block, so recording is a plain store by
+ * the block's only writer (no lock, no atomic read-modify-write). The endpoint thread sums
+ * the blocks with relaxed loads; it never takes a lock the game threads use. A block of a
+ * thread that ended is reused by the next new thread and keeps its totals.
+ *
+ * Gauges (queue depths, pending output) are published as the difference of two counters
+ * that may be counted on different threads, e.g. requests queued minus requests taken.
+ */
+
+#ifndef __SERVER_METRICS_H__
+#define __SERVER_METRICS_H__
+
+#include <stdint.h>
+#include "def_n_struct.h"
+
+/**
+ * Counters.
+ */
+#define METRIC_MESSAGES_IN          0   /**< Messages dispatched after LOGIN. */
+#define METRIC_BYTES_IN             1   /**< Bytes read from client sockets. */
+#define METRIC_MESSAGES_OUT         2   /**< Messages queued for clients. */
+#define METRIC_BYTES_OUT            3   /**< Bytes of the messages queued for clients. */
+#define METRIC_MOVES                4   /**< Accepted moves. */
+#define METRIC_MOVES_REJECTED       5   /**< Rejected MOVE requests. */
+#define METRIC_GAMES_STARTED        6   /**< Games created by matchmaking. */
+#define METRIC_LOGINS               7   /**< Clients registered. */
+#define METRIC_DISCONNECTS          8   /**< Clients removed. */
+#define METRIC_OUT_QUEUED           9   /**< Bytes appended to outbound queues. */
+#define METRIC_OUT_DRAINED          10  /**< Bytes written from or discarded with outbound queues. */
+#define METRIC_MATCH_SUBMITTED      11  /**< JOIN_GAME requests queued for the matchmaker. */
+#define METRIC_MATCH_TAKEN          12  /**< JOIN_GAME requests taken by the matchmaker. */
+#define METRIC_HANDOFFS_SENT        13  /**< Connections handed to another shard. */
+#define METRIC_HANDOFFS_TAKEN       14  /**< Connections adopted from another shard. */
+#define METRIC_COUNTERS             15
+
+/**
+ * Latency histograms (nanoseconds).
+ */
+#define LATENCY_PARSE               0   /**< Parsing one message. */
+#define LATENCY_RULES               1   /**< validate_move of a MOVE (which also settles the game). */
+#define LATENCY_REQUEST             2   /**< From a read delivering messages to their replies being written. */
+#define LATENCY_SEND                3   /**< One sendmsg of queued output. */
+#define LATENCY_MATCH_WAIT          4   /**< From JOIN_GAME to the start of the game. */
+#define METRIC_LATENCIES            5
+
+/**
+ * Reads the monotonic clock the latencies are measured with.
+ *
+ * @return Current monotonic time in nanoseconds
+ */
+long long metrics_clock_ns();
+
+/**
+ * Adds to a counter of the calling thread.
+ *
+ * @param counter One of the METRIC_* counters
+ * @param amount The increment
+ */
+void count_metric(int counter, uint64_t amount);
+
+/**
+ * Records samples of a latency in the calling thread's histogram.
+ *
+ * @param stage One of the LATENCY_* histograms
+ * @param ns The latency in nanoseconds
+ * @param samples How many samples had this latency
+ */
+void record_latency(int stage, long long ns, uint64_t samples);
+
+/**
+ * Starts the thread serving the metrics page on 127.0.0.1:port. Every connection gets the
+ * current page (as an HTTP/1.0 response, so curl and Prometheus can scrape it) and is closed.
+ * The paths /clients and /games list the registered clients and the active games instead;
+ * those lists briefly take clients_mutex and g_gamesMutex.
+ *
+ * @param port The admin port
+ * @return TRUE if the endpoint was started, FALSE otherwise
+ */
+int start_metrics_endpoint(int port);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab_pool.h"
+
+/**
+ * Objects are padded to whole cache lines so that two threads working on neighbouring
+ * objects do not share a line.
+ */
+#define SLAB_CACHE_LINE         64
+
+/**
+ * @brief Builds the handle of a slot in its current generation.
+ */
+static pool_handle make_handle(unsigned int generation, int slot) {
+    return ((pool_handle) generation << 32) | (unsigned int) slot;
+}
+
+int init_slab_pool(slab_pool *pool, size_t object_size, int capacity) {
+    pool->stride = (object_size + SLAB_CACHE_LINE - 1) / SLAB_CACHE_LINE * SLAB_CACHE_LINE;
+    pool->capacity = capacity;
+    pool->objects = aligned_alloc(SLAB_CACHE_LINE, pool->stride * (size_t) capacity);
+    pool->generations = malloc((size_t) capacity * sizeof(unsigned int));
+    pool->free_slots = malloc((size_t) capacity * sizeof(int));
+    if (pool->objects == NULL || pool->generations == NULL || pool->free_slots == NULL) {
+        perror("Failed to allocate an object pool");
+        return FALSE;
+    }
+    memset(pool->objects, 0, pool->stride * (size_t) capacity);
+
+    // The lowest slots are handed out first
+    for (int slot = 0; slot < capacity; slot++) {
+        pool->generations[slot] = 1;
+        pool->free_slots[slot] = capacity - 1 - slot;
+    }
+    pool->free_count = capacity;
+    pthread_mutex_init(&pool->lock, NULL);
+    return TRUE;
+}
+
+void *slab_object(const slab_pool *pool, int slot) {
+    return pool->objects + (size_t) slot * pool->stride;
+}
+
+void *slab_alloc(slab_pool *pool, pool_handle *handle) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count == 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    int slot = pool->free_slots[--pool->free_count];
+    pthread_mutex_unlock(&pool->lock);
+
+    *handle = make_handle(__atomic_load_n(&pool->generations[slot], __ATOMIC_RELAXED), slot);
+    return slab_object(pool, slot);
+}
+
+void slab_free(slab_pool *pool, pool_handle handle) {
+    int slot = handle_slot(handle);
+
+    // Invalidate the outstanding handles (the generation skips 0 when it wraps)
+    unsigned int generation = pool->generations[slot] + 1;
+    __atomic_store_n(&pool->generations[slot], generation != 0 ? generation : 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->free_slots[pool->free_count++] = slot;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void *slab_resolve(const slab_pool *pool, pool_handle handle) {
+    if (handle == NULL_HANDLE) {
+        return NULL;
+    }
+    int slot = handle_slot(handle);
+    if (slot >= pool->capacity ||
+        __atomic_load_n(&pool->generations[slot], __ATOMIC_ACQUIRE) != (unsigned int) (handle >> 32)) {
+        return NULL;
+    }
+    return slab_object(pool, slot);
+}
+
+int handle_slot(pool_handle handle) {
+    return (int) (handle & 0xffffffffu);
+}
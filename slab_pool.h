@@ -0,0 +1,87 @@
+/**
+ * @file slab_pool.h
+ * @brief Declares the fixed-size object pools that hold the clients and the games.
+ *
+ * A pool allocates all of its objects up front in one cache-line aligned block and never
+ * returns them to the system. Allocation and release are O(1) (a stack of free slots, the
+ * most recently released slot is reused first while it is still in cache). Every slot has a
+ * generation that changes when the object is released, so a handle to a released object
+ * is recognized as stale instead of reaching the object's next user.
+ */
+
+#ifndef __SLAB_POOL_H__
+#define __SLAB_POOL_H__
+
+#include <stddef.h>
+#include <pthread.h>
+#include "def_n_struct.h"
+
+/**
+ * A pool of capacity objects of one type.
+ */
+typedef struct {
+    char            *objects;       /**< The objects, stride bytes apart. */
+    size_t          stride;         /**< Object size rounded up to whole cache lines. */
+    int             capacity;       /**< Number of objects. */
+    unsigned int    *generations;   /**< Current generation of every slot (never 0). */
+    int             *free_slots;    /**< Stack of free slots. */
+    int             free_count;     /**< Number of entries in free_slots. */
+    pthread_mutex_t lock;           /**< Guards free_slots and free_count. */
+} slab_pool;
+
+/**
+ * Allocates the objects of a pool; call once at startup.
+ *
+ * @param pool The pool
+ * @param object_size Size of one object
+ * @param capacity Number of objects
+ * @return TRUE on success, FALSE if the memory could not be allocated
+ */
+int init_slab_pool(slab_pool *pool, size_t object_size, int capacity);
+
+/**
+ * Returns the object stored in a slot, allocated or not (used to prepare the objects once).
+ *
+ * @param pool The pool
+ * @param slot The slot, 0 to capacity - 1
+ * @return The object
+ */
+void *slab_object(const slab_pool *pool, int slot);
+
+/**
+ * Takes a free object from the pool. Its memory keeps whatever the previous user left.
+ *
+ * @param pool The pool
+ * @param handle Receives the handle of the object
+ * @return The object, or NULL if the pool is exhausted
+ */
+void *slab_alloc(slab_pool *pool, pool_handle *handle);
+
+/**
+ * Returns an object to the pool; every handle to it becomes stale.
+ *
+ * @param pool The pool
+ * @param handle The handle of the object
+ */
+void slab_free(slab_pool *pool, pool_handle handle);
+
+/**
+ * Returns the object a handle refers to. The memory always belongs to the pool, so a
+ * caller that races with slab_free reads a recycled object rather than freed memory;
+ * it must validate the object (e.g. compare its stored handle) under the object's lock.
+ *
+ * @param pool The pool
+ * @param handle The handle (NULL_HANDLE allowed)
+ * @return The object, or NULL if the handle is NULL_HANDLE or stale
+ */
+void *slab_resolve(const slab_pool *pool, pool_handle handle);
+
+/**
+ * Returns the slot a handle refers to.
+ *
+ * @param handle The handle
+ * @return The slot index
+ */
+int handle_slot(pool_handle handle);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stddef.h>
+#include <time.h>
+
+#include "timer_wheel.h"
+
+/**
+ * @brief Links an entry at the head of a list.
+ * @param head The list
+ * @param entry The entry
+ */
+static void link_timer(timer_entry **head, timer_entry *entry) {
+    entry->next = *head;
+    if (*head != NULL) {
+        (*head)->pprev = &entry->next;
+    }
+    *head = entry;
+    entry->pprev = head;
+}
+
+/**
+ * @brief Puts an entry into the slot matching its deadline: the lowest level whose range
+ *        (measured from the current tick) still contains it.
+ * @param wheel The wheel
+ * @param entry The entry, with expires set
+ */
+static void insert_timer(timer_wheel *wheel, timer_entry *entry) {
+    if (entry->expires < wheel->current) {
+        entry->expires = wheel->current;
+    }
+
+    long long delta = entry->expires - wheel->current;
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= 1LL << (TIMER_SLOT_BITS * (level + 1))) {
+        level++;
+    }
+    if (delta >= 1LL << (TIMER_SLOT_BITS * TIMER_LEVELS)) {
+        entry->expires = wheel->current + (1LL << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1;
+    }
+
+    int slot = (int) ((entry->expires >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1));
+    link_timer(&wheel->slots[level][slot], entry);
+}
+
+/**
+ * @brief Redistributes the entries of a higher level slot into the lower levels.
+ * @param wheel The wheel
+ * @param level The level (at least 1)
+ * @param slot The slot
+ */
+static void cascade_timers(timer_wheel *wheel, int level, int slot) {
+    timer_entry *entry = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    while (entry != NULL) {
+        timer_entry *next = entry->next;
+        insert_timer(wheel, entry);
+        entry = next;
+    }
+}
+
+long long monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void init_timer_wheel(timer_wheel *wheel, long long now_ms) {
+    wheel->current = now_ms / TIMER_TICK_MS;
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_SLOTS; slot++) {
+            wheel->slots[level][slot] = NULL;
+        }
+    }
+    wheel->expired = NULL;
+}
+
+void init_timer(timer_entry *entry, void *data) {
+    entry->next = NULL;
+    entry->pprev = NULL;
+    entry->expires = 0;
+    entry->data = data;
+}
+
+void schedule_timer(timer_wheel *wheel, timer_entry *entry, long long deadline_ms) {
+    cancel_timer(entry);
+    entry->expires = (deadline_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    insert_timer(wheel, entry);
+}
+
+void cancel_timer(timer_entry *entry) {
+    if (entry->pprev == NULL) {
+        return;
+    }
+    *entry->pprev = entry->next;
+    if (entry->next != NULL) {
+        entry->next->pprev = entry->pprev;
+    }
+    entry->next = NULL;
+    entry->pprev = NULL;
+}
+
+void advance_timer_wheel(timer_wheel *wheel, long long now_ms) {
+    long long target = now_ms / TIMER_TICK_MS;
+
+    while (wheel->current <= target) {
+        int slot = (int) (wheel->current & (TIMER_SLOTS - 1));
+
+        // Level 0 wrapped around: bring the next range of every higher level down
+        int index = slot;
+        for (int level = 1; level < TIMER_LEVELS && index == 0; level++) {
+            index = (int) ((wheel->current >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1));
+            cascade_timers(wheel, level, index);
+        }
+
+        timer_entry *entry = wheel->slots[0][slot];
+        wheel->slots[0][slot] = NULL;
+        while (entry != NULL) {
+            timer_entry *next = entry->next;
+            link_timer(&wheel->expired, entry);
+            entry = next;
+        }
+        wheel->current++;
+    }
+}
+
+timer_entry *pop_expired_timer(timer_wheel *wheel) {
+    timer_entry *entry = wheel->expired;
+    if (entry != NULL) {
+        cancel_timer(entry);
+    }
+    return entry;
+}
+
+long long next_timer_deadline(const timer_wheel *wheel) {
+    if (wheel->expired != NULL) {
+        return (wheel->current - 1) * TIMER_TICK_MS;
+    }
+
+    // Level 0 slots up to its wrap-around; the wrap itself cascades the higher levels
+    long long tick = wheel->current;
+    while (wheel->slots[0][tick & (TIMER_SLOTS - 1)] == NULL && (tick & (TIMER_SLOTS - 1)) != 0) {
+        tick++;
+    }
+    return tick * TIMER_TICK_MS;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file timer_wheel.h
+ * @brief Declares the hierarchical timer wheel that keeps the ping and zombie deadlines.
+ *
+ * Scheduling and cancelling a deadline are O(1); advancing the wheel costs one slot per
+ * elapsed tick plus an occasional cascade of a higher level, independent of how many
+ * deadlines are pending. A wheel is not thread-safe; its owner serializes the calls.
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include "def_n_struct.h"
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return Current monotonic time in milliseconds
+ */
+long long monotonic_ms();
+
+/**
+ * Prepares an empty wheel.
+ *
+ * @param wheel The wheel
+ * @param now_ms Current monotonic time in milliseconds
+ */
+void init_timer_wheel(timer_wheel *wheel, long long now_ms);
+
+/**
+ * Prepares an unscheduled entry.
+ *
+ * @param entry The entry
+ * @param data The owner, returned with the entry when it expires
+ */
+void init_timer(timer_entry *entry, void *data);
+
+/**
+ * Schedules (or moves) an entry to the given deadline, rounded up to the next tick.
+ * A deadline in the past expires on the next tick.
+ *
+ * @param wheel The wheel
+ * @param entry The entry
+ * @param deadline_ms Monotonic time in milliseconds
+ */
+void schedule_timer(timer_wheel *wheel, timer_entry *entry, long long deadline_ms);
+
+/**
+ * Removes an entry from its wheel, whether pending or already expired; no-op if unscheduled.
+ *
+ * @param entry The entry
+ */
+void cancel_timer(timer_entry *entry);
+
+/**
+ * Moves every entry whose deadline is not after now_ms to the wheel's expired list.
+ *
+ * @param wheel The wheel
+ * @param now_ms Current monotonic time in milliseconds
+ */
+void advance_timer_wheel(timer_wheel *wheel, long long now_ms);
+
+/**
+ * Takes the next expired entry off the wheel.
+ *
+ * @param wheel The wheel
+ * @return The entry (unscheduled), or NULL if none has expired
+ */
+timer_entry *pop_expired_timer(timer_wheel *wheel);
+
+/**
+ * Returns when the wheel needs to be advanced next: the first non-empty level 0 slot,
+ * or the next cascade of the higher levels.
+ *
+ * @param wheel The wheel
+ * @return Monotonic time in milliseconds
+ */
+long long next_timer_deadline(const timer_wheel *wheel);
+
+#endif
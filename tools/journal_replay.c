@@ -0,0 +1,325 @@
+/**
+ * @file journal_replay.c
+ * @brief Rebuilds the games of a move journal and checks every move and result against the
+ *        rules engine.
+ *
+ * The records are grouped by run (each JOURNAL_OPEN starts one) and game, and ordered by
+ * their disc count. A game starts from the position of its SEAT records; every MOVE must be
+ * made by the player on turn, be legal and flip exactly the recorded discs, and a RESULT must
+ * match the replayed position and winner. Games without a RESULT or END were still running
+ * when the journal was copied (or when the server stopped).
+ *
+ * Usage: journal_replay [-v] journal_file
+ *        -v prints every game with its final board
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../def_n_struct.h"
+#include "../rules_engine.h"
+#include "../slab_pool.h"
+#include "../move_journal.h"
+
+/**
+ * A record of the journal with the run it belongs to.
+ */
+typedef struct {
+    const journal_record    *record;
+    int                     run;        /**< Number of JOURNAL_OPEN records before it. */
+    int                     position;   /**< Position in the file (keeps equal keys in file order). */
+} replay_entry;
+
+/**
+ * A game being replayed.
+ */
+typedef struct {
+    int                 run;
+    uint64_t            game;
+    const rules_kernel  *kernel;
+    bitboard            discs[2];
+    int                 on_turn;
+    int                 seated;                     /**< Bit per seat with a SEAT record. */
+    char                names[2][PLAYER_NAME_SIZE]; /**< NUL-terminated usernames. */
+    int                 moves;
+    int                 ended;                      /**< JOURNAL_RESULT, JOURNAL_END or 0. */
+    int                 errors;
+} replay_game;
+
+/**
+ * Totals over the whole journal.
+ */
+typedef struct {
+    int     games;
+    int     moves;
+    int     finished;
+    int     abandoned;
+    int     unfinished;
+    int     errors;
+} replay_totals;
+
+/**
+ * @brief Order in which the record types of one disc count are replayed.
+ */
+static int type_rank(int type) {
+    return type == JOURNAL_SEAT ? 0 : type == JOURNAL_MOVE ? 1 : 2;
+}
+
+/**
+ * @brief Sorts the entries by run, game, disc count, type and file position.
+ */
+static int compare_entries(const void *a, const void *b) {
+    const replay_entry *x = a;
+    const replay_entry *y = b;
+    if (x->run != y->run) {
+        return x->run < y->run ? -1 : 1;
+    }
+    if (x->record->game != y->record->game) {
+        return x->record->game < y->record->game ? -1 : 1;
+    }
+    if (x->record->ply != y->record->ply) {
+        return x->record->ply < y->record->ply ? -1 : 1;
+    }
+    if (type_rank(x->record->type) != type_rank(y->record->type)) {
+        return type_rank(x->record->type) < type_rank(y->record->type) ? -1 : 1;
+    }
+    return x->position < y->position ? -1 : x->position > y->position;
+}
+
+/**
+ * @brief Counts the set bits of a bitboard.
+ */
+static int count_discs(bitboard b) {
+    return __builtin_popcountll((uint64_t) b) + __builtin_popcountll((uint64_t) (b >> 64));
+}
+
+/**
+ * @brief Reports an inconsistency of a game.
+ */
+static void report(replay_game *g, const journal_record *record, const char *problem) {
+    printf("run %d game %d (%s vs %s), record at %d discs: %s\n", g->run, handle_slot(g->game), g->names[0],
+           g->names[1], record->ply, problem);
+    g->errors++;
+}
+
+/**
+ * @brief Replays one record of a game.
+ */
+static void replay_record(replay_game *g, const journal_record *record) {
+    if (g->ended) {
+        report(g, record, "record after the end of the game");
+        return;
+    }
+
+    switch (record->type) {
+        case JOURNAL_SEAT:
+            if (record->seat > 1 || record->name_len >= PLAYER_NAME_SIZE || g->kernel == NULL) {
+                report(g, record, "invalid seat");
+                return;
+            }
+            memcpy(g->names[record->seat], record->name, record->name_len);
+            g->names[record->seat][record->name_len] = '\0';
+            g->seated |= 1 << record->seat;
+            g->discs[0] = record->discs[0];
+            g->discs[1] = record->discs[1];
+            g->on_turn = record->x;
+            break;
+
+        case JOURNAL_MOVE: {
+            int own = record->seat;
+            int cell = record->y * record->board_size + record->x;
+            if (g->seated != 3) {
+                report(g, record, "move before both players were seated");
+                return;
+            }
+            if (own > 1 || own != g->on_turn) {
+                report(g, record, "move out of turn");
+                return;
+            }
+            if (record->name_len != strlen(g->names[own]) ||
+                memcmp(record->name, g->names[own], record->name_len) != 0) {
+                report(g, record, "move by a player not seated in the game");
+                return;
+            }
+            bitboard flips = 0;
+            if (record->x < record->board_size && record->y < record->board_size &&
+                !((g->discs[0] | g->discs[1]) & ((bitboard) 1 << cell))) {
+                flips = g->kernel->compute_flips(g->discs[own], g->discs[1 - own], cell);
+            }
+            if (flips == 0) {
+                report(g, record, "illegal move");
+                return;
+            }
+            if (flips != record->discs[0]) {
+                report(g, record, "flipped discs differ from the rules");
+            }
+            g->discs[own] |= flips | ((bitboard) 1 << cell);
+            g->discs[1 - own] &= ~flips;
+
+            // The opponent is on turn next unless it has to pass
+            bitboard moves[2];
+            g->kernel->generate_both_moves(g->discs[0], g->discs[1], moves);
+            g->on_turn = moves[1 - own] == 0 && moves[own] != 0 ? own : 1 - own;
+            g->moves++;
+            break;
+        }
+
+        case JOURNAL_RESULT: {
+            int first = count_discs(g->discs[0]);
+            int second = count_discs(g->discs[1]);
+            int winner = first > second ? 0 : second > first ? 1 : JOURNAL_NO_SEAT;
+            if (record->discs[0] != g->discs[0] || record->discs[1] != g->discs[1]) {
+                report(g, record, "final position differs from the replayed one");
+            } else if (record->seat != winner) {
+                report(g, record, "winner differs from the final position");
+            } else if (g->kernel->generate_moves(g->discs[0], g->discs[1]) != 0 ||
+                       g->kernel->generate_moves(g->discs[1], g->discs[0]) != 0) {
+                report(g, record, "game ended while a player could move");
+            }
+            g->ended = JOURNAL_RESULT;
+            break;
+        }
+
+        case JOURNAL_END:
+            g->ended = JOURNAL_END;
+            break;
+
+        default:
+            report(g, record, "unknown record type");
+    }
+}
+
+/**
+ * @brief Prints a game and its final board.
+ */
+static void print_game(const replay_game *g) {
+    const char *state = g->ended == JOURNAL_RESULT ? "finished" : g->ended == JOURNAL_END ? "abandoned" : "unfinished";
+    printf("run %d game %d: %s vs %s, %d moves, %s, %d:%d\n", g->run, handle_slot(g->game), g->names[0], g->names[1],
+           g->moves, state, count_discs(g->discs[0]), count_discs(g->discs[1]));
+    for (int row = 0; row < g->kernel->size; row++) {
+        printf("    ");
+        for (int col = 0; col < g->kernel->size; col++) {
+            bitboard cell = (bitboard) 1 << (row * g->kernel->size + col);
+            putchar((g->discs[0] & cell) ? FIRST_PL_CHAR : (g->discs[1] & cell) ? SECOND_PL_CHAR : '-');
+        }
+        putchar('\n');
+    }
+}
+
+/**
+ * @brief Adds a replayed game to the totals.
+ */
+static void finish_game(const replay_game *g, replay_totals *totals, int verbose) {
+    if (verbose && g->kernel != NULL) {
+        print_game(g);
+    }
+    totals->games++;
+    totals->moves += g->moves;
+    totals->errors += g->errors;
+    if (g->ended == JOURNAL_RESULT) {
+        totals->finished++;
+    } else if (g->ended == JOURNAL_END) {
+        totals->abandoned++;
+    } else {
+        totals->unfinished++;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int verbose = FALSE;
+    int opt;
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        if (opt == 'v') {
+            verbose = TRUE;
+        } else {
+            fprintf(stderr, "Usage: %s [-v] journal_file\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-v] journal_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror("Failed to open the journal");
+        return EXIT_FAILURE;
+    }
+    size_t count = (size_t) st.st_size / sizeof(journal_record);
+    if ((size_t) st.st_size % sizeof(journal_record) != 0) {
+        printf("Ignoring a torn record at the end of the journal\n");
+    }
+    journal_record *records = malloc(count * sizeof(journal_record) + 1);
+    replay_entry *entries = malloc(count * sizeof(replay_entry) + 1);
+    if (records == NULL || entries == NULL) {
+        perror("Failed to allocate the journal");
+        return EXIT_FAILURE;
+    }
+    size_t loaded = 0;
+    while (loaded < count * sizeof(journal_record)) {
+        ssize_t got = read(fd, (char *) records + loaded, count * sizeof(journal_record) - loaded);
+        if (got <= 0) {
+            perror("Failed to read the journal");
+            return EXIT_FAILURE;
+        }
+        loaded += (size_t) got;
+    }
+    close(fd);
+
+    init_rules_engine();
+
+    // Split the journal into runs; only the games are kept for sorting
+    int runs = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].type == JOURNAL_OPEN) {
+            if (records[i].name_len != strlen(JOURNAL_MAGIC) ||
+                memcmp(records[i].name, JOURNAL_MAGIC, records[i].name_len) != 0) {
+                fprintf(stderr, "Not a move journal (or a different version)\n");
+                return EXIT_FAILURE;
+            }
+            runs++;
+            continue;
+        }
+        if (runs == 0) {
+            fprintf(stderr, "Not a move journal: it does not start with a run\n");
+            return EXIT_FAILURE;
+        }
+        entries[used].record = &records[i];
+        entries[used].run = runs;
+        entries[used].position = (int) i;
+        used++;
+    }
+    qsort(entries, used, sizeof(replay_entry), compare_entries);
+
+    replay_totals totals = {0};
+    replay_game g;
+    for (size_t i = 0; i < used; i++) {
+        const journal_record *record = entries[i].record;
+        if (i == 0 || entries[i].run != g.run || record->game != g.game) {
+            if (i > 0) {
+                finish_game(&g, &totals, verbose);
+            }
+            memset(&g, 0, sizeof(g));
+            g.run = entries[i].run;
+            g.game = record->game;
+            g.kernel = get_rules_kernel(record->board_size);
+        }
+        replay_record(&g, record);
+    }
+    if (used > 0) {
+        finish_game(&g, &totals, verbose);
+    }
+
+    printf("%d runs, %d games (%d finished, %d abandoned, %d unfinished), %d moves, %d errors\n", runs, totals.games,
+           totals.finished, totals.abandoned, totals.unfinished, totals.moves, totals.errors);
+    free(entries);
+    free(records);
+    return totals.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}